@@ -39,7 +39,7 @@ void load_watch_history() {
 	
 	std::vector<HistoryVideo> loaded_watch_history;
 	if (version >= 0) {
-		for (auto video : data_json["history"].array_items()) {
+		for (auto video : data_json["history"].array_range()) {
 			HistoryVideo cur_video;
 			cur_video.id = video["id"].string_value();
 			cur_video.title = video["title"].string_value();
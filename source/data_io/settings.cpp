@@ -48,6 +48,7 @@ void load_settings() {
 	var_autoplay_level = std::min(2, std::max(0, load_int("autoplay_level", 2)));
 	var_loop_mode = std::min(2, std::max(0, load_int("loop_mode", 0)));
 	var_forward_buffer_ratio = std::max(0.1, std::min(1.0, load_double("forward_buffer_ratio", 0.8)));
+	var_stream_disk_cache = load_int("stream_disk_cache", 0);
 	var_history_enabled = load_int("history_enabled", 1);
 	var_video_show_debug_info = load_int("video_show_debug_info", 0);
 	var_video_linear_filter = load_int("linear_filter", 1);
@@ -86,6 +87,7 @@ void save_settings() {
 	add_int("autoplay_level", var_autoplay_level);
 	add_int("loop_mode", var_loop_mode);
 	add_double("forward_buffer_ratio", var_forward_buffer_ratio);
+	add_int("stream_disk_cache", var_stream_disk_cache);
 	add_int("history_enabled", var_history_enabled);
 	add_int("video_show_debug_info", var_video_show_debug_info);
 	add_int("linear_filter", var_video_linear_filter);
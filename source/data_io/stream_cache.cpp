@@ -0,0 +1,283 @@
+#include "headers.hpp"
+#include "stream_cache.hpp"
+#include "util/misc_tasks.hpp"
+#include <map>
+#include <deque>
+
+#define STREAM_CACHE_DIR (DEF_MAIN_DIR + "stream_cache/")
+#define STREAM_CACHE_INDEX_PATH (STREAM_CACHE_DIR + "index.bin")
+#define STREAM_CACHE_INDEX_TMP_PATH (STREAM_CACHE_DIR + "index_tmp.bin")
+
+#define STREAM_CACHE_INDEX_MAGIC 0x31435353 // "SSC1"
+#define STREAM_CACHE_BUDGET ((u64) 256 * 1000 * 1000) // bytes of blocks kept on the SD card
+#define STREAM_CACHE_PENDING_MAX 3 // blocks waiting to be written, more are dropped so that spilling never eats up the RAM
+
+struct BlockEntry {
+	u32 offset; // in the data file
+	u32 size;
+};
+struct CachedStream {
+	u64 len;
+	u32 last_access; // value of `access_cnter` at the last access
+	u32 data_file_size;
+	std::map<u32, BlockEntry> blocks;
+};
+struct PendingBlock {
+	std::string id;
+	u64 len;
+	u32 block;
+	u8 *data; // owned, freed once written
+	u32 size;
+};
+struct IndexHeader {
+	u32 magic;
+	u32 stream_num;
+	u32 access_cnter;
+};
+struct IndexStreamHeader { // followed by `id_len` bytes of the id and `block_num` IndexBlockRecord
+	u32 id_len;
+	u32 last_access;
+	u64 len;
+	u32 data_file_size;
+	u32 block_num;
+};
+struct IndexBlockRecord {
+	u32 block;
+	BlockEntry entry;
+};
+
+static Mutex resource_lock;
+static bool index_loaded = false;
+static std::map<std::string, CachedStream> cached_streams;
+static u32 access_cnter = 0;
+static u64 total_size = 0; // the total size of the data files
+static std::deque<PendingBlock> pending_writes;
+
+static AtomicFileIO index_io(STREAM_CACHE_INDEX_PATH, STREAM_CACHE_INDEX_TMP_PATH);
+
+static std::string get_data_file_path(const std::string &id) { return STREAM_CACHE_DIR + id + ".bin"; }
+
+static std::string get_url_parameter(const std::string &url, const std::string &name) {
+	auto pos = url.find("&" + name + "=");
+	if (pos == std::string::npos) pos = url.find("?" + name + "=");
+	if (pos == std::string::npos) return "";
+	pos += name.size() + 2;
+	std::string res;
+	while (pos < url.size() && url[pos] != '&') res.push_back(url[pos++]);
+	return res;
+}
+std::string stream_disk_cache_get_id(const std::string &url) {
+	// the urls themselves expire, but {itag, last modified time, length} identifies the same encoding of the same video
+	std::string itag = get_url_parameter(url, "itag");
+	std::string lmt = get_url_parameter(url, "lmt");
+	std::string clen = get_url_parameter(url, "clen");
+	for (auto str : {&itag, &lmt, &clen}) {
+		if (!str->size() || str->size() > 20) return "";
+		for (auto c : *str) if (!isdigit(c)) return "";
+	}
+	return itag + "_" + lmt + "_" + clen;
+}
+
+// returns false if the data is broken
+// the streams and the access counter are stored to `streams` and `access_cnter_dst` if they're not NULL
+static bool parse_index(const std::string &data, std::map<std::string, CachedStream> *streams, u32 *access_cnter_dst) {
+	if (data.size() < sizeof(IndexHeader)) return false;
+	IndexHeader header;
+	memcpy(&header, data.data(), sizeof(IndexHeader));
+	if (header.magic != STREAM_CACHE_INDEX_MAGIC) return false;
+	size_t pos = sizeof(IndexHeader);
+	for (u32 i = 0; i < header.stream_num; i++) {
+		IndexStreamHeader stream_header;
+		if (pos + sizeof(IndexStreamHeader) > data.size()) return false;
+		memcpy(&stream_header, data.data() + pos, sizeof(IndexStreamHeader));
+		pos += sizeof(IndexStreamHeader);
+		if (pos + stream_header.id_len + (u64) stream_header.block_num * sizeof(IndexBlockRecord) > data.size()) return false;
+		std::string id = data.substr(pos, stream_header.id_len);
+		pos += stream_header.id_len;
+		CachedStream stream{stream_header.len, stream_header.last_access, stream_header.data_file_size, {}};
+		for (u32 j = 0; j < stream_header.block_num; j++) {
+			IndexBlockRecord record;
+			memcpy(&record, data.data() + pos, sizeof(IndexBlockRecord));
+			pos += sizeof(IndexBlockRecord);
+			stream.blocks[record.block] = record.entry;
+		}
+		if (streams) (*streams)[id] = stream;
+	}
+	if (access_cnter_dst) *access_cnter_dst = header.access_cnter;
+	return pos == data.size();
+}
+static bool is_valid_index(const std::string &data) { return parse_index(data, NULL, NULL); }
+static std::string serialize_index_wo_lock() {
+	std::string res;
+	auto append = [&] (const void *data, size_t size) { res.append((const char *) data, size); };
+	IndexHeader header{STREAM_CACHE_INDEX_MAGIC, (u32) cached_streams.size(), access_cnter};
+	append(&header, sizeof(header));
+	for (auto &i : cached_streams) {
+		IndexStreamHeader stream_header{(u32) i.first.size(), i.second.last_access, i.second.len, i.second.data_file_size, (u32) i.second.blocks.size()};
+		append(&stream_header, sizeof(stream_header));
+		append(i.first.data(), i.first.size());
+		for (auto &j : i.second.blocks) {
+			IndexBlockRecord record{j.first, j.second};
+			append(&record, sizeof(record));
+		}
+	}
+	return res;
+}
+// reads the index and checks it against the data files, without holding resource_lock as it can take a while on the SD card
+// until it's done, the cache is treated as empty by the read path
+void stream_disk_cache_load() {
+	resource_lock.lock();
+	bool already_loaded = index_loaded;
+	resource_lock.unlock();
+	if (already_loaded) return;
+	
+	std::map<std::string, CachedStream> loaded_streams;
+	u64 loaded_size = 0;
+	u32 loaded_access_cnter = 0;
+	auto tmp = index_io.load(is_valid_index);
+	if (tmp.first.code == 0 && !parse_index(tmp.second, &loaded_streams, &loaded_access_cnter)) {
+		logger.caution("stream-cache", "index broken, starting over");
+		loaded_streams.clear();
+	}
+	for (auto it = loaded_streams.begin(); it != loaded_streams.end(); ) {
+		u64 actual_size = 0;
+		if (Path(get_data_file_path(it->first)).get_size(actual_size).code != 0) {
+			it = loaded_streams.erase(it);
+			continue;
+		}
+		// the data may never have been written (e.g. the app crashed)
+		it->second.data_file_size = std::min<u64>(it->second.data_file_size, actual_size);
+		// or may have been written without the index being saved, in which case the next append
+		// would be recorded at `data_file_size` while being written at the actual end, so drop it
+		if (actual_size > it->second.data_file_size && Path(get_data_file_path(it->first)).truncate_file(it->second.data_file_size).code != 0) {
+			Path(get_data_file_path(it->first)).delete_file();
+			it = loaded_streams.erase(it);
+			continue;
+		}
+		auto &blocks = it->second.blocks;
+		for (auto block = blocks.begin(); block != blocks.end(); ) {
+			if ((u64) block->second.offset + block->second.size > it->second.data_file_size) block = blocks.erase(block);
+			else block++;
+		}
+		loaded_size += it->second.data_file_size;
+		it++;
+	}
+	
+	size_t stream_num = loaded_streams.size();
+	resource_lock.lock();
+	// only the misc tasks thread writes to the cache and it does so after loading, so nothing can have been added meanwhile
+	cached_streams = std::move(loaded_streams);
+	total_size = loaded_size;
+	access_cnter = loaded_access_cnter;
+	index_loaded = true;
+	resource_lock.unlock();
+	logger.info("stream-cache", "loaded " + std::to_string(stream_num) + " streams (" + std::to_string(loaded_size / 1000000) + " MB)");
+}
+
+bool stream_disk_cache_has_block(const std::string &id, u64 block) {
+	resource_lock.lock();
+	bool res = cached_streams.count(id) && cached_streams[id].blocks.count(block);
+	resource_lock.unlock();
+	return res;
+}
+u32 stream_disk_cache_read_block(const std::string &id, u64 block, u8 *dst, u32 dst_size) {
+	u32 res = 0;
+	resource_lock.lock();
+	if (cached_streams.count(id) && cached_streams[id].blocks.count(block)) {
+		CachedStream &stream = cached_streams[id];
+		BlockEntry entry = stream.blocks[block];
+		u32 read_size = 0;
+		auto result = Path(get_data_file_path(id)).read_file(dst, std::min(entry.size, dst_size), read_size, entry.offset);
+		if (result.code != 0 || read_size != std::min(entry.size, dst_size)) {
+			logger.error("stream-cache", "read failed : " + result.string);
+			stream.blocks.erase(block);
+		} else {
+			stream.last_access = ++access_cnter;
+			res = read_size;
+		}
+	}
+	resource_lock.unlock();
+	return res;
+}
+
+bool stream_disk_cache_put_block(const std::string &id, u64 len, u64 block, u8 *data, u32 size, bool ignore_queue_limit) {
+	if (id == "" || !size) return false;
+	resource_lock.lock();
+	bool needed = !(cached_streams.count(id) && cached_streams[id].blocks.count(block));
+	for (auto &i : pending_writes) if (i.id == id && i.block == block) needed = false;
+	if (needed && !ignore_queue_limit && pending_writes.size() >= STREAM_CACHE_PENDING_MAX) needed = false;
+	if (needed) pending_writes.push_back({id, len, (u32) block, data, size});
+	resource_lock.unlock();
+	if (needed) misc_tasks_request(TASK_FLUSH_STREAM_CACHE);
+	return needed;
+}
+
+void stream_disk_cache_flush() {
+	stream_disk_cache_load(); // in case TASK_LOAD_STREAM_CACHE hasn't been processed yet
+	while (1) {
+		// the file operations are performed without the lock so that the downloader can read from the cache meanwhile
+		resource_lock.lock();
+		if (!pending_writes.size()) {
+			resource_lock.unlock();
+			break;
+		}
+		PendingBlock pending = std::move(pending_writes.front());
+		pending_writes.pop_front();
+		if (cached_streams.count(pending.id) && cached_streams[pending.id].len == pending.len && cached_streams[pending.id].blocks.count(pending.block)) {
+			resource_lock.unlock(); // queued before the index was loaded
+			free(pending.data);
+			continue;
+		}
+		CachedStream &stream = cached_streams[pending.id];
+		if (stream.len != pending.len) { // newly added (or broken)
+			total_size -= stream.data_file_size;
+			stream = CachedStream{pending.len, 0, 0, {}};
+		}
+		u32 offset = stream.data_file_size;
+		resource_lock.unlock();
+		
+		if (offset == 0) Path(get_data_file_path(pending.id)).delete_file(); // leftover of an evicted stream
+		auto result = Path(get_data_file_path(pending.id)).append_file(pending.data, pending.size);
+		free(pending.data);
+		
+		resource_lock.lock();
+		if (!cached_streams.count(pending.id) || cached_streams[pending.id].data_file_size != offset) {
+			resource_lock.unlock(); // evicted meanwhile
+			continue;
+		}
+		CachedStream &cur_stream = cached_streams[pending.id];
+		std::vector<std::string> ids_to_delete; // deleted after unlocking, deleting a large file on FAT takes a while
+		if (result.code != 0) {
+			logger.error("stream-cache", "append failed : " + result.string);
+			// the file may have been partially written, so start it over
+			total_size -= cur_stream.data_file_size;
+			cached_streams.erase(pending.id);
+			ids_to_delete.push_back(pending.id);
+		} else {
+			cur_stream.blocks[pending.block] = {offset, pending.size};
+			cur_stream.data_file_size += pending.size;
+			cur_stream.last_access = ++access_cnter;
+			total_size += pending.size;
+		}
+		
+		// evict least recently used streams (other than the one just written)
+		if (total_size > STREAM_CACHE_BUDGET) {
+			std::vector<std::pair<u32, std::string> > access_order; // {last access, id}
+			for (auto &i : cached_streams) if (i.first != pending.id) access_order.push_back({i.second.last_access, i.first});
+			std::sort(access_order.begin(), access_order.end());
+			for (auto &i : access_order) {
+				if (total_size <= STREAM_CACHE_BUDGET * 9 / 10) break;
+				total_size -= cached_streams[i.second].data_file_size;
+				cached_streams.erase(i.second);
+				ids_to_delete.push_back(i.second);
+			}
+		}
+		std::string index_data = serialize_index_wo_lock();
+		resource_lock.unlock();
+		
+		// no data file can be recreated meanwhile as they're only written from this thread
+		for (auto &id : ids_to_delete) Path(get_data_file_path(id)).delete_file();
+		result = index_io.save(index_data);
+		if (result.code != 0) logger.error("stream-cache", "index save failed : " + result.string);
+	}
+}
@@ -0,0 +1,24 @@
+#pragma once
+#include <string>
+#include "types.hpp"
+
+// second-tier cache of stream blocks on the SD card
+// blocks dropped from the RAM cache of NetworkStream are queued here and written by the misc tasks thread
+// each stream gets its own data file, to which blocks are appended in the order they are written (FAT has no sparse files),
+// and a single index file maps {stream, block} to the position in the data file
+// the total size is kept under the budget by deleting the least recently used streams
+
+// loads the index and checks it against the data files (TASK_LOAD_STREAM_CACHE, called from the misc tasks thread)
+// the cache is empty to the read path until this is done, so that a read never has to wait for the SD card scan
+void stream_disk_cache_load();
+// returns the id of the stream of `url` that stays the same across sessions ("" if it can't be identified)
+std::string stream_disk_cache_get_id(const std::string &url);
+bool stream_disk_cache_has_block(const std::string &id, u64 block);
+// reads the block into `dst` and returns its size (0 if not cached or the read failed)
+u32 stream_disk_cache_read_block(const std::string &id, u64 block, u8 *dst, u32 dst_size);
+// queues the block to be written and requests TASK_FLUSH_STREAM_CACHE
+// on success, the ownership of `data` (allocated with malloc()) moves to the cache, which frees it once written
+// returns false without taking `data` if the block is not needed or the queue is full (unless `ignore_queue_limit` is set)
+bool stream_disk_cache_put_block(const std::string &id, u64 len, u64 block, u8 *data, u32 size, bool ignore_queue_limit = false);
+// writes queued blocks and the index, evicting least recently used streams to keep the size budget (called from the misc tasks thread)
+void stream_disk_cache_flush();
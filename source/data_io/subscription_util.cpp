@@ -43,7 +43,7 @@ void load_subscription() {
 	
 	std::vector<SubscriptionChannel> loaded_channels;
 	if (version >= 0) {
-		for (auto video : data_json["channels"].array_items()) {
+		for (auto video : data_json["channels"].array_range()) {
 			SubscriptionChannel cur_channel;
 			cur_channel.id = video["id"].string_value();
 			cur_channel.url = video["url"].string_value();
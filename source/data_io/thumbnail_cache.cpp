@@ -0,0 +1,276 @@
+#include "headers.hpp"
+#include "thumbnail_cache.hpp"
+#include "util/misc_tasks.hpp"
+#include <map>
+#include <unordered_map>
+
+#define THUMBNAIL_CACHE_DATA_PATH (DEF_MAIN_DIR + "thumbnail_cache/data.bin")
+#define THUMBNAIL_CACHE_DATA_TMP_PATH (DEF_MAIN_DIR + "thumbnail_cache/data_tmp.bin")
+#define THUMBNAIL_CACHE_INDEX_PATH (DEF_MAIN_DIR + "thumbnail_cache/index.bin")
+#define THUMBNAIL_CACHE_INDEX_TMP_PATH (DEF_MAIN_DIR + "thumbnail_cache/index_tmp.bin")
+
+#define THUMBNAIL_CACHE_INDEX_MAGIC 0x31435454 // "TTC1"
+#define THUMBNAIL_CACHE_BUDGET (16 * 1000 * 1000) // bytes of live thumbnails kept on the SD card
+#define THUMBNAIL_CACHE_ENTRY_SIZE_MAX (256 * 1000) // larger images are not cached on the SD card
+
+struct IndexEntry {
+	u32 offset;
+	u32 size;
+	u32 last_access; // value of `access_cnter` at the last access
+};
+struct IndexHeader {
+	u32 magic;
+	u32 entry_num;
+	u32 access_cnter;
+	u32 data_file_size;
+};
+struct IndexRecord {
+	u64 url_hash;
+	IndexEntry entry;
+};
+
+static Mutex resource_lock;
+static bool index_loaded = false;
+static bool index_dirty = false;
+static std::unordered_map<u64, IndexEntry> cache_index;
+static u32 access_cnter = 0;
+static u32 data_file_size = 0; // may contain the data of evicted entries until compacted
+static u64 live_size = 0; // the total size of the entries in `cache_index`
+static std::map<u64, std::vector<u8> > pending_writes;
+
+static AtomicFileIO index_io(THUMBNAIL_CACHE_INDEX_PATH, THUMBNAIL_CACHE_INDEX_TMP_PATH);
+
+// 64-bit FNV-1a
+static u64 get_url_hash(const std::string &url) {
+	u64 res = 0xcbf29ce484222325ULL;
+	for (auto c : url) res = (res ^ (u8) c) * 0x100000001b3ULL;
+	return res;
+}
+
+static bool is_valid_index(const std::string &data) {
+	if (data.size() < sizeof(IndexHeader)) return false;
+	const IndexHeader *header = (const IndexHeader *) data.data();
+	return header->magic == THUMBNAIL_CACHE_INDEX_MAGIC && data.size() == sizeof(IndexHeader) + (size_t) header->entry_num * sizeof(IndexRecord);
+}
+// resource_lock must be held
+static void load_index_wo_lock() {
+	if (index_loaded) return;
+	index_loaded = true;
+	
+	u64 actual_data_file_size = 0;
+	if (Path(THUMBNAIL_CACHE_DATA_PATH).get_size(actual_data_file_size).code != 0) return; // no cache yet
+	
+	auto tmp = index_io.load(is_valid_index);
+	if (tmp.first.code != 0 || !is_valid_index(tmp.second)) {
+		logger.caution("thumb-cache", "index not available, starting over");
+		Path(THUMBNAIL_CACHE_DATA_PATH).delete_file();
+		return;
+	}
+	const IndexHeader *header = (const IndexHeader *) tmp.second.data();
+	const IndexRecord *records = (const IndexRecord *) (tmp.second.data() + sizeof(IndexHeader));
+	access_cnter = header->access_cnter;
+	data_file_size = std::min<u64>(header->data_file_size, actual_data_file_size);
+	// data appended after the last index save (e.g. the app crashed in between) is dropped,
+	// otherwise the next append would be recorded at `data_file_size` while being written at the actual end
+	if (actual_data_file_size > data_file_size && Path(THUMBNAIL_CACHE_DATA_PATH).truncate_file(data_file_size).code != 0) {
+		logger.caution("thumb-cache", "truncation failed, starting over");
+		Path(THUMBNAIL_CACHE_DATA_PATH).delete_file();
+		data_file_size = 0;
+		return;
+	}
+	for (u32 i = 0; i < header->entry_num; i++) {
+		const IndexEntry &entry = records[i].entry;
+		if ((u64) entry.offset + entry.size > data_file_size) continue; // the data was never written (e.g. the app crashed)
+		cache_index[records[i].url_hash] = entry;
+		live_size += entry.size;
+	}
+	logger.info("thumb-cache", "loaded " + std::to_string(cache_index.size()) + " entries");
+}
+
+bool thumbnail_disk_cache_get(const std::string &url, std::vector<u8> &data) {
+	u64 hash = get_url_hash(url);
+	resource_lock.lock();
+	load_index_wo_lock();
+	bool res = false;
+	if (pending_writes.count(hash)) {
+		data = pending_writes[hash];
+		res = true;
+	} else if (cache_index.count(hash)) {
+		IndexEntry &entry = cache_index[hash];
+		data.resize(entry.size);
+		u32 read_size = 0;
+		auto result = Path(THUMBNAIL_CACHE_DATA_PATH).read_file(data.data(), entry.size, read_size, entry.offset);
+		if (result.code != 0 || read_size != entry.size) {
+			logger.error("thumb-cache", "read failed : " + result.string);
+			live_size -= entry.size;
+			cache_index.erase(hash);
+			data.clear();
+		} else {
+			entry.last_access = ++access_cnter;
+			res = true;
+		}
+		index_dirty = true;
+	}
+	resource_lock.unlock();
+	return res;
+}
+
+void thumbnail_disk_cache_put(const std::string &url, const std::vector<u8> &data) {
+	if (!data.size() || data.size() > THUMBNAIL_CACHE_ENTRY_SIZE_MAX) return;
+	u64 hash = get_url_hash(url);
+	resource_lock.lock();
+	bool needed = !cache_index.count(hash) && !pending_writes.count(hash);
+	if (needed) pending_writes[hash] = data;
+	resource_lock.unlock();
+	if (needed) misc_tasks_request(TASK_FLUSH_THUMBNAIL_CACHE);
+}
+
+// copies `entries` (sorted by offset) from the data file into the temporary data file, updating their offsets to the new ones
+// entries that could not be read get `size` of 0
+// performed without resource_lock as it may read and write the whole budget; only the misc tasks thread modifies the data file
+static Result_with_string write_compacted_data_file(std::vector<std::pair<u64, IndexEntry> > &entries, u32 &new_data_file_size) {
+	static constexpr size_t WRITE_CHUNK_SIZE = 0x40000;
+	Path tmp_path(THUMBNAIL_CACHE_DATA_TMP_PATH);
+	tmp_path.delete_file();
+	Result_with_string result;
+	std::vector<u8> buffer;
+	new_data_file_size = 0;
+	for (auto &i : entries) {
+		size_t cur_offset = buffer.size();
+		buffer.resize(cur_offset + i.second.size);
+		u32 read_size = 0;
+		auto read_result = Path(THUMBNAIL_CACHE_DATA_PATH).read_file(&buffer[cur_offset], i.second.size, read_size, i.second.offset);
+		if (read_result.code != 0 || read_size != i.second.size) {
+			buffer.resize(cur_offset);
+			i.second.size = 0;
+			continue;
+		}
+		i.second.offset = new_data_file_size + cur_offset;
+		if (buffer.size() >= WRITE_CHUNK_SIZE) {
+			result = tmp_path.append_file(buffer.data(), buffer.size());
+			if (result.code != 0) return result;
+			new_data_file_size += buffer.size();
+			buffer.clear();
+		}
+	}
+	if (buffer.size()) {
+		result = tmp_path.append_file(buffer.data(), buffer.size());
+		new_data_file_size += buffer.size();
+	}
+	return result;
+}
+// rewrites the data file so that it only contains the entries in `cache_index`
+// resource_lock must not be held
+static void compact_data_file() {
+	resource_lock.lock();
+	std::vector<std::pair<u64, IndexEntry> > entries(cache_index.begin(), cache_index.end());
+	resource_lock.unlock();
+	std::sort(entries.begin(), entries.end(), [] (const auto &i, const auto &j) { return i.second.offset < j.second.offset; });
+	
+	u32 new_data_file_size = 0;
+	auto result = write_compacted_data_file(entries, new_data_file_size);
+	
+	resource_lock.lock();
+	if (result.code == 0) {
+		// the saved index no longer matches the data file after the rename, so remove it until the new one is saved
+		Path(index_io.main_path).delete_file();
+		Path(index_io.tmp_path).delete_file();
+		Path(THUMBNAIL_CACHE_DATA_PATH).delete_file();
+		result = Path(THUMBNAIL_CACHE_DATA_TMP_PATH).rename_to(THUMBNAIL_CACHE_DATA_PATH);
+	}
+	if (result.code != 0) { // start over
+		logger.error("thumb-cache", "compaction failed : " + result.string);
+		Path(THUMBNAIL_CACHE_DATA_TMP_PATH).delete_file();
+		Path(THUMBNAIL_CACHE_DATA_PATH).delete_file();
+		cache_index.clear();
+		live_size = 0;
+		data_file_size = 0;
+	} else {
+		// entries are only removed from `cache_index` meanwhile (by a failed read), never added or moved
+		for (auto &i : entries) {
+			auto it = cache_index.find(i.first);
+			if (it == cache_index.end()) continue;
+			if (i.second.size) it->second.offset = i.second.offset;
+			else live_size -= it->second.size, cache_index.erase(it);
+		}
+		data_file_size = new_data_file_size;
+	}
+	index_dirty = true;
+	resource_lock.unlock();
+}
+
+void thumbnail_disk_cache_flush() {
+	// the SD card I/O is performed without the lock so that the thumbnail loader can read from the cache meanwhile
+	// the queued thumbnails stay in `pending_writes` (and are served from there) until the append completes
+	resource_lock.lock();
+	load_index_wo_lock();
+	std::vector<u8> appended_data;
+	std::vector<std::pair<u64, u32> > appended; // {url hash, size}
+	for (auto &i : pending_writes) {
+		if (cache_index.count(i.first)) continue;
+		appended.push_back({i.first, (u32) i.second.size()});
+		appended_data.insert(appended_data.end(), i.second.begin(), i.second.end());
+	}
+	u32 offset = data_file_size;
+	resource_lock.unlock();
+	
+	if (appended_data.size()) {
+		auto result = Path(THUMBNAIL_CACHE_DATA_PATH).append_file(appended_data.data(), appended_data.size());
+		bool broken = false;
+		if (result.code != 0) {
+			logger.error("thumb-cache", "append failed : " + result.string);
+			// the file may have been partially written, so cut it back
+			broken = Path(THUMBNAIL_CACHE_DATA_PATH).truncate_file(offset).code != 0;
+		}
+		
+		resource_lock.lock();
+		if (broken) { // start over
+			Path(THUMBNAIL_CACHE_DATA_PATH).delete_file();
+			cache_index.clear();
+			live_size = 0;
+			data_file_size = 0;
+		} else if (result.code == 0) {
+			for (auto &i : appended) {
+				cache_index[i.first] = {data_file_size, i.second, ++access_cnter};
+				data_file_size += i.second;
+				live_size += i.second;
+			}
+		}
+		for (auto &i : appended) pending_writes.erase(i.first);
+		index_dirty = true;
+		resource_lock.unlock();
+	}
+	
+	// evict least recently used entries
+	resource_lock.lock();
+	if (live_size > THUMBNAIL_CACHE_BUDGET) {
+		std::vector<std::pair<u32, u64> > access_order; // {last access, url hash}
+		for (auto &i : cache_index) access_order.push_back({i.second.last_access, i.first});
+		std::sort(access_order.begin(), access_order.end());
+		for (auto &i : access_order) {
+			if (live_size <= THUMBNAIL_CACHE_BUDGET * 9 / 10) break;
+			live_size -= cache_index[i.second].size;
+			cache_index.erase(i.second);
+		}
+		index_dirty = true;
+	}
+	bool need_compaction = data_file_size > live_size * 2 && data_file_size > THUMBNAIL_CACHE_BUDGET / 2;
+	resource_lock.unlock();
+	if (need_compaction) compact_data_file();
+	
+	resource_lock.lock();
+	std::string index_data;
+	if (index_dirty) {
+		index_data.assign(sizeof(IndexHeader) + cache_index.size() * sizeof(IndexRecord), '\0');
+		IndexHeader *header = (IndexHeader *) &index_data[0];
+		*header = {THUMBNAIL_CACHE_INDEX_MAGIC, (u32) cache_index.size(), access_cnter, data_file_size};
+		IndexRecord *records = (IndexRecord *) &index_data[sizeof(IndexHeader)];
+		for (auto &i : cache_index) *records++ = {i.first, i.second};
+		index_dirty = false;
+	}
+	resource_lock.unlock();
+	if (index_data.size()) {
+		auto result = index_io.save(index_data);
+		if (result.code != 0) logger.error("thumb-cache", "index save failed : " + result.string);
+	}
+}
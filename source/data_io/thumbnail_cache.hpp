@@ -0,0 +1,15 @@
+#pragma once
+#include <vector>
+#include <string>
+#include "types.hpp"
+
+// second-tier thumbnail cache on the SD card
+// compressed thumbnails are appended to a single data file, and an index file maps url hashes to {offset, size, last access}
+// the index is loaded lazily on the first lookup, and writes are queued and performed by the misc tasks thread
+
+// returns true and fills `data` if `url` is cached
+bool thumbnail_disk_cache_get(const std::string &url, std::vector<u8> &data);
+// queues `data` to be written and requests TASK_FLUSH_THUMBNAIL_CACHE
+void thumbnail_disk_cache_put(const std::string &url, const std::vector<u8> &data);
+// writes queued thumbnails and the index, evicting least recently used entries to keep the size budget (called from the misc tasks thread)
+void thumbnail_disk_cache_flush();
@@ -1,31 +1,47 @@
-#include "headers.hpp"
+#ifdef __3DS__
+#	include "headers.hpp"
+#	define image_error(s) logger.error("image-dec", s)
+#else // the host benchmark (see Makefile.host) has no libctru nor logger
+#	include <cstdlib>
+#	include <iostream>
+#	include <string>
+#	include "image.hpp"
+#	define image_error(s) std::cerr << "image-dec : " << (s) << std::endl
+#endif
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image/stb_image.h"
 
 // returns in BGR565 format, should be freed
-u8 *Image_decode(u8 *input, size_t input_len, int* width, int* height)
+// only the region returned by `crop` (if given) is converted, and it's done in place in the buffer stbi returned,
+// so the peak memory usage is that of the RGB888 image alone
+u8 *Image_decode(u8 *input, size_t input_len, int* width, int* height, std::function<ImageRegion (int, int)> crop)
 {
 	int image_ch = 0;
 	u8 *rgb_image = stbi_load_from_memory(input, input_len, width, height, &image_ch, STBI_rgb);
 	if (!rgb_image) {
-		logger.error("image-dec", "stbi load failed : " + std::string(stbi_failure_reason()));
+		image_error("stbi load failed : " + std::string(stbi_failure_reason()));
 		return NULL;
 	}
-	u8 *bgr_image = (u8 *) malloc(*width * *height * 2);
-	if (!bgr_image) {
-		stbi_image_free(rgb_image);
-		return NULL;
-	}
-	int in_size = *width * *height * 3;
-	u16 *out_head = (u16 *) bgr_image;
-	for (int i = 0; i < in_size; i += 3) {
-		u16 r = rgb_image[i + 0];
-		u16 g = rgb_image[i + 1];
-		u16 b = rgb_image[i + 2];
-		*out_head++ = ((r & 0b11111000) << 8) | ((g & 0b11111100) << 3) | (b >> 3);
+	ImageRegion region = {0, 0, *width, *height};
+	if (crop) {
+		region = crop(*width, *height);
+		if (region.x < 0 || region.y < 0 || region.width <= 0 || region.height <= 0 ||
+			region.x + region.width > *width || region.y + region.height > *height) {
+			image_error("invalid crop region");
+			region = {0, 0, *width, *height};
+		}
 	}
 	
-	stbi_image_free(rgb_image);
-	return bgr_image;
+	u16 *bgr_image = (u16 *) rgb_image;
+	if (region.x == 0 && region.width == *width) // contiguous
+		Image_rgb888_to_bgr565(rgb_image + region.y * *width * 3, bgr_image, region.width * region.height);
+	else for (int i = 0; i < region.height; i++)
+		Image_rgb888_to_bgr565(rgb_image + ((region.y + i) * *width + region.x) * 3, bgr_image + i * region.width, region.width);
+	*width = region.width;
+	*height = region.height;
+	
+	// stbi allocates with malloc(), so the result can be shrunk and later freed with free()
+	u8 *res = (u8 *) realloc(rgb_image, *width * *height * 2);
+	return res ? res : rgb_image;
 }
@@ -1,3 +1,12 @@
 #pragma once
+#include <functional>
+#include "image_kernels.hpp"
 
-u8 *Image_decode(u8 *input, size_t input_len, int* width, int* height);
+struct ImageRegion {
+	int x;
+	int y;
+	int width;
+	int height;
+};
+// `crop` is given the full size of the image and returns the region to keep; width and height are set to the size of that region
+u8 *Image_decode(u8 *input, size_t input_len, int* width, int* height, std::function<ImageRegion (int, int)> crop = nullptr);
@@ -0,0 +1,110 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include "image_kernels.hpp"
+
+// define IMAGE_SCALAR_KERNELS to use the plain per-pixel loops instead of the batched ones
+// ARM11 has no NEON, so the batched kernels work on whole words (4 RGB888 pixels = 3 words) instead
+
+static inline u16 rgb888_to_bgr565(u8 r, u8 g, u8 b) {
+	return ((r & 0b11111000) << 8) | ((g & 0b11111100) << 3) | (b >> 3);
+}
+
+void Image_rgb888_to_bgr565_scalar(const u8 *src, u16 *dst, int pixel_num) {
+	for (int i = 0; i < pixel_num; i++) dst[i] = rgb888_to_bgr565(src[i * 3 + 0], src[i * 3 + 1], src[i * 3 + 2]);
+}
+void Image_rgb888_to_bgr565(const u8 *src, u16 *dst, int pixel_num) {
+#ifdef IMAGE_SCALAR_KERNELS
+	Image_rgb888_to_bgr565_scalar(src, dst, pixel_num);
+#else
+	int i = 0;
+	// 8 pixels (6 input words -> 4 output words) per iteration
+	// memcpy() compiles to plain (unaligned-capable) word accesses on ARMv6, so cropped rows with odd offsets are fine too
+	// `dst` may alias `src` as long as it does not start after it : each group is read before being written
+	const u8 *in = src;
+	u8 *out = (u8 *) dst;
+	for (; i + 8 <= pixel_num; i += 8) {
+		for (int k = 0; k < 2; k++) {
+			u32 w0, w1, w2;
+			memcpy(&w0, in + 0, 4); // r0 g0 b0 r1
+			memcpy(&w1, in + 4, 4); // g1 b1 r2 g2
+			memcpy(&w2, in + 8, 4); // b2 r3 g3 b3
+			u32 p0 = ((w0 << 8) & 0xF800) | ((w0 >> 5) & 0x07E0) | ((w0 >> 19) & 0x001F);
+			u32 p1 = ((w0 >> 16) & 0xF800) | ((w1 << 3) & 0x07E0) | ((w1 >> 11) & 0x001F);
+			u32 p2 = ((w1 >> 8) & 0xF800) | ((w1 >> 21) & 0x07E0) | ((w2 >> 3) & 0x001F);
+			u32 p3 = (w2 & 0xF800) | ((w2 >> 13) & 0x07E0) | (w2 >> 27);
+			u32 o0 = p0 | p1 << 16;
+			u32 o1 = p2 | p3 << 16;
+			memcpy(out + 0, &o0, 4);
+			memcpy(out + 4, &o1, 4);
+			in += 12;
+			out += 8;
+		}
+	}
+	Image_rgb888_to_bgr565_scalar(src + i * 3, dst + i, pixel_num - i);
+#endif
+}
+
+// blends one pixel of a rounded icon exactly like the original per-pixel loop did
+static inline u16 round_icon_blend(u16 pixel, float proportion, bool dark_background) {
+	u8 b = pixel & ((1 << 5) - 1);
+	u8 g = (pixel >> 5) & ((1 << 6) - 1);
+	u8 r = pixel >> 11;
+	b = b * proportion + (dark_background ? 0 : ((1 << 5) - 1)) * (1 - proportion);
+	g = g * proportion + (dark_background ? 0 : ((1 << 6) - 1)) * (1 - proportion);
+	r = r * proportion + (dark_background ? 0 : ((1 << 5) - 1)) * (1 - proportion);
+	return b | g << 5 | r << 11;
+}
+
+static float round_icon_proportion(float radius, int i, int j) {
+	float distance = std::hypot(radius - (i + 0.5), radius - (j + 0.5));
+	return std::max(0.0f, std::min(1.0f, radius + 0.5f - distance));
+}
+
+void Image_round_icon_scalar(u16 *image, int width, int height, bool dark_background) {
+	float radius = (float) height / 2;
+	for (int i = 0; i < height; i++) for (int j = 0; j < width; j++)
+		image[i * width + j] = round_icon_blend(image[i * width + j], round_icon_proportion(radius, i, j), dark_background);
+}
+void Image_round_icon(u16 *image, int width, int height, bool dark_background) {
+#ifdef IMAGE_SCALAR_KERNELS
+	Image_round_icon_scalar(image, width, height, dark_background);
+#else
+	float radius = (float) height / 2;
+	auto pixel_proportion = [&] (int i, int j) { return round_icon_proportion(radius, i, j); };
+	u16 background = dark_background ? 0x0000 : 0xFFFF;
+	for (int i = 0; i < height; i++) {
+		u16 *row = image + i * width;
+		// only the pixels near the circle edge need blending : the ones well inside are kept as-is and the ones well outside are filled
+		// the spans are shrunk by a safety margin so that the result stays bit-exact with the per-pixel formula
+		float dy = radius - (i + 0.5f);
+		float center = radius - 0.5f;
+		float outer_sq = (radius + 0.5f) * (radius + 0.5f) - dy * dy;
+		float inner_sq = (radius - 0.5f) * (radius - 0.5f) - dy * dy;
+		int outer_l = width, outer_r = -1; // outside [outer_l, outer_r] is fully background
+		if (outer_sq > 0) {
+			float half = std::sqrt(outer_sq);
+			outer_l = std::max(0, (int) std::floor(center - half) - 1);
+			outer_r = std::min(width - 1, (int) std::ceil(center + half) + 1);
+		}
+		int inner_l = width, inner_r = -1; // inside [inner_l, inner_r] is fully kept
+		if (inner_sq > 0) {
+			float half = std::sqrt(inner_sq);
+			inner_l = std::max(outer_l, (int) std::ceil(center - half) + 1);
+			inner_r = std::min(outer_r, (int) std::floor(center + half) - 1);
+		}
+		if (outer_l > outer_r) {
+			std::fill(row, row + width, background);
+			continue;
+		}
+		std::fill(row, row + outer_l, background);
+		std::fill(row + outer_r + 1, row + width, background);
+		if (inner_l > inner_r) {
+			for (int j = outer_l; j <= outer_r; j++) row[j] = round_icon_blend(row[j], pixel_proportion(i, j), dark_background);
+		} else {
+			for (int j = outer_l; j < inner_l; j++) row[j] = round_icon_blend(row[j], pixel_proportion(i, j), dark_background);
+			for (int j = inner_r + 1; j <= outer_r; j++) row[j] = round_icon_blend(row[j], pixel_proportion(i, j), dark_background);
+		}
+	}
+#endif
+}
@@ -0,0 +1,14 @@
+#pragma once
+#include "3ds/types.h"
+
+// pixel conversion kernels used by Image_decode() and the thumbnail loader
+// nothing here depends on libctru beyond its integer types, so that the host tests can compare the kernels (see Makefile.host)
+
+// batched unless IMAGE_SCALAR_KERNELS is defined
+void Image_rgb888_to_bgr565(const u8 *src, u16 *dst, int pixel_num);
+// fills the area outside the inscribed circle with white (black if dark_background), anti-aliasing the edge
+void Image_round_icon(u16 *image, int width, int height, bool dark_background);
+
+// the plain per-pixel loops, which the batched kernels must match bit for bit
+void Image_rgb888_to_bgr565_scalar(const u8 *src, u16 *dst, int pixel_num);
+void Image_round_icon_scalar(u16 *image, int width, int height, bool dark_background);
@@ -18,6 +18,7 @@ void NetworkDecoderFFmpegIOData::deinit_(int type, bool deinit_stream) {
 	if (deinit_stream) {
 		network_stream[type]->quit_request = true;
 		network_stream[type] = NULL;
+		keyframe_index[type].clear();
 	}
 }
 void NetworkDecoderFFmpegIOData::deinit(bool deinit_stream) {
@@ -60,10 +61,9 @@ static int read_network_stream(void *opaque, u8 *buf, int buf_size_) { // size o
 	
 	
 	{
-		auto tmp = stream->get_data(stream->read_head, std::min<u64>(buf_size, stream->len - stream->read_head));
-		size_t read_size = tmp.size();
+		size_t read_size = stream->read_data(stream->read_head, std::min<u64>(buf_size, stream->len - stream->read_head), buf);
+		if (stream->pin_reads) stream->pin_range(stream->read_head, read_size);
 		stream->read_head += read_size;
-		memcpy(buf, &tmp[0], read_size);
 		if (!read_size) return AVERROR_EOF;
 		return read_size;
 	}
@@ -106,6 +106,7 @@ static int64_t seek_network_stream(void *opaque, s64 offset, int whence) { // si
 	
 	if (new_pos > stream->len) return -1;
 	
+	stream->record_seek(new_pos);
 	stream->read_head = new_pos;
 	
 	return stream->read_head;
@@ -147,7 +148,10 @@ Result_with_string NetworkDecoderFFmpegIOData::init_(int type, NetworkDecoder *p
 		return result;
 	}
 	format_context[type]->pb = io_context[type];
+	// whatever the demuxer reads to open the stream (moov, sidx, cues...) is needed again on seeks, so keep it in the cache
+	network_stream[type]->pin_reads = true;
 	ffmpeg_result = avformat_open_input(&format_context[type], "yay", NULL, NULL);
+	network_stream[type]->pin_reads = false;
 	if (ffmpeg_result != 0) {
 		result.error_description = "avformat_open_input() failed " + std::to_string(ffmpeg_result);
 		goto fail;
@@ -173,6 +177,7 @@ Result_with_string NetworkDecoderFFmpegIOData::init_(int type, NetworkDecoder *p
 			if (format_context[BOTH]->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_AUDIO) stream_index[AUDIO] = i;
 		}
 	}
+	if (!keyframe_index[type].size()) build_keyframe_index(type); // kept across the periodic reinits of the same stream
 	return result;
 	
 	fail:
@@ -180,6 +185,79 @@ Result_with_string NetworkDecoderFFmpegIOData::init_(int type, NetworkDecoder *p
 	result.string = DEF_ERR_FFMPEG_RETURNED_NOT_SUCCESS_STR;
 	return result;
 }
+static u64 read_big_endian(const u8 *data, int size) {
+	u64 res = 0;
+	for (int i = 0; i < size; i++) res = res << 8 | data[i];
+	return res;
+}
+// walks the top-level boxes at the beginning of the stream and parses the sidx box if found
+// every subsegment referenced by the sidx of a DASH stream starts with a keyframe
+static std::vector<NetworkDecoderFFmpegIOData::KeyframeIndexEntry> parse_sidx(NetworkStream *stream) {
+	std::vector<NetworkDecoderFFmpegIOData::KeyframeIndexEntry> res;
+	u64 header_len = std::min<u64>(stream->len, 2 * NetworkStream::BLOCK_SIZE); // the header is pinned in the cache, no need to look further
+	u64 pos = 0;
+	while (pos + 16 <= header_len && stream->is_data_available(pos, 16)) {
+		u8 box_header[16];
+		stream->read_data(pos, 16, box_header);
+		u64 box_size = read_big_endian(box_header, 4);
+		u64 box_header_size = 8;
+		if (box_size == 1) box_size = read_big_endian(box_header + 8, 8), box_header_size = 16;
+		if (box_size < box_header_size) break; // extends to the eof (0) or broken
+		if (memcmp(box_header + 4, "sidx", 4)) {
+			pos += box_size;
+			continue;
+		}
+		
+		if (box_size > 0x100000 || pos + box_size > header_len || !stream->is_data_available(pos, box_size)) break;
+		std::vector<u8> box(box_size);
+		stream->read_data(pos, box_size, box.data());
+		const u8 *cur = box.data() + box_header_size;
+		const u8 *end = box.data() + box_size;
+		if (end - cur < 12) break;
+		int field_size = cur[0] == 0 ? 4 : 8; // version 0 : 32-bit time and offset, otherwise 64-bit
+		u64 timescale = read_big_endian(cur + 8, 4); // skipping version, flags and reference_ID
+		cur += 12;
+		if (end - cur < 2 * field_size + 4 || !timescale) break;
+		u64 time = read_big_endian(cur, field_size); // earliest_presentation_time
+		u64 offset = pos + box_size + read_big_endian(cur + field_size, field_size); // first_offset is relative to the end of the sidx box
+		u32 reference_num = read_big_endian(cur + 2 * field_size + 2, 2);
+		cur += 2 * field_size + 4;
+		if ((u64) (end - cur) < (u64) reference_num * 12) break;
+		for (u32 i = 0; i < reference_num; i++, cur += 12) {
+			res.push_back({(s64) (time * 1000000 / timescale), offset});
+			offset += read_big_endian(cur, 4) & 0x7FFFFFFF; // referenced_size (the top bit is reference_type)
+			time += read_big_endian(cur + 4, 4); // subsegment_duration
+		}
+		break;
+	}
+	return res;
+}
+#define KEYFRAME_INDEX_MIN_INTERVAL 500000 // in microseconds, denser entries (e.g. every audio frame) are thinned out
+void NetworkDecoderFFmpegIOData::build_keyframe_index(int type) {
+	keyframe_index[type] = parse_sidx(network_stream[type]);
+	if (!keyframe_index[type].size()) {
+		int index = stream_index[video_audio_seperate ? type : (stream_index[VIDEO] != -1 ? VIDEO : AUDIO)];
+		if (index < 0) return;
+		AVStream *stream = format_context[type]->streams[index];
+		double time_base = av_q2d(stream->time_base);
+		int entry_num = avformat_index_get_entries_count(stream);
+		for (int i = 0; i < entry_num; i++) {
+			const AVIndexEntry *entry = avformat_index_get_entry(stream, i);
+			if (!entry || !(entry->flags & AVINDEX_KEYFRAME) || entry->pos < 0 || entry->timestamp == AV_NOPTS_VALUE) continue;
+			s64 timestamp = entry->timestamp * time_base * 1000000;
+			if (keyframe_index[type].size() && timestamp < keyframe_index[type].back().timestamp + KEYFRAME_INDEX_MIN_INTERVAL) continue;
+			keyframe_index[type].push_back({timestamp, (u64) entry->pos});
+		}
+	}
+	keyframe_index[type].shrink_to_fit();
+}
+bool NetworkDecoderFFmpegIOData::find_keyframe(int type, s64 microseconds, KeyframeIndexEntry &res) {
+	auto &index = keyframe_index[type];
+	if (!index.size()) return false;
+	auto itr = std::upper_bound(index.begin(), index.end(), microseconds, [] (s64 timestamp, const KeyframeIndexEntry &entry) { return timestamp < entry.timestamp; });
+	res = itr == index.begin() ? *itr : *std::prev(itr);
+	return true;
+}
 #	define RETURN_WITH_PREFIX_ON_ERROR(exp, prefix) \
 	do {\
 		if ((result = exp).code != 0) {\
@@ -1035,10 +1113,59 @@ Result_with_string NetworkDecoder::get_decoded_video_frame(int width, int height
 	return result;
 }
 
+// without this, the demuxer reads the target of the video stream first and only then that of the audio stream,
+// each read starting its own download after the seek ; here the read heads are moved to the keyframes the seek will land on
+// so that the downloader fetches all the target ranges at once, and they're restored before the actual seek
+#define FETCH_SEEK_TARGET_TIMEOUT_MS 10000
+#define FETCH_SEEK_TARGET_POLL_MS 100
+void NetworkDecoder::fetch_seek_target(s64 microseconds) {
+	int type_num = is_av_separate() ? 2 : 1;
+	NetworkDecoderFFmpegIOData::KeyframeIndexEntry keyframes[2];
+	if (!io->find_keyframe(VIDEO, microseconds, keyframes[VIDEO])) return;
+	// audio is sought to the timestamp of the video keyframe
+	if (type_num == 2 && !io->find_keyframe(AUDIO, keyframes[VIDEO].timestamp, keyframes[AUDIO])) type_num = 1;
+	
+	NetworkStream *streams[2];
+	u64 old_read_heads[2];
+	u64 target_sizes[2];
+	for (int type = 0; type < type_num; type++) {
+		streams[type] = io->network_stream[type];
+		if (!streams[type]->ready || keyframes[type].pos >= streams[type]->len) return;
+		old_read_heads[type] = streams[type]->read_head;
+		target_sizes[type] = std::min<u64>(NETWORK_BUFFER_SIZE, streams[type]->len - keyframes[type].pos);
+	}
+	for (int type = 0; type < type_num; type++) {
+		streams[type]->record_seek(keyframes[type].pos);
+		streams[type]->read_head = keyframes[type].pos;
+	}
+	{
+		// this is only a prefetch, so give up after a while and let the demuxer reads wait as usual
+		u64 deadline = osGetTime() + FETCH_SEEK_TARGET_TIMEOUT_MS;
+		while (osGetTime() < deadline) {
+			bool waiting = false;
+			for (int type = 0; type < type_num; type++) {
+				if (streams[type]->error || streams[type]->quit_request || streams[type]->suspend_request ||
+					(!streams[type]->disable_interrupt && interrupt)) goto end;
+				if (!streams[type]->is_data_available(keyframes[type].pos, target_sizes[type])) {
+					streams[type]->network_waiting_status = "Reading stream (seek)";
+					if (!waiting) streams[type]->wait_for_block(FETCH_SEEK_TARGET_POLL_MS); // the flags above are checked at least this often
+					waiting = true;
+				}
+			}
+			if (!waiting) break;
+		}
+	}
+	end :
+	for (int type = 0; type < type_num; type++) {
+		streams[type]->network_waiting_status = NULL;
+		streams[type]->read_head = old_read_heads[type]; // the demuxer may still think it's at the old position
+	}
+}
 Result_with_string NetworkDecoder::seek(s64 microseconds) {
 	Result_with_string result;
 	
 	clear_buffer();
+	fetch_seek_target(microseconds);
 	
 	s64 min_ts = std::max<s64>(0, microseconds - 1000000);
 	s64 max_ts = microseconds + 500000;
@@ -101,7 +101,18 @@ public :
 	NetworkDecoder *parent_decoder = NULL;
 	int packets_until_next_reinit = DECODER_REINIT_INTERVAL_PACKETS;
 	
+	// keyframe -> byte offset of the stream, built once the header is parsed
+	// from the sidx box if any (fragmented mp4), otherwise from the index the demuxer built (stss/stco/stsz, cues)
+	struct KeyframeIndexEntry {
+		s64 timestamp; // in microseconds
+		u64 pos;
+	};
+	std::vector<KeyframeIndexEntry> keyframe_index[2];
+	
 	Result_with_string init_(int type, NetworkDecoder *parent_decoder);
+	void build_keyframe_index(int type);
+	// gets the last keyframe at or before `microseconds` (the first one if there's none), returns false if the index is empty
+	bool find_keyframe(int type, s64 microseconds, KeyframeIndexEntry &res);
 	Result_with_string init(NetworkStream *video_stream, NetworkStream *audio_stream, NetworkDecoder *parent_decoder);
 	Result_with_string init(NetworkStream *both_stream, NetworkDecoder *parent_decoder);
 	void deinit_(int type, bool deinit_stream);
@@ -171,6 +182,7 @@ private :
 	Result_with_string init_decoder(int type);
 	Result_with_string read_packet(int type);
 	Result_with_string mvd_decode(int *width, int *height);
+	void fetch_seek_target(s64 microseconds);
 	AVStream *get_stream(int type) { return io->format_context[is_av_separate() ? type : BOTH]->streams[io->stream_index[type]]; }
 public :
 	bool hw_decoder_enabled = false;
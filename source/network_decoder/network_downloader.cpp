@@ -1,14 +1,26 @@
 #include "headers.hpp"
 #include "network_downloader.hpp"
 #include "network_io.hpp"
+#include "youtube_parser/parser.hpp"
+#include "data_io/stream_cache.hpp"
 
 #define MAX_CACHE_BLOCKS (var_is_new3ds ? NetworkStream::NEW3DS_MAX_CACHE_BLOCKS : NetworkStream::OLD3DS_MAX_CACHE_BLOCKS)
+#define PREFETCH_BLOCK_NUM (var_is_new3ds ? NEW3DS_PREFETCH_BLOCK_NUM : OLD3DS_PREFETCH_BLOCK_NUM)
 
 
 // --------------------------------
 // NetworkStream implementation
 // --------------------------------
 
+NetworkStream::~NetworkStream () {
+	// the header is needed first when the video is opened again
+	// the slot buffers are freed right after anyway, so they are handed over regardless of the size of the write queue
+	if (disk_cache_id != "") for (auto block : pinned_blocks) if (block < block_to_slot.size() && block_to_slot[block] != -1) {
+		CacheSlot &slot = cache_slots[block_to_slot[block]];
+		if (stream_disk_cache_put_block(disk_cache_id, len, block, slot.data, slot.size, true)) slot.data = NULL;
+	}
+	for (auto &slot : cache_slots) free(slot.data);
+}
 bool NetworkStream::is_data_available(u64 start, u64 size) {
 	if (!ready) return false;
 	if (start + size > len) return false;
@@ -18,67 +30,188 @@ bool NetworkStream::is_data_available(u64 start, u64 size) {
 	
 	bool res = true;
 	downloaded_data_lock.lock();
-	for (u64 block = start_block; block <= end_block; block++) if (!downloaded_data.count(block)) {
+	for (u64 block = start_block; block <= end_block; block++) if (block >= block_to_slot.size() || block_to_slot[block] == -1) {
 		res = false;
 		break;
 	}
 	downloaded_data_lock.unlock();
 	return res;
 }
-std::vector<u8> NetworkStream::get_data(u64 start, u64 size) {
-	if (!ready) return {};
-	if (!size) return {};
+bool NetworkStream::is_block_available(u64 block) {
+	downloaded_data_lock.lock();
+	bool res = block < block_to_slot.size() && block_to_slot[block] != -1;
+	downloaded_data_lock.unlock();
+	return res;
+}
+size_t NetworkStream::read_data(u64 start, u64 size, u8 *dst) {
+	if (!ready) return 0;
+	if (!size) return 0;
 	u64 end = start + size - 1;
 	u64 start_block = start / BLOCK_SIZE;
 	u64 end_block = end / BLOCK_SIZE;
-	std::vector<u8> res;
+	size_t copied = 0;
 	
 	downloaded_data_lock.lock();
-	auto itr = downloaded_data.find(start_block);
-	my_assert(itr != downloaded_data.end());
 	for (u64 block = start_block; block <= end_block; block++) {
-		my_assert(itr->first == block);
+		my_assert(block < block_to_slot.size() && block_to_slot[block] != -1);
+		const CacheSlot &slot = cache_slots[block_to_slot[block]];
 		u64 cur_l = std::max(start, block * BLOCK_SIZE) - block * BLOCK_SIZE;
 		u64 cur_r = std::min(end + 1, (block + 1) * BLOCK_SIZE) - block * BLOCK_SIZE;
-		res.insert(res.end(), itr->second.begin() + cur_l, itr->second.begin() + cur_r);
-		itr++;
+		memcpy(dst + copied, slot.data + cur_l, cur_r - cur_l);
+		copied += cur_r - cur_l;
+	}
+	downloaded_data_lock.unlock();
+	return copied;
+}
+int NetworkStream::acquire_slot(u64 block) {
+	if (!cache_slots.size()) cache_slots.resize(MAX_CACHE_BLOCKS);
+	if (block >= block_to_slot.size()) block_to_slot.resize(block + 1, -1);
+	
+	int slot_index = -1;
+	for (size_t i = 0; i < cache_slots.size(); i++) if (cache_slots[i].block == -1 && !cache_slots[i].writing) {
+		slot_index = i;
+		break;
+	}
+	if (slot_index == -1) { // ensure it doesn't cache too much and run out of memory
+		// the new block takes part in the selection as if it had already been inserted
+		EvictionContext context{read_head / BLOCK_SIZE, seeking_backward, recent_seek_blocks};
+		u64 victim = (u64) -1;
+		double victim_score = 0;
+		if (!is_pinned(block)) victim = block, victim_score = eviction_policy(block, context);
+		for (auto &slot : cache_slots) {
+			if (slot.block == -1) continue; // being written
+			if (is_pinned(slot.block)) continue;
+			double score = eviction_policy(slot.block, context);
+			if (victim == (u64) -1 || victim_score < score) victim = slot.block, victim_score = score;
+		}
+		if (victim == block || victim == (u64) -1) return -1; // the new block itself would be dropped right away
+		slot_index = block_to_slot[victim];
+		// the buffer itself is handed over instead of copying the block while holding the lock, and a new one is allocated below
+		if (disk_cache_id != "" && stream_disk_cache_put_block(disk_cache_id, len, victim, cache_slots[slot_index].data, cache_slots[slot_index].size))
+			cache_slots[slot_index].data = NULL;
+		block_to_slot[victim] = -1;
+		cache_slots[slot_index].block = -1;
+		cached_block_num--;
+	}
+	
+	CacheSlot &slot = cache_slots[slot_index];
+	if (!slot.data) slot.data = (u8 *) malloc(BLOCK_SIZE);
+	if (!slot.data) {
+		logger.error("net/dl", "out of memory while allocating a cache slot");
+		return -1;
+	}
+	return slot_index;
+}
+double NetworkStream::eviction_score_farthest(u64 block, const EvictionContext &context) {
+	u64 head = context.read_head_block;
+	if (block < head) return (double) (1 << 30) + (head - block);
+	return block - head;
+}
+double NetworkStream::eviction_score_seek_aware(u64 block, const EvictionContext &context) {
+	double score = eviction_score_farthest(block, context);
+	// after seeking backward, the user is likely to seek around there again, so one more block is kept
+	u64 keep_block_num = context.seeking_backward ? 2 : 1;
+	if (block < context.read_head_block) {
+		for (auto seek_block : context.recent_seek_blocks) if (block >= seek_block && block < seek_block + keep_block_num) {
+			score = (double) (1 << 30) + (context.read_head_block - block) / 2.0;
+			break;
+		}
+	}
+	return score;
+}
+void NetworkStream::pin_range(u64 start, u64 size) {
+	if (!size) return;
+	downloaded_data_lock.lock();
+	for (u64 block = start / BLOCK_SIZE; block <= (start + size - 1) / BLOCK_SIZE; block++) {
+		if (is_pinned(block)) continue;
+		if (pinned_blocks.size() >= std::max<u64>(1, MAX_CACHE_BLOCKS / 4)) {
+			logger.caution("net/dl", "too many pinned blocks, ignoring block " + std::to_string(block));
+			break;
+		}
+		pinned_blocks.push_back(block);
+	}
+	downloaded_data_lock.unlock();
+}
+void NetworkStream::record_seek(u64 new_pos) {
+	u64 old_pos = read_head;
+	if (pin_reads) return; // the demuxer looking for the header
+	if (std::max(old_pos, new_pos) - std::min(old_pos, new_pos) < BLOCK_SIZE) return; // small skips are not seeks
+	downloaded_data_lock.lock();
+	seeking_backward = new_pos < old_pos;
+	if (!recent_seek_blocks.size() || recent_seek_blocks.front() != new_pos / BLOCK_SIZE) { // the decoder fetches the seek target before the demuxer seeks there
+		recent_seek_blocks.push_front(new_pos / BLOCK_SIZE);
+		if (recent_seek_blocks.size() > RECENT_SEEK_NUM) recent_seek_blocks.pop_back();
 	}
 	downloaded_data_lock.unlock();
+}
+int NetworkStream::get_pinned_block_num() {
+	downloaded_data_lock.lock();
+	int res = pinned_blocks.size();
+	downloaded_data_lock.unlock();
 	return res;
 }
-void NetworkStream::set_data(u64 block, const std::vector<u8> &data) {
+void NetworkStream::set_data(u64 block, const u8 *data, size_t size) {
 	downloaded_data_lock.lock();
-	downloaded_data[block] = data;
-	if (downloaded_data.size() > MAX_CACHE_BLOCKS) { // ensure it doesn't cache too much and run out of memory
-		u64 read_head_block = read_head / BLOCK_SIZE;
-		if (std::next(downloaded_data.begin())->first < read_head_block) downloaded_data.erase(std::next(downloaded_data.begin()));
-		else downloaded_data.erase(std::prev(downloaded_data.end()));
+	int slot_index = block < block_to_slot.size() ? block_to_slot[block] : -1;
+	if (slot_index == -1) slot_index = acquire_slot(block);
+	if (slot_index != -1) {
+		CacheSlot &slot = cache_slots[slot_index];
+		size = std::min<size_t>(size, BLOCK_SIZE);
+		memcpy(slot.data, data, size);
+		slot.size = size;
+		if (slot.block == -1) {
+			slot.block = block;
+			block_to_slot[block] = slot_index;
+			cached_block_num++;
+		}
 	}
 	downloaded_data_lock.unlock();
+	if (slot_index != -1) LightEvent_Signal(&block_event);
+}
+int NetworkStream::begin_block_write(u64 block, u8 **buffer) {
+	downloaded_data_lock.lock();
+	int slot_index = -1;
+	if (block >= block_to_slot.size() || block_to_slot[block] == -1) { // already downloaded blocks are left as they are
+		slot_index = acquire_slot(block);
+		if (slot_index != -1) {
+			cache_slots[slot_index].writing = true;
+			*buffer = cache_slots[slot_index].data;
+		}
+	}
+	downloaded_data_lock.unlock();
+	return slot_index;
+}
+void NetworkStream::end_block_write(int slot_index, u64 block, size_t size) {
+	downloaded_data_lock.lock();
+	CacheSlot &slot = cache_slots[slot_index];
+	slot.writing = false;
+	if (size) {
+		slot.size = std::min<size_t>(size, BLOCK_SIZE);
+		slot.block = block;
+		block_to_slot[block] = slot_index;
+		cached_block_num++;
+	}
+	downloaded_data_lock.unlock();
+	if (size) LightEvent_Signal(&block_event);
 }
 double NetworkStream::get_download_percentage() {
 	downloaded_data_lock.lock();
-	double res = (double) downloaded_data.size() * BLOCK_SIZE / len * 100;
+	double res = (double) cached_block_num * BLOCK_SIZE / len * 100;
 	downloaded_data_lock.unlock();
 	return res;
 }
 std::vector<double> NetworkStream::get_buffering_progress_bar(int res_len) {
 	downloaded_data_lock.lock();
 	std::vector<double> res(res_len);
-	auto itr = downloaded_data.begin();
 	for (int i = 0; i < res_len; i++) {
 		u64 l = (u64) len * i / res_len;
 		u64 r = std::min<u64>(len, len * (i + 1) / res_len);
-		while (itr != downloaded_data.end()) {
-			u64 il = itr->first * BLOCK_SIZE;
-			u64 ir = std::min((itr->first + 1) * BLOCK_SIZE, len);
-			if (ir <= l) itr++;
-			else if (il >= r) break;
-			else {
-				res[i] += std::min(ir, r) - std::max(il, l);
-				if (ir >= r) break;
-				else itr++;
-			}
+		if (l >= r) continue;
+		for (u64 block = l / BLOCK_SIZE; block <= (r - 1) / BLOCK_SIZE && block < block_to_slot.size(); block++) {
+			if (block_to_slot[block] == -1) continue;
+			u64 il = block * BLOCK_SIZE;
+			u64 ir = std::min((block + 1) * BLOCK_SIZE, len);
+			res[i] += std::min(ir, r) - std::max(il, l);
 		}
 		res[i] /= r - l;
 		res[i] *= 100;
@@ -93,6 +226,28 @@ std::vector<double> NetworkStream::get_buffering_progress_bar(int res_len) {
 // --------------------------------
 
 void NetworkStreamDownloader::add_stream(NetworkStream *stream) {
+	if (var_stream_disk_cache && !stream->whole_download) stream->disk_cache_id = stream_disk_cache_get_id(stream->url);
+	
+	// adopt the prefetched blocks so that the stream can be opened without waiting for the network (before the downloader thread sees it)
+	prefetch_lock.lock();
+	for (size_t i = 0; i < prefetched_streams.size(); i++) {
+		auto &prefetched = prefetched_streams[i];
+		if (prefetched.url != stream->url) continue;
+		collect_prefetched_stream(prefetched);
+		if (prefetched.data.size() && !stream->whole_download && stream->len == prefetched.len) {
+			for (size_t offset = 0; offset < prefetched.data.size(); offset += BLOCK_SIZE)
+				stream->set_data(offset / BLOCK_SIZE, &prefetched.data[offset], std::min<size_t>(BLOCK_SIZE, prefetched.data.size() - offset));
+			stream->ready = true;
+			logger.info("net/dl", "adopted " + std::to_string(prefetched.data.size() / 1000) + " KB of prefetched data");
+		}
+		// a request still in flight can't be adopted : it would be paused by the scheduler as soon as the new stream needs data,
+		// so stop it rather than letting it download the blocks the stream is about to request again at the playback priority
+		if (prefetched.request) *prefetched.cancelled = true;
+		prefetched_streams.erase(prefetched_streams.begin() + i);
+		break;
+	}
+	prefetch_lock.unlock();
+	
 	streams_lock.lock();
 	size_t index = (size_t) -1;
 	for (size_t i = 0; i < streams.size(); i++) if (!streams[i]) {
@@ -106,6 +261,46 @@ void NetworkStreamDownloader::add_stream(NetworkStream *stream) {
 	}
 	streams_lock.unlock();
 }
+void NetworkStreamDownloader::set_prefetch_urls(const std::vector<std::string> &urls) {
+	prefetch_lock.lock();
+	prefetch_generation++; // aborts the requests in flight
+	prefetched_streams.clear();
+	for (auto &url : urls) {
+		if ((int) prefetched_streams.size() == PREFETCH_STREAM_NUM_MAX) break;
+		int64_t len = extract_stream_length(url);
+		if (len <= 0) continue;
+		PrefetchedStream prefetched;
+		prefetched.url = url;
+		prefetched.len = len;
+		prefetched_streams.push_back(prefetched);
+	}
+	prefetch_lock.unlock();
+}
+void NetworkStreamDownloader::collect_prefetched_stream(PrefetchedStream &prefetched) {
+	if (prefetched.done || !prefetched.request || !prefetched.request->done) return;
+	NetworkResult &result = prefetched.request->result;
+	u64 expected_len = std::min<u64>(prefetched.len, PREFETCH_BLOCK_NUM * BLOCK_SIZE);
+	if (!result.fail && result.status_code_is_success() && result.data.size() == expected_len) prefetched.data = std::move(result.data);
+	else logger.caution("net/dl", "prefetch failed : " + (result.fail ? result.error : std::to_string(result.status_code)));
+	prefetched.done = true;
+	prefetched.request.reset();
+}
+// called from the downloader thread only while every stream has its forward buffer filled
+// the transfers themselves progress in process() or perform() of `session_list` and are paused by the scheduler if the playback margin gets low
+void NetworkStreamDownloader::progress_prefetch(NetworkSessionList &session_list) {
+	prefetch_lock.lock();
+	for (auto &prefetched : prefetched_streams) {
+		collect_prefetched_stream(prefetched);
+		if (prefetched.done || prefetched.request) continue;
+		u64 end = std::min<u64>(prefetched.len, PREFETCH_BLOCK_NUM * BLOCK_SIZE);
+		u32 generation = prefetch_generation;
+		auto cancelled = prefetched.cancelled;
+		prefetched.request = session_list.submit(HttpRequest::GET(prefetched.url + "&range=0-" + std::to_string(end - 1), {})
+			.with_priority(NetworkPriority::PREFETCH)
+			.with_abort_check([this, generation, cancelled] () { return thread_exit_reqeusted || generation != prefetch_generation || *cancelled; }));
+	}
+	prefetch_lock.unlock();
+}
 
 static bool thread_network_session_list_inited = false;
 static NetworkSessionList thread_network_session_list;
@@ -128,6 +323,43 @@ static std::string remove_url_parameter(const std::string &url, const std::strin
 	return res;
 }
 
+static int get_forward_buffer_block_num(NetworkStream *stream) {
+	return std::max<int>(2, (MAX_CACHE_BLOCKS - stream->get_pinned_block_num()) * var_forward_buffer_ratio); // pinned blocks are always kept
+}
+
+// updates the throughput/RTT estimates of the stream with a finished range request and picks the size of the next requests
+// a request should take about twice as long to transfer as the round trip, so that the round trip costs at most a third of the time
+static void update_request_block_num(NetworkStream *stream, const NetworkResult &result, u64 received_size) {
+	double transfer_time = result.total_time - result.time_to_first_byte;
+	if (result.time_to_first_byte > 0)
+		stream->rtt_estimate = stream->rtt_estimate > 0 ? stream->rtt_estimate * 0.75 + result.time_to_first_byte * 0.25 : result.time_to_first_byte;
+	if (transfer_time > 0.001 && received_size) {
+		double throughput = received_size / transfer_time;
+		stream->throughput_estimate = stream->throughput_estimate > 0 ? stream->throughput_estimate * 0.75 + throughput * 0.25 : throughput;
+	}
+	if (stream->throughput_estimate <= 0 || stream->rtt_estimate <= 0) return;
+	
+	int target = std::ceil(stream->throughput_estimate * stream->rtt_estimate * 2 / NetworkStream::BLOCK_SIZE);
+	target = std::max(1, std::min<int>({target, NetworkStream::MAX_REQUEST_BLOCK_NUM, stream->request_block_num * 2})); // grow gradually
+	stream->request_block_num = target;
+}
+
+// moves the blocks of [first_block, end_block) found in the SD card cache back into the RAM cache and returns the number of blocks loaded
+static int load_blocks_from_disk(NetworkStream *stream, u64 first_block, u64 end_block, int max_num) {
+	int res = 0;
+	for (u64 block = first_block; block < end_block && res < max_num; block++) {
+		if (stream->is_block_available(block) || !stream_disk_cache_has_block(stream->disk_cache_id, block)) continue;
+		u8 *buffer;
+		int slot_index = stream->begin_block_write(block, &buffer);
+		if (slot_index == -1) break;
+		u32 size = stream_disk_cache_read_block(stream->disk_cache_id, block, buffer, NetworkStream::BLOCK_SIZE);
+		stream->end_block_write(slot_index, block, size);
+		if (!size) break;
+		res++;
+	}
+	return res;
+}
+
 #define LOG_THREAD_STR "net/dl"
 void NetworkStreamDownloader::downloader_thread() {
 	while (!thread_exit_reqeusted) {
@@ -140,6 +372,8 @@ void NetworkStreamDownloader::downloader_thread() {
 		
 		// find the stream to download next
 		double margin_percentage_min = 1000;
+		bool margin_low = false;
+		u64 margin_low_blocks = network_is_playback_margin_low() ? PLAYBACK_MARGIN_LOW_BLOCKS * 2 : PLAYBACK_MARGIN_LOW_BLOCKS;
 		for (size_t i = 0; i < streams.size(); i++) {
 			if (!streams[i]) continue;
 			if (streams[i]->quit_request) {
@@ -151,18 +385,20 @@ void NetworkStreamDownloader::downloader_thread() {
 			if (streams[i]->suspend_request) continue;
 			if (!streams[i]->ready) {
 				cur_stream_index = i;
+				margin_low = true;
 				break;
 			}
 			if (streams[i]->whole_download) continue; // its entire content should already be downloaded
 			
-			int forward_buffer_block_num = std::max<int>(2, (MAX_CACHE_BLOCKS - 1) * var_forward_buffer_ratio); // block #0 is always kept
+			int forward_buffer_block_num = get_forward_buffer_block_num(streams[i]);
 			u64 read_head_block = read_heads[i] / BLOCK_SIZE;
 			u64 first_not_downloaded_block = read_head_block;
-			while (first_not_downloaded_block < streams[i]->block_num && streams[i]->downloaded_data.count(first_not_downloaded_block)) {
+			while (first_not_downloaded_block < streams[i]->block_num && streams[i]->is_block_available(first_not_downloaded_block)) {
 				first_not_downloaded_block++;
 				if (first_not_downloaded_block == read_head_block + forward_buffer_block_num) break;
 			}
 			if (first_not_downloaded_block == streams[i]->block_num) continue;
+			if (first_not_downloaded_block < read_head_block + margin_low_blocks) margin_low = true;
 			if (first_not_downloaded_block == read_head_block + forward_buffer_block_num) continue; // no need to download this stream for now
 			
 			double margin_percentage;
@@ -174,9 +410,13 @@ void NetworkStreamDownloader::downloader_thread() {
 			}
 		}
 		
+		network_set_playback_margin_low(margin_low);
+		idle = cur_stream_index == (size_t) -1;
 		if (cur_stream_index == (size_t) -1) {
 			streams_lock.unlock();
-			usleep(20000);
+			confirm_thread_network_session_list_inited();
+			if (!margin_low) progress_prefetch(thread_network_session_list);
+			thread_network_session_list.process(20); // waits for 20 ms at most
 			continue;
 		}
 		NetworkStream *cur_stream = streams[cur_stream_index];
@@ -186,7 +426,7 @@ void NetworkStreamDownloader::downloader_thread() {
 		// whole download
 		if (cur_stream->whole_download) {
 			auto &session_list = cur_stream->session_list ? *cur_stream->session_list : thread_network_session_list;
-			auto result = session_list.perform(HttpRequest::GET(cur_stream->url, {}));
+			auto result = session_list.perform(HttpRequest::GET(cur_stream->url, {}).with_priority(NetworkPriority::PLAYBACK_CRITICAL));
 			if (result.redirected_url != "") cur_stream->url = result.redirected_url;
 			
 			if (!result.fail && result.status_code_is_success() && result.data.size()) {
@@ -213,7 +453,7 @@ void NetworkStreamDownloader::downloader_thread() {
 					for (size_t i = 0; i < result.data.size(); i += BLOCK_SIZE) {
 						size_t left = i;
 						size_t right = std::min<size_t>(i + BLOCK_SIZE, result.data.size());
-						cur_stream->set_data(i / BLOCK_SIZE, std::vector<u8>(result.data.begin() + left, result.data.begin() + right));
+						cur_stream->set_data(i / BLOCK_SIZE, &result.data[left], right - left);
 					}
 					cur_stream->ready = true;
 				}
@@ -233,65 +473,162 @@ void NetworkStreamDownloader::downloader_thread() {
 				}
 			}
 		} else {
-			u64 block_reading = read_heads[cur_stream_index] / BLOCK_SIZE;
+			u64 read_head_block = read_heads[cur_stream_index] / BLOCK_SIZE;
+			u64 block_reading = read_head_block;
+			struct BlockRange {
+				u64 first_block;
+				u64 block_cnt;
+			};
+			std::vector<BlockRange> ranges_to_download;
 			if (cur_stream->ready) {
-				while (block_reading < cur_stream->block_num && cur_stream->downloaded_data.count(block_reading)) block_reading++;
+				while (block_reading < cur_stream->block_num && cur_stream->is_block_available(block_reading)) block_reading++;
 				if (block_reading == cur_stream->block_num) { // something unexpected happened
 					logger.error(LOG_THREAD_STR, "unexpected error (trying to read beyond the end of the stream)");
 					cur_stream->error = true;
 					continue;
 				}
-			}
+				// the SD card cache comes before the network, the stream to download is chosen again afterwards
+				u64 window_end = std::min<u64>(cur_stream->block_num, read_head_block + get_forward_buffer_block_num(cur_stream));
+				if (cur_stream->disk_cache_id != "" && load_blocks_from_disk(cur_stream, block_reading, window_end, DISK_LOAD_BLOCK_NUM_MAX)) continue;
+				// nothing is buffered ahead of the read head (start of playback or right after a seek) : restart from small requests
+				if (block_reading == read_head_block) cur_stream->request_block_num = 1;
+				int request_block_num = adaptive_request_size ? cur_stream->request_block_num : 1;
+				
+				// request up to `parallel_request_num` runs of missing blocks in the forward buffer at once
+				// each run is at most `request_block_num` blocks long and is fetched with a single range request
+				for (u64 block = block_reading; block < window_end && (int) ranges_to_download.size() < parallel_request_num; block++) {
+					if (cur_stream->is_block_available(block)) continue;
+					u64 block_cnt = 1;
+					while (block + block_cnt < window_end && (int) block_cnt < request_block_num && !cur_stream->is_block_available(block + block_cnt)) block_cnt++;
+					ranges_to_download.push_back({block, block_cnt});
+					block += block_cnt - 1;
+				}
+				if (!ranges_to_download.size()) ranges_to_download.push_back({block_reading, 1});
+			} else ranges_to_download.push_back({block_reading, 1}); // the length is not known yet, so only the first block is requested
 			// Util_log_save("net/dl", "dl next : " + std::to_string(cur_stream_index) + " " + std::to_string(block_reading));
 			
-			u64 start = block_reading * BLOCK_SIZE;
-			u64 end = cur_stream->ready ? std::min((block_reading + 1) * BLOCK_SIZE, cur_stream->len) : (block_reading + 1) * BLOCK_SIZE;
-			u64 expected_len = end - start;
-			
-			auto &session_list = cur_stream->session_list ? *cur_stream->session_list : thread_network_session_list;
-			// length not sure -> use Range header to get the size (slower)
-			auto result = cur_stream->len == 0 ?
-				session_list.perform(HttpRequest::GET(cur_stream->url, {{"Range", "bytes=" + std::to_string(start) + "-" + std::to_string(end - 1)}})) :
-				session_list.perform(HttpRequest::GET(cur_stream->url + "&range=" + std::to_string(start) + "-" + std::to_string(end - 1), {}));
-			if (result.redirected_url != "") cur_stream->url = remove_url_parameter(result.redirected_url, "range");
-			
-			
-			if (!result.fail && result.status_code_is_success()) {
-				if (cur_stream->len == 0) {
-					auto content_range_str = result.get_header("Content-Range");
-					char *slash = strchr(content_range_str.c_str(), '/');
-					bool ok = false;
-					if (slash) {
-						char *end;
-						cur_stream->len = strtoll(slash + 1, &end, 10);
-						if (!*end) {
-							ok = true;
-							cur_stream->block_num = NetworkStream::get_block_num(cur_stream->len);
-						} else logger.error(LOG_THREAD_STR, "failed to parse Content-Range : " + std::string(slash + 1));
-					} else logger.error(LOG_THREAD_STR, "no slash in Content-Range response header : " + content_range_str);
-					if (!ok) cur_stream->error = true;
-				}
-				if (cur_stream->ready && result.data.size() != expected_len) {
-					logger.error(LOG_THREAD_STR, "size discrepancy : " + std::to_string(expected_len) + " -> " + std::to_string(result.data.size()));
-					if (cur_stream->retry_cnt_left) {
-						cur_stream->retry_cnt_left--;
-					} else cur_stream->error = true;
-					continue;
-				}
-				cur_stream->retry_cnt_left = NetworkStream::RETRY_CNT_MAX;
-				cur_stream->set_data(block_reading, result.data);
-				cur_stream->ready = true;
-			} else if (!result.fail) {
-				logger.error("net/dl", "stream returned: " + std::to_string(result.status_code));
-				cur_stream->error = true;
-			} else {
-				logger.error("net/dl", "access failed : " + result.error);
+			// blocks requested together usually fail together, so a failed batch consumes only one retry
+			bool failure_counted = false;
+			auto count_failure = [&] () {
+				if (failure_counted) return;
+				failure_counted = true;
 				if (cur_stream->retry_cnt_left) {
 					cur_stream->retry_cnt_left--;
 				} else cur_stream->error = true;
+			};
+			// the response body is received directly into cache slots, one block at a time
+			// complete blocks become readable right away, the last partial one only after the response turns out to be complete
+			struct RangeReceiver {
+				u64 received = 0;
+				int slot_index = -1;
+				u8 *buffer = NULL;
+			};
+			std::vector<RangeReceiver> receivers(ranges_to_download.size());
+			auto receive_data = [&] (size_t index, const u8 *data, size_t size) {
+				auto &range = ranges_to_download[index];
+				auto &receiver = receivers[index];
+				while (size) {
+					u64 block = range.first_block + receiver.received / BLOCK_SIZE;
+					u64 offset = receiver.received % BLOCK_SIZE;
+					if (block >= range.first_block + range.block_cnt) return false; // more than requested
+					if (offset == 0) receiver.slot_index = cur_stream->begin_block_write(block, &receiver.buffer);
+					size_t cur_size = std::min<u64>(size, BLOCK_SIZE - offset);
+					if (receiver.slot_index != -1) memcpy(receiver.buffer + offset, data, cur_size);
+					data += cur_size;
+					size -= cur_size;
+					receiver.received += cur_size;
+					if (receiver.received % BLOCK_SIZE == 0 && receiver.slot_index != -1) {
+						cur_stream->end_block_write(receiver.slot_index, block, BLOCK_SIZE);
+						receiver.slot_index = -1;
+					}
+				}
+				return true;
+			};
+			auto finish_receiving = [&] (size_t index, bool complete) {
+				auto &range = ranges_to_download[index];
+				auto &receiver = receivers[index];
+				if (receiver.slot_index != -1) {
+					u64 block = range.first_block + receiver.received / BLOCK_SIZE;
+					cur_stream->end_block_write(receiver.slot_index, block, complete ? receiver.received % BLOCK_SIZE : 0);
+					receiver.slot_index = -1;
+				}
+			};
+			
+			auto handle_result = [&] (size_t index, NetworkResult &result) {
+				const BlockRange &range = ranges_to_download[index];
+				u64 received = receivers[index].received;
+				if (result.cancelled) { // the range fell out of the forward buffer after a seek, it will be requested again if necessary
+					finish_receiving(index, false);
+					return;
+				}
+				if (result.redirected_url != "") cur_stream->url = remove_url_parameter(result.redirected_url, "range");
+				
+				u64 start = range.first_block * BLOCK_SIZE;
+				u64 end = (range.first_block + range.block_cnt) * BLOCK_SIZE;
+				if (cur_stream->ready) end = std::min(end, cur_stream->len);
+				u64 expected_len = end - start;
+				
+				if (!result.fail && result.status_code_is_success()) {
+					if (cur_stream->len == 0) {
+						auto content_range_str = result.get_header("Content-Range");
+						char *slash = strchr(content_range_str.c_str(), '/');
+						bool ok = false;
+						if (slash) {
+							char *end;
+							cur_stream->len = strtoll(slash + 1, &end, 10);
+							if (!*end) {
+								ok = true;
+								cur_stream->block_num = NetworkStream::get_block_num(cur_stream->len);
+							} else logger.error(LOG_THREAD_STR, "failed to parse Content-Range : " + std::string(slash + 1));
+						} else logger.error(LOG_THREAD_STR, "no slash in Content-Range response header : " + content_range_str);
+						if (!ok) cur_stream->error = true;
+					}
+					if (cur_stream->ready && received != expected_len) {
+						logger.error(LOG_THREAD_STR, "size discrepancy : " + std::to_string(expected_len) + " -> " + std::to_string(received));
+						finish_receiving(index, false);
+						count_failure();
+						return;
+					}
+					finish_receiving(index, true);
+					cur_stream->retry_cnt_left = NetworkStream::RETRY_CNT_MAX;
+					cur_stream->ready = true;
+					update_request_block_num(cur_stream, result, received);
+				} else if (!result.fail) {
+					finish_receiving(index, false);
+					logger.error("net/dl", "stream returned: " + std::to_string(result.status_code));
+					cur_stream->error = true;
+				} else {
+					finish_receiving(index, false);
+					logger.error("net/dl", "access failed : " + result.error);
+					count_failure();
+				}
+			};
+			
+			int forward_buffer_block_num = get_forward_buffer_block_num(cur_stream);
+			std::vector<HttpRequest> requests;
+			for (size_t index = 0; index < ranges_to_download.size(); index++) {
+				auto range = ranges_to_download[index];
+				u64 start = range.first_block * BLOCK_SIZE;
+				u64 end = (range.first_block + range.block_cnt) * BLOCK_SIZE;
+				if (cur_stream->ready) end = std::min(end, cur_stream->len);
+				// length not sure -> use Range header to get the size (slower)
+				auto request = cur_stream->len == 0 ?
+					HttpRequest::GET(cur_stream->url, {{"Range", "bytes=" + std::to_string(start) + "-" + std::to_string(end - 1)}}) :
+					HttpRequest::GET(cur_stream->url + "&range=" + std::to_string(start) + "-" + std::to_string(end - 1), {});
+				requests.push_back(request.with_priority(NetworkPriority::PLAYBACK_CRITICAL).with_abort_check([cur_stream, range, forward_buffer_block_num] () {
+					if (cur_stream->quit_request) return true;
+					u64 read_head_block = cur_stream->read_head / BLOCK_SIZE;
+					return range.first_block + range.block_cnt <= read_head_block || range.first_block >= read_head_block + forward_buffer_block_num;
+				}).with_data_sink([&, index] (const u8 *data, size_t size) { return receive_data(index, data, size); })
+				.with_on_finish_callback([&] (NetworkResult &result, int index) { handle_result(index, result); }));
 			}
+			auto &session_list = cur_stream->session_list ? *cur_stream->session_list : thread_network_session_list;
+			session_list.perform(requests);
+			for (size_t i = 0; i < ranges_to_download.size(); i++) finish_receiving(i, false); // in case perform() returned early (e.g. the app is exiting)
 		}
 	}
+	network_set_playback_margin_low(false);
+	set_prefetch_urls({});
 	logger.info(LOG_THREAD_STR, "Exit, deiniting...");
 	for (auto stream : streams) if (stream) stream->quit_request = true;
 }
@@ -1,5 +1,7 @@
 #pragma once
 #include <vector>
+#include <deque>
+#include <algorithm>
 #include <map>
 #include <string>
 #include <3ds.h>
@@ -12,13 +14,44 @@ struct NetworkStream {
 	static constexpr u64 NEW3DS_MAX_CACHE_BLOCKS = 12 * 1000 * 1000 / BLOCK_SIZE;
 	static constexpr u64 OLD3DS_MAX_CACHE_BLOCKS = 4 * 1000 * 1000 / BLOCK_SIZE;
 	static constexpr int RETRY_CNT_MAX = 1;
+	static constexpr int MAX_REQUEST_BLOCK_NUM = 4; // the maximum number of blocks fetched with one range request
+	static constexpr int RECENT_SEEK_NUM = 4;
 	static u64 get_block_num(u64 size) { return (size + BLOCK_SIZE - 1) / BLOCK_SIZE; }
 	
+	// when the cache is full, the block with the highest score of the eviction policy is dropped (pinned blocks are never dropped)
+	struct EvictionContext {
+		u64 read_head_block;
+		bool seeking_backward; // the last seek went backward
+		const std::deque<u64> &recent_seek_blocks; // the newest first
+	};
+	using EvictionPolicy = double (*)(u64 block, const EvictionContext &context);
+	// the blocks behind the read head first (the farthest first), then the blocks ahead (the farthest first)
+	static double eviction_score_farthest(u64 block, const EvictionContext &context);
+	// the same as above, except that the blocks just after recent seek targets are kept longer
+	// so that seeking back and forth doesn't download the same blocks again
+	static double eviction_score_seek_aware(u64 block, const EvictionContext &context);
+	
 	std::string url;
-	Mutex downloaded_data_lock; // std::map needs locking when searching and inserting at the same time
+	Mutex downloaded_data_lock; // the slot table needs locking when searching and inserting at the same time
 	u64 len = 0;
 	u64 block_num = 0;
-	std::map<u64, std::vector<u8> > downloaded_data;
+	// downloaded blocks live in a fixed number of slots of BLOCK_SIZE bytes
+	// a slot buffer is allocated the first time it's used and is reused after eviction, so no allocation happens on the read path
+	struct CacheSlot {
+		u8 *data = NULL;
+		u32 size = 0;
+		s64 block = -1; // -1 if the slot is unused
+		bool writing = false; // reserved by begin_block_write() and not readable yet
+	};
+	std::vector<CacheSlot> cache_slots;
+	std::vector<int> block_to_slot; // block_to_slot[block] : index in `cache_slots`, -1 if the block is not downloaded
+	u64 cached_block_num = 0;
+	EvictionPolicy eviction_policy = eviction_score_seek_aware;
+	std::vector<u64> pinned_blocks = {0}; // e.g. the moov box, the cues, ... (block #0 is always kept)
+	std::deque<u64> recent_seek_blocks;
+	bool seeking_backward = false;
+	LightEvent block_event; // signaled whenever a block is stored
+	std::string disk_cache_id; // dropped blocks are spilled to the SD card cache under this id ("" if disabled)
 	bool whole_download = false;
 	NetworkSessionList *session_list = NULL;
 	
@@ -29,6 +62,7 @@ struct NetworkStream {
 	volatile bool error = false;
 	volatile int retry_cnt_left = RETRY_CNT_MAX;
 	volatile u64 read_head = 0;
+	bool pin_reads = false; // set while the demuxer reads the header, every range read meanwhile is pinned
 	const char * volatile network_waiting_status = NULL;
 	bool disable_interrupt = false;
 	// used for livestreams
@@ -37,38 +71,89 @@ struct NetworkStream {
 	bool livestream_eof = false;
 	bool livestream_private = false;
 	bool read_dead_tried = false;
+	// used for adaptive request sizing
+	double throughput_estimate = 0; // bytes per second, 0 if not measured yet
+	double rtt_estimate = 0; // seconds, 0 if not measured yet
+	int request_block_num = 1; // the number of consecutive blocks requested with one range request
 	
 	
 	// if `whole_download` is true, it will not use Range request but download the whole content at once (used for livestreams)
 	NetworkStream (std::string url, int64_t len, bool whole_download, NetworkSessionList *session_list) : url(url), len(len < 0 ? 0 : len),
-		block_num(get_block_num(this->len)), whole_download(whole_download), session_list(session_list) {}
+		block_num(get_block_num(this->len)), whole_download(whole_download), session_list(session_list) { LightEvent_Init(&block_event, RESET_ONESHOT); }
+	~NetworkStream ();
 	
 	double get_download_percentage();
 	std::vector<double> get_buffering_progress_bar(int res_len);
 	
 	// check if the data of the current stream of range [start, start + size) is already downloaded and available
 	bool is_data_available(u64 start, u64 size);
+	bool is_block_available(u64 block);
 	
 	// this function must only be called when is_data_available(start, size) returns true
-	// returns the data of the stream of range [start, start + size)
-	std::vector<u8> get_data(u64 start, u64 size);
+	// copies the data of the stream of range [start, start + size) into `dst` and returns the number of bytes copied
+	size_t read_data(u64 start, u64 size, u8 *dst);
+	// called from the demuxer io
+	void pin_range(u64 start, u64 size); // the number of pinned blocks is capped at a quarter of the cache
+	void record_seek(u64 new_pos); // must be called before read_head is updated
+	int get_pinned_block_num();
+	// blocks until a block is stored or `timeout_ms` passes (the caller should check the availability again either way)
+	void wait_for_block(int timeout_ms) { LightEvent_WaitTimeout(&block_event, (s64) timeout_ms * 1000000); }
 	
-	// this function is supposed to be called from NetworkStreamDownloader::*
-	void set_data(u64 block, const std::vector<u8> &data);
+	// these functions are supposed to be called from NetworkStreamDownloader::*
+	void set_data(u64 block, const u8 *data, size_t size);
+	// reserves a slot for `block` so that the data can be received directly into it
+	// returns the slot index (and its buffer of BLOCK_SIZE bytes in `buffer`), or -1 if the block should not be stored
+	int begin_block_write(u64 block, u8 **buffer);
+	// makes the block readable with `size` bytes of data, or releases the slot if `size` is 0
+	void end_block_write(int slot_index, u64 block, size_t size);
+private :
+	int acquire_slot(u64 block); // downloaded_data_lock must be locked
+	bool is_pinned(u64 block) { return std::find(pinned_blocks.begin(), pinned_blocks.end(), block) != pinned_blocks.end(); }
 };
 
 
 // each instance of this class is paired with one downloader thread
 // it owns NetworkStream instances, and the one with the least margin (as in proportion to the length of the entire stream) is the target of next downloading
+// several missing blocks of the target stream are requested at once through the multi interface of the session list
+// consecutive missing blocks are merged into one range request whose size follows the measured throughput and RTT of the stream
+// the cache itself stays addressed by blocks of BLOCK_SIZE
+// while every stream has its forward buffer filled, the first blocks (moov box / init segment) of the streams likely to be played next
+// are fetched into a small side cache, and a stream with the same url adopts them in add_stream()
 class NetworkStreamDownloader {
 private :
 	static constexpr u64 BLOCK_SIZE = NetworkStream::BLOCK_SIZE;
+	static constexpr int PARALLEL_REQUEST_NUM_DEFAULT = 3;
+	static constexpr int PARALLEL_REQUEST_NUM_MAX = 4;
+	// lower priority traffic is held back while a stream has less than this many blocks buffered ahead of its read head
+	// (and until every stream has twice as many again)
+	static constexpr u64 PLAYBACK_MARGIN_LOW_BLOCKS = 2;
+	static constexpr int NEW3DS_PREFETCH_BLOCK_NUM = 2; // per stream
+	static constexpr int OLD3DS_PREFETCH_BLOCK_NUM = 1;
+	static constexpr int DISK_LOAD_BLOCK_NUM_MAX = 4; // blocks loaded from the SD card cache per loop
+	static constexpr int PREFETCH_STREAM_NUM_MAX = 2; // video + audio
 	static constexpr const char * USER_AGENT = "Mozilla/5.0 (Linux; Android 11; Pixel 3a) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/83.0.4103.101 Mobile Safari/537.36";
 	
 	Mutex streams_lock;
 	std::vector<NetworkStream *> streams;
 	
 	bool thread_exit_reqeusted = false;
+	int parallel_request_num = PARALLEL_REQUEST_NUM_DEFAULT; // the number of range requests of a stream performed at once
+	bool adaptive_request_size = true; // if false, every range request is exactly one block
+	volatile bool idle = false; // no stream needed downloading in the last loop
+	
+	struct PrefetchedStream {
+		std::string url;
+		u64 len = 0;
+		std::vector<u8> data; // the first min(len, PREFETCH_BLOCK_NUM * BLOCK_SIZE) bytes of the stream, valid once `done` is set
+		bool done = false; // empty `data` means the prefetch failed
+		NetworkSessionList::AsyncHandle request;
+		std::shared_ptr<volatile bool> cancelled = std::make_shared<volatile bool>(false); // aborts `request` alone
+	};
+	Mutex prefetch_lock;
+	std::vector<PrefetchedStream> prefetched_streams; // the side cache, only holds the urls of the last set_prefetch_urls()
+	volatile u32 prefetch_generation = 0; // incremented on every set_prefetch_urls()
+	void progress_prefetch(NetworkSessionList &session_list);
+	void collect_prefetched_stream(PrefetchedStream &prefetched); // prefetch_lock must be locked
 public :
 	NetworkStreamDownloader () = default;
 	
@@ -76,6 +161,12 @@ public :
 	void add_stream(NetworkStream *stream);
 	
 	void request_thread_exit() { thread_exit_reqeusted = true; }
+	void set_parallel_request_num(int num) { parallel_request_num = std::max(1, std::min(PARALLEL_REQUEST_NUM_MAX, num)); }
+	void set_adaptive_request_size(bool enabled) { adaptive_request_size = enabled; }
+	// replaces the prefetch targets and drops the blocks prefetched for the previous ones (an empty vector just clears the side cache)
+	// urls without the length parameter (e.g. livestreams) are ignored
+	void set_prefetch_urls(const std::vector<std::string> &urls);
+	bool is_idle() const { return idle; }
 	void delete_all();
 	
 	void downloader_thread();
@@ -1,6 +1,8 @@
 #include "headers.hpp"
 #include "network_io.hpp"
+#include "util/misc_tasks.hpp"
 #include <deque>
+#include <algorithm>
 
 #include <fcntl.h>
 
@@ -13,16 +15,308 @@
 
 static volatile bool exiting = false;
 
+static Mutex deinit_list_lock; // session lists are initialized from their own threads
 static std::vector<NetworkSessionList *> deinit_list;
+static std::vector<NetworkSessionList *> get_session_lists() {
+	deinit_list_lock.lock();
+	auto res = deinit_list;
+	deinit_list_lock.unlock();
+	return res;
+}
+
+// process-wide curl share handle : all session lists share the DNS cache and TLS sessions through it
+// so that each thread can resume TLS sessions instead of making full handshakes to the same hosts
+// connections are not shared : libcurl can't safely share its connection cache between multi handles driven by different threads
+// (transfers of one thread may end up waiting on a connection only another thread is polling), so each session list keeps its own
+static Mutex share_init_lock;
+static Mutex share_locks[CURL_LOCK_DATA_LAST];
+static CURLSH *curl_share = NULL;
+static void curl_share_lock_func(CURL *, curl_lock_data data, curl_lock_access, void *) { share_locks[data].lock(); }
+static void curl_share_unlock_func(CURL *, curl_lock_data data, void *) { share_locks[data].unlock(); }
+static CURLSH *get_curl_share() {
+	share_init_lock.lock();
+	if (!curl_share) {
+		curl_share = curl_share_init();
+		curl_share_setopt(curl_share, CURLSHOPT_LOCKFUNC, curl_share_lock_func);
+		curl_share_setopt(curl_share, CURLSHOPT_UNLOCKFUNC, curl_share_unlock_func);
+		curl_share_setopt(curl_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+		curl_share_setopt(curl_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+	}
+	share_init_lock.unlock();
+	return curl_share;
+}
+
+static Mutex host_stats_lock;
+static std::map<std::string, NetworkHostStats> host_stats;
+static std::string get_host_name(const std::string &url) {
+	size_t start = url.find("://");
+	start = start == std::string::npos ? 0 : start + 3;
+	size_t end = url.find_first_of(":/?", start);
+	return url.substr(start, end == std::string::npos ? std::string::npos : end - start);
+}
+std::map<std::string, NetworkHostStats> network_get_host_stats() {
+	host_stats_lock.lock();
+	auto res = host_stats;
+	host_stats_lock.unlock();
+	return res;
+}
+
+// in-flight request deduplication
+// nothing is buffered or copied for the joined requests unless someone has actually joined
+struct NetworkSessionList::InFlight {
+	std::string key;
+	bool done = false;
+	int joined_num = 0;
+	NetworkResult result; // valid once done, only filled if joined_num > 0
+	std::vector<u8> body; // a 2xx body the owner passed to its data sink, only kept if joined_num > 0 when it started
+	std::vector<CURLM *> waiting_multis; // woken up when done
+};
+static Mutex dedup_lock;
+static std::map<std::string, std::shared_ptr<NetworkSessionList::InFlight> > in_flight_requests; // dedup key -> transfer
+// called when the 2xx body of a transfer with a data sink starts, returns whether the body needs to be kept for joined requests
+// if no one has joined yet, the body is streamed to the sink only and later requests can no longer join
+static bool in_flight_start_body(NetworkSessionList::InFlight *in_flight) {
+	dedup_lock.lock();
+	bool res = in_flight->joined_num > 0;
+	if (!res) {
+		auto itr = in_flight_requests.find(in_flight->key);
+		if (itr != in_flight_requests.end() && itr->second.get() == in_flight) in_flight_requests.erase(itr);
+	}
+	dedup_lock.unlock();
+	return res;
+}
+static NetworkDedupStats dedup_stats;
+NetworkDedupStats network_get_dedup_stats() {
+	dedup_lock.lock();
+	auto res = dedup_stats;
+	dedup_lock.unlock();
+	return res;
+}
+
+// priority scheduling
+static const int transfer_num_max[NETWORK_PRIORITY_NUM] = {1000, 8, 6, 3};
+#define BACKGROUND_TRANSFER_NUM_MAX_WHILE_PLAYING 1 // while a PLAYBACK_CRITICAL transfer is running
+static Mutex schedule_lock;
+static NetworkScheduleStats schedule_stats;
+static volatile bool playback_margin_low = false;
+static bool schedule_acquire_slot(NetworkPriority priority) {
+	int cur = (int) priority;
+	if (playback_margin_low && priority >= NetworkPriority::PREFETCH) return false;
+	schedule_lock.lock();
+	int max = transfer_num_max[cur];
+	if (priority == NetworkPriority::BACKGROUND && schedule_stats.active_num[(int) NetworkPriority::PLAYBACK_CRITICAL])
+		max = std::min(max, BACKGROUND_TRANSFER_NUM_MAX_WHILE_PLAYING);
+	bool ok = schedule_stats.active_num[cur] < max;
+	if (ok) schedule_stats.active_num[cur]++;
+	schedule_lock.unlock();
+	return ok;
+}
+static void schedule_release_slot(NetworkPriority priority) {
+	schedule_lock.lock();
+	schedule_stats.active_num[(int) priority]--;
+	schedule_lock.unlock();
+}
+void network_set_playback_margin_low(bool low) {
+	if (playback_margin_low == low) return;
+	playback_margin_low = low;
+	if (low) {
+		schedule_lock.lock();
+		schedule_stats.preemption_num++;
+		schedule_lock.unlock();
+	}
+	for (auto session_list : get_session_lists()) session_list->wakeup(); // to pause/resume their transfers
+}
+bool network_is_playback_margin_low() { return playback_margin_low; }
+NetworkScheduleStats network_get_schedule_stats() {
+	schedule_lock.lock();
+	auto res = schedule_stats;
+	schedule_lock.unlock();
+	return res;
+}
+
+// timing log
+#define TIMING_SAMPLE_MAX 256
+struct TimingSample {
+	time_t time;
+	std::string host;
+	std::string endpoint;
+	int status_code;
+	bool fail;
+	double namelookup_time;
+	double connect_time;
+	double appconnect_time;
+	double time_to_first_byte;
+	double total_time;
+	u64 bytes_received;
+	int http_version;
+	bool connection_reused;
+};
+static Mutex timing_lock;
+static std::deque<TimingSample> timing_samples; // the most recent TIMING_SAMPLE_MAX requests
+static std::string get_endpoint(const std::string &url) { // host + path without queries
+	size_t start = url.find("://");
+	start = start == std::string::npos ? 0 : start + 3;
+	size_t end = url.find_first_of("?#", start);
+	return url.substr(start, end == std::string::npos ? std::string::npos : end - start);
+}
+static void record_timing(const std::string &url, const NetworkResult &res) {
+	TimingSample sample = {time(NULL), get_host_name(url), get_endpoint(url), res.status_code, res.fail, res.namelookup_time, res.connect_time,
+		res.appconnect_time, res.time_to_first_byte, res.total_time, res.bytes_received, res.http_version, res.connection_reused};
+	timing_lock.lock();
+	timing_samples.push_back(sample);
+	if (timing_samples.size() > TIMING_SAMPLE_MAX) timing_samples.pop_front();
+	timing_lock.unlock();
+}
+std::vector<NetworkEndpointTiming> network_get_endpoint_timings() {
+	std::map<std::string, std::vector<const TimingSample *> > samples_per_endpoint;
+	std::vector<NetworkEndpointTiming> res;
+	timing_lock.lock();
+	for (auto &sample : timing_samples) samples_per_endpoint[sample.endpoint].push_back(&sample);
+	for (auto &i : samples_per_endpoint) {
+		NetworkEndpointTiming cur;
+		cur.endpoint = i.first;
+		std::vector<double> ttfbs, totals;
+		for (auto sample : i.second) {
+			if (sample->fail) continue;
+			cur.request_num++;
+			cur.reused_num += sample->connection_reused;
+			cur.bytes_received += sample->bytes_received;
+			ttfbs.push_back(sample->time_to_first_byte);
+			totals.push_back(sample->total_time);
+			int bucket = 0;
+			while (bucket + 1 < NETWORK_TIMING_BUCKET_NUM && sample->total_time >= 0.05 * (1 << bucket)) bucket++;
+			cur.histogram[bucket]++;
+		}
+		if (!cur.request_num) continue;
+		std::sort(ttfbs.begin(), ttfbs.end());
+		std::sort(totals.begin(), totals.end());
+		cur.ttfb_median = ttfbs[ttfbs.size() / 2];
+		cur.total_median = totals[totals.size() / 2];
+		cur.total_p90 = totals[totals.size() * 9 / 10];
+		res.push_back(cur);
+	}
+	timing_lock.unlock();
+	std::sort(res.begin(), res.end(), [] (const auto &i, const auto &j) { return i.request_num > j.request_num; });
+	return res;
+}
+void network_dump_timings_csv() {
+	std::string data = "time,host,endpoint,status,fail,namelookup_ms,connect_ms,appconnect_ms,ttfb_ms,total_ms,bytes,http_version,reused\n";
+	auto ms = [] (double sec) { return std::to_string((int) (sec * 1000)); };
+	timing_lock.lock();
+	for (auto &i : timing_samples) {
+		data += std::to_string((long long) i.time) + "," + i.host + "," + i.endpoint + "," + std::to_string(i.status_code) + "," + std::to_string(i.fail) + "," +
+			ms(i.namelookup_time) + "," + ms(i.connect_time) + "," + ms(i.appconnect_time) + "," + ms(i.time_to_first_byte) + "," + ms(i.total_time) + "," +
+			std::to_string(i.bytes_received) + "," + std::to_string(i.http_version) + "," + std::to_string(i.connection_reused) + "\n";
+	}
+	timing_lock.unlock();
+	Result_with_string result = Path(DEF_MAIN_DIR + "network_log.csv").write_file((const u8 *) data.c_str(), data.size());
+	if (result.code != 0) logger.error("curl", "network log dump failed : " + result.error_description);
+	else logger.info("curl", "network log dumped");
+}
+
+// persistent DNS cache
+// the loaded entries are fed to curl through CURLOPT_RESOLVE as non-permanent ('+') entries of the shared DNS cache
+// they're only attached for the first DNS_CACHE_PRELOAD_SECONDS (curl's DNS cache timeout), after that curl resolves by itself
+// format version 2 : version 1 files may map the host of a redirected request to the address of the redirect target, so they are discarded
+#define DNS_CACHE_PATH (DEF_MAIN_DIR + "dns_cache.txt")
+#define DNS_CACHE_TMP_PATH (DEF_MAIN_DIR + "dns_cache_tmp.txt")
+#define DNS_CACHE_TTL (6 * 60 * 60)
+#define DNS_CACHE_MAX_ENTRIES 32
+#define DNS_CACHE_PRELOAD_SECONDS 60
+struct DNSCacheEntry {
+	std::string address;
+	time_t expire;
+};
+static Mutex dns_cache_lock;
+static std::map<std::pair<std::string, int>, DNSCacheEntry> dns_cache; // {host, port} -> address
+static struct curl_slist *dns_preload_list = NULL;
+static time_t dns_preload_until = 0;
+static AtomicFileIO dns_cache_io(DNS_CACHE_PATH, DNS_CACHE_TMP_PATH);
+
+void network_dns_cache_load() {
+	auto tmp = dns_cache_io.load([] (const std::string &data) { return data.substr(0, 11) == "dns_cache 2"; });
+	if (tmp.first.code != 0) return; // doesn't exist yet
+	if (tmp.second.substr(0, 11) != "dns_cache 2") {
+		logger.warning("curl", "dns cache broken");
+		return;
+	}
+	time_t now = time(NULL);
+	dns_cache_lock.lock();
+	char host[256], address[64];
+	int port;
+	long long expire;
+	for (size_t head = tmp.second.find('\n'); head != std::string::npos; head = tmp.second.find('\n', head + 1)) {
+		if (sscanf(tmp.second.c_str() + head + 1, "%255s %d %63s %lld", host, &port, address, &expire) != 4) continue;
+		if (expire <= now) continue;
+		dns_cache[{host, port}] = {address, (time_t) expire};
+		std::string address_str = strchr(address, ':') ? "[" + std::string(address) + "]" : std::string(address); // IPv6
+		dns_preload_list = curl_slist_append(dns_preload_list, ("+" + std::string(host) + ":" + std::to_string(port) + ":" + address_str).c_str());
+	}
+	dns_preload_until = now + DNS_CACHE_PRELOAD_SECONDS;
+	logger.info("curl", "dns cache : " + std::to_string(dns_cache.size()) + " entries loaded");
+	dns_cache_lock.unlock();
+}
+void network_dns_cache_save() {
+	dns_cache_lock.lock();
+	std::string data = "dns_cache 2\n";
+	for (auto &i : dns_cache) data += i.first.first + " " + std::to_string(i.first.second) + " " + i.second.address + " " + std::to_string((long long) i.second.expire) + "\n";
+	dns_cache_lock.unlock();
+	Result_with_string result = dns_cache_io.save(data);
+	if (result.code != 0) logger.error("curl", "dns cache save failed : " + result.error_description);
+}
+// per-video stream servers (rr1---sn-xxxx.googlevideo.com) are rarely contacted twice and would push the long-lived hosts out
+static bool dns_cache_host_worth_storing(const std::string &host) {
+	const std::string stream_server_suffix = ".googlevideo.com";
+	return !(host.compare(0, 2, "rr") == 0 && host.size() > stream_server_suffix.size() &&
+		host.compare(host.size() - stream_server_suffix.size(), stream_server_suffix.size(), stream_server_suffix) == 0);
+}
+static void dns_cache_update(CURL *curl) {
+	char *ip = NULL;
+	long port = 0;
+	char *effective_url = NULL;
+	if (curl_easy_getinfo(curl, CURLINFO_PRIMARY_IP, &ip) != CURLE_OK || !ip || !*ip) return;
+	if (curl_easy_getinfo(curl, CURLINFO_PRIMARY_PORT, &port) != CURLE_OK || !port) return;
+	// the primary IP is the one of the last connection, which is to the host of the last redirect, not to the one of the original url
+	if (curl_easy_getinfo(curl, CURLINFO_EFFECTIVE_URL, &effective_url) != CURLE_OK || !effective_url) return;
+	std::string host = get_host_name(effective_url);
+	if (host == "" || !dns_cache_host_worth_storing(host)) return;
+	time_t now = time(NULL);
+	
+	dns_cache_lock.lock();
+	auto &entry = dns_cache[{host, (int) port}];
+	bool changed = entry.address != ip || entry.expire < now + DNS_CACHE_TTL / 2;
+	if (changed) {
+		entry = {ip, now + DNS_CACHE_TTL};
+		while (dns_cache.size() > DNS_CACHE_MAX_ENTRIES) { // drop the one expiring first
+			auto erase_itr = dns_cache.begin();
+			for (auto i = dns_cache.begin(); i != dns_cache.end(); i++) if (i->second.expire < erase_itr->second.expire) erase_itr = i;
+			dns_cache.erase(erase_itr);
+		}
+	}
+	dns_cache_lock.unlock();
+	if (changed) misc_tasks_request(TASK_SAVE_DNS_CACHE);
+}
+static void dns_cache_drop_preload() { // the stored addresses may be stale
+	dns_cache_lock.lock();
+	dns_preload_until = 0;
+	dns_cache_lock.unlock();
+}
 
 void NetworkSessionList::init() {
 	inited = true;
+	deinit_list_lock.lock();
 	deinit_list.push_back(this);
+	deinit_list_lock.unlock();
 }
 void NetworkSessionList::deinit() {
 	inited = false;
 	
 	// curl cleanup
+	for (auto &i : handle_pool) {
+		curl_easy_cleanup(i.curl);
+		free(i.errbuf);
+	}
+	handle_pool.clear();
 	if (curl_multi) {
 		curl_multi_cleanup(curl_multi);
 		curl_multi = NULL;
@@ -30,10 +324,22 @@ void NetworkSessionList::deinit() {
 }
 void NetworkSessionList::exit_request() {
 	exiting = true;
+	for (auto session_list : get_session_lists()) session_list->wakeup(); // don't let them sleep in process()
 }
 void NetworkSessionList::at_exit() {
-	for (auto session_list : deinit_list) session_list->deinit();
+	deinit_list_lock.lock();
+	auto session_lists = std::move(deinit_list);
 	deinit_list.clear();
+	deinit_list_lock.unlock();
+	for (auto session_list : session_lists) session_list->deinit();
+	for (auto &i : host_stats) logger.info("curl", i.first + " : " + std::to_string(i.second.reused_num) + "/" + std::to_string(i.second.request_num) + " reused");
+	logger.info("curl", std::to_string(dedup_stats.coalesced_num) + " requests coalesced, " + std::to_string(dedup_stats.saved_bytes / 1000) + " KB saved");
+	if (curl_share) {
+		curl_share_cleanup(curl_share);
+		curl_share = NULL;
+	}
+	curl_slist_free_all(dns_preload_list);
+	dns_preload_list = NULL;
 }
 
 
@@ -43,16 +349,31 @@ static std::string remove_leading_whitespaces(std::string str) {
 	return str.substr(i, str.size() - i);
 }
 
+// the body is not reserved beyond this from Content-Length, in case the header is bogus
+#define CONTENT_LENGTH_RESERVE_MAX (4 * 1024 * 1024)
+
 // libcurl callback functions
 static size_t curl_receive_data_callback_func(char *in_ptr, size_t, size_t len, void *user_data) {
-	std::vector<u8> *out = (std::vector<u8> *) user_data;
+	NetworkSessionList::ReceiveContext *context = (NetworkSessionList::ReceiveContext *) user_data;
+	if (context->request->data_sink) {
+		long status_code = 0;
+		curl_easy_getinfo(context->curl, CURLINFO_RESPONSE_CODE, &status_code);
+		if (status_code / 100 == 2) {
+			if (context->in_flight && !context->body_started) context->keep_body = in_flight_start_body(context->in_flight);
+			context->body_started = true;
+			if (context->keep_body) context->in_flight->body.insert(context->in_flight->body.end(), in_ptr, in_ptr + len);
+			return context->request->data_sink((const u8 *) in_ptr, len) ? len : 0; // error bodies still go to `data`
+		}
+	}
+	std::vector<u8> *out = &context->res->data;
 	out->insert(out->end(), in_ptr, in_ptr + len);
 	
 	// Util_log_save("curl", "received : " + std::to_string(len));
 	return len;
 }
 static size_t curl_receive_headers_callback_func(char* in_ptr, size_t, size_t len, void *user_data) {
-	std::map<std::string, std::string> *out = (std::map<std::string, std::string> *) user_data;
+	NetworkSessionList::ReceiveContext *context = (NetworkSessionList::ReceiveContext *) user_data;
+	std::map<std::string, std::string> *out = &context->res->response_headers;
 	
 	std::string cur_line = std::string(in_ptr, in_ptr + len);
 	if (cur_line.size() && cur_line.back() == '\n') cur_line.pop_back();
@@ -66,6 +387,11 @@ static size_t curl_receive_headers_callback_func(char* in_ptr, size_t, size_t le
 		// Util_log_save("curl", "header line : " + header_name + " : " + header_content);
 		for (auto &c : header_name) c = tolower(c);
 		(*out)[header_name] = header_content;
+		// reserve the body at once instead of growing it piece by piece (the header is the compressed size if compressed, but still a good start)
+		if (header_name == "content-length" && !context->request->data_sink) {
+			long long content_length = strtoll(header_content.c_str(), NULL, 10);
+			if (content_length > 0 && content_length <= CONTENT_LENGTH_RESERVE_MAX) context->res->data.reserve(context->res->data.size() + content_length);
+		}
 	}
 	return len;
 }
@@ -78,8 +404,9 @@ static int curl_set_socket_options(void *, curl_socket_t sockfd, curlsocktype pu
 	return CURL_SOCKOPT_OK;
 }
 static int curl_progress_callback_func(void *data, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow) {
-	if (*(std::function<void (u64, u64)> *) data)
-		(*(std::function<void (u64, u64)> *) data)(dlnow, dltotal);
+	const HttpRequest *request = (const HttpRequest *) data;
+	if (request->progress_func) request->progress_func(dlnow, dltotal);
+	if (request->abort_check && request->abort_check()) return 1; // non-zero aborts the transfer
 	return CURL_PROGRESSFUNC_CONTINUE;
 }
 static int curl_debug_callback_func(CURL *handle, curl_infotype type, char *data, size_t size, void *userptr) {
@@ -94,13 +421,47 @@ static int curl_debug_callback_func(CURL *handle, curl_infotype type, char *data
 	return 0;
 }
 
-void NetworkSessionList::curl_add_request(const HttpRequest &request, NetworkResult *res) {
+bool NetworkSessionList::curl_add_request(AsyncHandle async) {
+	const HttpRequest &request = async->request;
+	NetworkResult *res = &async->result;
 	if (!curl_multi) {
+		submit_lock.lock();
 		curl_multi = curl_multi_init();
+		submit_lock.unlock();
 		curl_multi_setopt(curl_multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
 	}
+	std::shared_ptr<InFlight> in_flight;
+	if (request.dedup_key.size()) {
+		dedup_lock.lock();
+		auto &cur = in_flight_requests[request.dedup_key];
+		if (cur) { // join the transfer already in flight
+			cur->joined_num++;
+			cur->waiting_multis.push_back(curl_multi);
+			coalesced_requests.push_back({async, cur});
+			dedup_stats.coalesced_num++;
+			dedup_lock.unlock();
+			return true;
+		}
+		bool ok = schedule_acquire_slot(request.priority);
+		if (ok) {
+			in_flight = cur = std::make_shared<InFlight>();
+			in_flight->key = request.dedup_key;
+		}
+		else in_flight_requests.erase(request.dedup_key);
+		dedup_lock.unlock();
+		if (!ok) return false;
+	} else if (!schedule_acquire_slot(request.priority)) return false;
+	
 	CURL *curl;
-	curl = curl_easy_init();
+	char *curl_errbuf;
+	if (handle_pool.size()) {
+		curl = handle_pool.back().curl;
+		curl_errbuf = handle_pool.back().errbuf;
+		handle_pool.pop_back();
+	} else {
+		curl = curl_easy_init();
+		curl_errbuf = (char *) malloc(CURL_ERROR_SIZE);
+	}
 	curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0L);
 	curl_easy_setopt(curl, CURLOPT_BUFFERSIZE, 102400L);
 	curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "br");
@@ -108,19 +469,23 @@ void NetworkSessionList::curl_add_request(const HttpRequest &request, NetworkRes
 	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, curl_receive_data_callback_func);
 	curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, curl_receive_headers_callback_func);
 	curl_easy_setopt(curl, CURLOPT_SOCKOPTFUNCTION, curl_set_socket_options);
-	curl_easy_setopt(curl, CURLOPT_XFERINFODATA, &request.progress_func);
+	curl_easy_setopt(curl, CURLOPT_XFERINFODATA, &request);
 	curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, curl_progress_callback_func);
 	curl_easy_setopt(curl, CURLOPT_NOPROGRESS, (long) 0);
 	// curl_easy_setopt(curl, CURLOPT_VERBOSE, (long) 1);
 	// curl_easy_setopt(curl, CURLOPT_DEBUGFUNCTION, curl_debug_callback_func);
-	char *curl_errbuf = (char *) malloc(CURL_ERROR_SIZE);
 	memset(curl_errbuf, 0, CURL_ERROR_SIZE);
 	curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, curl_errbuf);
 	curl_easy_setopt(curl, CURLOPT_PIPEWAIT, 1L);
+	curl_easy_setopt(curl, CURLOPT_SHARE, get_curl_share());
+	dns_cache_lock.lock();
+	if (dns_preload_list && time(NULL) < dns_preload_until) curl_easy_setopt(curl, CURLOPT_RESOLVE, dns_preload_list);
+	dns_cache_lock.unlock();
 	// curl_easy_setopt(curl, CURLOPT_TIMEOUT, timeout);
 	
-	curl_easy_setopt(curl, CURLOPT_WRITEDATA, &res->data);
-	curl_easy_setopt(curl, CURLOPT_HEADERDATA, &res->response_headers);
+	ReceiveContext *receive_context = new ReceiveContext{curl, &request, res, in_flight.get()};
+	curl_easy_setopt(curl, CURLOPT_WRITEDATA, receive_context);
+	curl_easy_setopt(curl, CURLOPT_HEADERDATA, receive_context);
 	curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, request.method.c_str());
 	curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, (long) request.follow_redirect);
 	curl_easy_setopt(curl, CURLOPT_POSTFIELDS, request.body.c_str());
@@ -131,114 +496,294 @@ void NetworkSessionList::curl_add_request(const HttpRequest &request, NetworkRes
 	curl_easy_setopt(curl, CURLOPT_HTTPHEADER, request_headers_list);
 	
 	curl_multi_add_handle(curl_multi, curl);
-	curl_requests.push_back({curl, res, curl_errbuf, request.url, request.on_finish});
-}
-CURLMcode NetworkSessionList::curl_perform_requests() {
-	auto read_multi_info = [this] () {
-		CURLMsg *msg;
-		int msg_left;
-		while ((msg = curl_multi_info_read(curl_multi, &msg_left))) {
-			if (msg->msg == CURLMSG_DONE) {
-				CURL *curl = msg->easy_handle;
-				
-				int request_index = -1;
-				for (size_t i = 0; i < curl_requests.size(); i++) {
-					if (curl_requests[i].curl == msg->easy_handle) {
-						request_index = i;
-						break;
-					}
-				}
-				// Util_log_save("bench", "finished #" + std::to_string(request_index));
-				
-				if (request_index == -1) {
-					logger.error("curl", "unexpected : while processing multi message corresponding request not found");
-					continue;
-				}
-				RequestInternal &req = curl_requests[request_index];
-				NetworkResult &res = *req.res;
-				
-				CURLcode each_result = msg->data.result;
-				if (each_result == CURLE_OK) {
-					long status_code;
-					curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status_code);
-					res.status_code = status_code;
-					
-					char *redirected_url;
-					curl_easy_getinfo(curl, CURLINFO_EFFECTIVE_URL, &redirected_url);
-					res.redirected_url = redirected_url;
-					if (res.redirected_url != req.orig_url) logger.info("curl", "redir : " + res.redirected_url);
-				} else {
-					logger.error("curl", std::string("deep fail : ") + curl_easy_strerror(each_result) + " / " + req.errbuf);
+	curl_requests.push_back({curl, curl_errbuf, receive_context, request_headers_list, async, in_flight});
+	return true;
+}
+void NetworkSessionList::curl_add_pending_requests() {
+	submit_lock.lock();
+	pending_requests.insert(pending_requests.end(), submitted_requests.begin(), submitted_requests.end());
+	submitted_requests.clear();
+	submit_lock.unlock();
+	if (!pending_requests.size()) return;
+	
+	std::stable_sort(pending_requests.begin(), pending_requests.end(),
+		[] (const AsyncHandle &i, const AsyncHandle &j) { return i->request.priority < j->request.priority; });
+	auto requests = std::move(pending_requests);
+	pending_requests.clear();
+	int deferred_num = 0;
+	for (auto &async : requests) {
+		const HttpRequest &request = async->request;
+		if (exiting || (request.abort_check && request.abort_check())) {
+			async->result.fail = true;
+			async->result.cancelled = !exiting;
+			async->result.error = exiting ? "The app is exiting" : "cancelled";
+			finish_request(async);
+		} else if (!curl_add_request(async)) {
+			pending_requests.push_back(async);
+			if (!async->deferred) deferred_num++;
+			async->deferred = true;
+		}
+	}
+	if (deferred_num) {
+		schedule_lock.lock();
+		schedule_stats.deferred_num += deferred_num;
+		schedule_lock.unlock();
+	}
+}
+void NetworkSessionList::update_preemption() {
+	bool pause = playback_margin_low;
+	if (pause == low_priority_paused) return;
+	low_priority_paused = pause;
+	for (auto &req : curl_requests) if (req.async->request.priority >= NetworkPriority::PREFETCH)
+		curl_easy_pause(req.curl, pause ? CURLPAUSE_RECV : CURLPAUSE_CONT);
+}
+#define HANDLE_POOL_MAX 8
+void NetworkSessionList::curl_release_handle(CURL *curl, char *errbuf, NetworkPriority priority) {
+	schedule_release_slot(priority);
+	curl_multi_remove_handle(curl_multi, curl);
+	if (handle_pool.size() < HANDLE_POOL_MAX) {
+		curl_easy_reset(curl); // connections stay in curl_multi and DNS/TLS sessions in the share handle, so nothing is lost
+		handle_pool.push_back({curl, errbuf});
+	} else {
+		curl_easy_cleanup(curl);
+		free(errbuf);
+	}
+}
+void NetworkSessionList::publish_in_flight(std::shared_ptr<InFlight> &in_flight, const NetworkResult &res) {
+	dedup_lock.lock();
+	auto itr = in_flight_requests.find(in_flight->key);
+	if (itr != in_flight_requests.end() && itr->second == in_flight) in_flight_requests.erase(itr); // later requests with the same key make a new transfer
+	bool joined = in_flight->joined_num > 0; // no one can join from here
+	dedup_lock.unlock();
+	
+	// only the joined requests read `result`, and only after `done` is set
+	if (joined) {
+		in_flight->result = res;
+		if (in_flight->body.size()) in_flight->result.data = std::move(in_flight->body);
+	}
+	dedup_lock.lock();
+	in_flight->done = true;
+	auto waiting_multis = std::move(in_flight->waiting_multis);
+	dedup_lock.unlock();
+	for (auto multi : waiting_multis) curl_multi_wakeup(multi);
+	in_flight.reset();
+}
+void NetworkSessionList::finish_request(const AsyncHandle &async) {
+	if (async->request.on_finish) async->request.on_finish(async->result, async->index);
+	async->done = true;
+}
+int NetworkSessionList::finish_coalesced_requests() {
+	int finished_num = 0;
+	for (size_t i = 0; i < coalesced_requests.size(); ) {
+		CoalescedRequest cur = coalesced_requests[i];
+		const HttpRequest &request = cur.async->request;
+		NetworkResult &res = cur.async->result;
+		dedup_lock.lock();
+		bool done = cur.in_flight->done;
+		dedup_lock.unlock();
+		bool aborted = !done && (exiting || (request.abort_check && request.abort_check()));
+		if (!done && !aborted) {
+			i++;
+			continue;
+		}
+		coalesced_requests.erase(coalesced_requests.begin() + i); // before on_finish, which may add requests
+		if (aborted) {
+			res.fail = true;
+			res.cancelled = !exiting;
+			res.error = exiting ? "The app is exiting" : "cancelled";
+		} else if (cur.in_flight->result.cancelled) { // cancelled by the one who started the transfer, not by us
+			cur.async->request.dedup_key = "";
+			pending_requests.push_back(cur.async);
+			continue;
+		} else {
+			res = cur.in_flight->result; // never modified after `done` is set
+			dedup_lock.lock();
+			dedup_stats.saved_bytes += res.bytes_received;
+			dedup_lock.unlock();
+			if (request.data_sink && res.status_code_is_success()) {
+				if (!request.data_sink(res.data.data(), res.data.size())) {
 					res.fail = true;
-					res.error = req.errbuf;
+					res.error = "data sink refused the body";
 				}
-				if (req.on_finish) req.on_finish(res, request_index);
+				res.data.clear();
 			}
 		}
-	};
+		finish_request(cur.async);
+		finished_num++;
+	}
+	return finished_num;
+}
+int NetworkSessionList::curl_read_finished_requests() {
+	int finished_num = 0;
+	CURLMsg *msg;
+	int msg_left;
+	while ((msg = curl_multi_info_read(curl_multi, &msg_left))) {
+		if (msg->msg != CURLMSG_DONE) continue;
+		CURL *curl = msg->easy_handle;
+		CURLcode each_result = msg->data.result;
+		
+		auto req_itr = std::find_if(curl_requests.begin(), curl_requests.end(), [&] (const RequestInternal &i) { return i.curl == curl; });
+		if (req_itr == curl_requests.end()) {
+			logger.error("curl", "unexpected : while processing multi message corresponding request not found");
+			continue;
+		}
+		RequestInternal req = *req_itr;
+		curl_requests.erase(req_itr); // before on_finish, which may add requests
+		NetworkResult &res = req.async->result;
+		const std::string &orig_url = req.async->request.url;
+		
+		if (each_result == CURLE_OK) dns_cache_update(curl);
+		// a stale address may also belong to another host now, which fails the TLS handshake instead of the connection
+		if (each_result == CURLE_COULDNT_CONNECT || each_result == CURLE_SSL_CONNECT_ERROR || each_result == CURLE_PEER_FAILED_VERIFICATION)
+			dns_cache_drop_preload();
+		{
+			long new_connection_num = 0;
+			curl_easy_getinfo(curl, CURLINFO_NUM_CONNECTS, &new_connection_num);
+			res.connection_reused = each_result == CURLE_OK && new_connection_num == 0;
+			host_stats_lock.lock();
+			auto &stats = host_stats[get_host_name(orig_url)];
+			stats.request_num++;
+			if (res.connection_reused) stats.reused_num++;
+			host_stats_lock.unlock();
+			
+			curl_off_t value;
+			if (curl_easy_getinfo(curl, CURLINFO_NAMELOOKUP_TIME_T, &value) == CURLE_OK) res.namelookup_time = value / 1000000.0;
+			if (curl_easy_getinfo(curl, CURLINFO_CONNECT_TIME_T, &value) == CURLE_OK) res.connect_time = value / 1000000.0;
+			if (curl_easy_getinfo(curl, CURLINFO_APPCONNECT_TIME_T, &value) == CURLE_OK) res.appconnect_time = value / 1000000.0;
+			if (curl_easy_getinfo(curl, CURLINFO_STARTTRANSFER_TIME_T, &value) == CURLE_OK) res.time_to_first_byte = value / 1000000.0;
+			if (curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME_T, &value) == CURLE_OK) res.total_time = value / 1000000.0;
+			if (curl_easy_getinfo(curl, CURLINFO_SIZE_DOWNLOAD_T, &value) == CURLE_OK) res.bytes_received = value;
+			long http_version = 0;
+			curl_easy_getinfo(curl, CURLINFO_HTTP_VERSION, &http_version);
+			res.http_version = http_version == CURL_HTTP_VERSION_1_0 ? 10 : http_version == CURL_HTTP_VERSION_1_1 ? 11 :
+				http_version == CURL_HTTP_VERSION_2_0 ? 20 : 0;
+		}
+		if (each_result == CURLE_OK) {
+			long status_code;
+			curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status_code);
+			res.status_code = status_code;
+			
+			char *redirected_url;
+			curl_easy_getinfo(curl, CURLINFO_EFFECTIVE_URL, &redirected_url);
+			res.redirected_url = redirected_url;
+			if (res.redirected_url != orig_url) logger.info("curl", "redir : " + res.redirected_url);
+		} else if (each_result == CURLE_ABORTED_BY_CALLBACK) {
+			res.fail = true;
+			res.cancelled = true;
+			res.error = "cancelled";
+		} else {
+			logger.error("curl", std::string("deep fail : ") + curl_easy_strerror(each_result) + " / " + req.errbuf);
+			res.fail = true;
+			res.error = req.errbuf;
+		}
+		record_timing(orig_url, res);
+		
+		delete req.receive_context;
+		curl_slist_free_all(req.headers_list);
+		curl_release_handle(curl, req.errbuf, req.async->request.priority);
+		if (req.in_flight) publish_in_flight(req.in_flight, res); // before on_finish, which may move the data out
+		finish_request(req.async);
+		finished_num++;
+	}
+	return finished_num;
+}
+void NetworkSessionList::curl_fail_all_requests(const std::string &error) {
+	auto requests = std::move(curl_requests);
+	curl_requests.clear();
+	for (auto &req : requests) {
+		req.async->result.fail = true;
+		req.async->result.error = error;
+		delete req.receive_context;
+		curl_slist_free_all(req.headers_list);
+		curl_release_handle(req.curl, req.errbuf, req.async->request.priority);
+		if (req.in_flight) publish_in_flight(req.in_flight, req.async->result);
+		finish_request(req.async);
+	}
+}
+
+int NetworkSessionList::process(int timeout_ms) {
+	if (!this->inited) return 0;
 	
-	int running_request_num;
-	do {
-		CURLMcode res = curl_multi_perform(curl_multi, &running_request_num);
-		if (res) {
-			std::string err = curl_multi_strerror(res);
-			logger.error("curl", "curl multi deep fail : " + err);
-			for (auto &i : curl_requests) {
-				i.res->fail = true;
-				i.res->error = err;
-			}
-			return res;
+	int finished_num = 0;
+	for (int i = 0; i < 2; i++) { // poll only if nothing has finished in the first round
+		curl_add_pending_requests();
+		update_preemption();
+		
+		if (curl_requests.size()) {
+			int running_request_num;
+			CURLMcode res = curl_multi_perform(curl_multi, &running_request_num);
+			if (res) {
+				std::string err = curl_multi_strerror(res);
+				logger.error("curl", "curl multi deep fail : " + err);
+				finished_num += curl_requests.size();
+				curl_fail_all_requests(err);
+			} else finished_num += curl_read_finished_requests();
 		}
-		if (running_request_num) curl_multi_poll(curl_multi, NULL, 0, 10000, NULL);
 		if (exiting) {
-			for (auto &i : curl_requests) {
-				i.res->fail = true;
-				i.res->error = "The app is exiting";
-			}
-			return CURLM_OK;
+			finished_num += curl_requests.size();
+			curl_fail_all_requests("The app is exiting");
 		}
-		read_multi_info();
-	} while (running_request_num > 0);
+		finished_num += finish_coalesced_requests(); // also handles exiting
+		
+		if (i == 1 || finished_num || timeout_ms <= 0) break;
+		// slots freed by other threads don't wake us up
+		int cur_timeout_ms = pending_requests.size() ? std::min(timeout_ms, 50) : timeout_ms;
+		if (curl_multi) curl_multi_poll(curl_multi, NULL, 0, cur_timeout_ms, NULL);
+		else usleep(cur_timeout_ms * 1000);
+	}
 	
-	return CURLM_OK;
+	submit_lock.lock();
+	int remaining_num = curl_requests.size() + coalesced_requests.size() + submitted_requests.size() + pending_requests.size();
+	submit_lock.unlock();
+	return remaining_num;
 }
-void NetworkSessionList::curl_clear_requests() {
-	for (auto &i : curl_requests) {
-		free(i.errbuf);
-		curl_multi_remove_handle(curl_multi, i.curl);
-		curl_easy_cleanup(i.curl);
+NetworkSessionList::AsyncHandle NetworkSessionList::submit(const HttpRequest &request) {
+	AsyncHandle res = std::make_shared<AsyncRequest>();
+	res->request = request;
+	if (!this->inited) {
+		res->result.fail = true;
+		res->result.error = "invalid session list";
+		res->done = true;
+		return res;
 	}
-	curl_requests.clear();
+	submit_lock.lock();
+	submitted_requests.push_back(res);
+	CURLM *multi = curl_multi;
+	submit_lock.unlock();
+	if (multi) curl_multi_wakeup(multi); // in case the owner thread is waiting in process()
+	return res;
+}
+void NetworkSessionList::wakeup() {
+	submit_lock.lock();
+	if (curl_multi) curl_multi_wakeup(curl_multi);
+	submit_lock.unlock();
 }
 
 NetworkResult NetworkSessionList::perform(const HttpRequest &request) {
-	NetworkResult result;
-	
-	if (!this->inited) {
-		result.fail = true;
-		result.error = "invalid session list";
-		return result;
-	}
-	
-	this->curl_add_request(request, &result);
-	this->curl_perform_requests();
-	this->curl_clear_requests();
-	return result;
+	return std::move(perform(std::vector<HttpRequest>{request})[0]);
 }
 std::vector<NetworkResult> NetworkSessionList::perform(const std::vector<HttpRequest> &requests) {
 	std::vector<NetworkResult> results(requests.size());
 	
 	if (!this->inited) {
-		for (auto result : results) {
+		for (auto &result : results) {
 			result.fail = true;
 			result.error = "invalid session list";
 		}
 		return results;
 	}
 	
-	for (size_t i = 0; i < requests.size(); i++) this->curl_add_request(requests[i], &results[i]);
-	this->curl_perform_requests();
-	this->curl_clear_requests();
+	std::vector<AsyncHandle> handles;
+	for (size_t i = 0; i < requests.size(); i++) {
+		handles.push_back(std::make_shared<AsyncRequest>());
+		handles.back()->request = requests[i];
+		handles.back()->index = i;
+		pending_requests.push_back(handles.back());
+	}
+	// our own transfers are published to the requests joining them as soon as they finish,
+	// so two threads can never be waiting for each other here
+	while (std::any_of(handles.begin(), handles.end(), [] (const AsyncHandle &i) { return !i->done; })) process(1000);
+	for (size_t i = 0; i < requests.size(); i++) results[i] = std::move(handles[i]->result);
 	return results;
 }
 
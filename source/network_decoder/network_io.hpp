@@ -3,22 +3,43 @@
 #include <map>
 #include <string>
 #include <functional>
+#include <memory>
 #include <3ds.h>
 #include <curl/curl.h>
+#include "system/libctru_wrapper.hpp"
 
 
 struct NetworkResult {
 	std::string redirected_url;
 	bool fail = false; // whether some network error occured; receiving http error code like 404 is still counted as a 'success'
+	bool cancelled = false; // the transfer was aborted because `abort_check` of the request returned true (`fail` is also set)
 	std::string error;
 	int status_code = -1;
 	std::string status_message;
 	std::vector<u8> data;
 	std::map<std::string, std::string> response_headers;
+	// timings in seconds, each measured from the start of the request (filled even if the request failed)
+	double namelookup_time = 0;
+	double connect_time = 0;
+	double appconnect_time = 0; // TLS handshake done
+	double time_to_first_byte = 0;
+	double total_time = 0;
+	u64 bytes_received = 0; // including what was passed to HttpRequest::data_sink
+	int http_version = 0; // 10, 11, 20 (0 if unknown)
+	bool connection_reused = false;
 	
 	bool status_code_is_success() { return status_code / 100 == 2; }
 	std::string get_header(std::string key);
 };
+// the network layer runs higher classes first when transfers compete for the link
+enum class NetworkPriority {
+	PLAYBACK_CRITICAL, // blocks of the stream being played, never deferred
+	INTERACTIVE, // something the user is waiting for (e.g. page loads)
+	PREFETCH, // likely to be needed soon (e.g. thumbnails on screen)
+	BACKGROUND, // anything else (e.g. off-screen thumbnails)
+};
+#define NETWORK_PRIORITY_NUM 4
+
 struct HttpRequest { // including https
 	std::string method;
 	std::string url;
@@ -30,6 +51,18 @@ struct HttpRequest { // including https
 	progress_callback_t progress_func{};
 	using on_finish_callback_t = std::function<void (NetworkResult &, int)>;
 	on_finish_callback_t on_finish{};
+	using abort_check_t = std::function<bool ()>; // polled while transferring, the transfer is aborted once it returns true
+	abort_check_t abort_check{};
+	// if set, the body of a successful (2xx) response is passed here piece by piece instead of being stored in NetworkResult::data
+	// returning false aborts the transfer
+	using data_sink_t = std::function<bool (const u8 *, size_t)>;
+	data_sink_t data_sink{};
+	// requests with the same non-empty key that are in flight at the same time (from any thread) share one transfer
+	// with a data sink, a request can only join before the body of the transfer has started
+	// set this only for idempotent requests
+	std::string dedup_key;
+	// PREFETCH and BACKGROUND transfers are deferred and paused while the playback margin is low (see network_set_playback_margin_low())
+	NetworkPriority priority = NetworkPriority::INTERACTIVE;
 	
 	static std::map<std::string, std::string> default_headers_added(std::map<std::string, std::string> headers) {
 		// Set up default Android/YouTube client headers
@@ -56,33 +89,92 @@ struct HttpRequest { // including https
 	}
 
 	HttpRequest with_progress_func(progress_callback_t progress_func) const {
-		return HttpRequest{method, url, headers, body, follow_redirect, progress_func, on_finish};
+		return HttpRequest{method, url, headers, body, follow_redirect, progress_func, on_finish, abort_check, data_sink, dedup_key, priority};
 	}
 
 	HttpRequest with_on_finish_callback(on_finish_callback_t on_finish) const {
-		return HttpRequest{method, url, headers, body, follow_redirect, progress_func, on_finish};
+		return HttpRequest{method, url, headers, body, follow_redirect, progress_func, on_finish, abort_check, data_sink, dedup_key, priority};
 	}
 
+	HttpRequest with_abort_check(abort_check_t abort_check) const {
+		return HttpRequest{method, url, headers, body, follow_redirect, progress_func, on_finish, abort_check, data_sink, dedup_key, priority};
+	}
+
+	HttpRequest with_data_sink(data_sink_t data_sink) const {
+		return HttpRequest{method, url, headers, body, follow_redirect, progress_func, on_finish, abort_check, data_sink, dedup_key, priority};
+	}
+
+	HttpRequest with_dedup_key(const std::string &dedup_key) const {
+		return HttpRequest{method, url, headers, body, follow_redirect, progress_func, on_finish, abort_check, data_sink, dedup_key, priority};
+	}
+
+	HttpRequest with_priority(NetworkPriority priority) const {
+		return HttpRequest{method, url, headers, body, follow_redirect, progress_func, on_finish, abort_check, data_sink, dedup_key, priority};
+	}
+
+	HttpRequest with_dedup() const { return with_dedup_key(method + " " + url + "\n" + body); }
+
 };
 
 struct NetworkSessionList { // one instance per thread
+public :
+	struct InFlight; // a transfer other requests with the same dedup key can join
+	struct AsyncRequest { // returned by submit()
+		HttpRequest request;
+		int index = 0; // passed to on_finish
+		NetworkResult result;
+		volatile bool done = false; // `result` is final and on_finish has returned
+		bool deferred = false; // had to wait for a transfer slot
+	};
+	using AsyncHandle = std::shared_ptr<AsyncRequest>;
 private :
 	void deinit(); // will be called for each instance when the app exits
 	
-	void curl_add_request(const HttpRequest &request, NetworkResult *res);
-	CURLMcode curl_perform_requests();
-	void curl_clear_requests();
+	struct CoalescedRequest {
+		AsyncHandle async;
+		std::shared_ptr<InFlight> in_flight;
+	};
+	std::vector<CoalescedRequest> coalesced_requests; // requests waiting for a transfer started by someone else
+	
+	Mutex submit_lock; // guards submitted_requests and the creation of curl_multi
+	std::vector<AsyncHandle> submitted_requests; // submitted (possibly from another thread) but not yet added to curl_multi
+	std::vector<AsyncHandle> pending_requests; // waiting for their priority class to get a transfer slot
+	bool low_priority_paused = false;
+	struct PooledHandle {
+		CURL *curl;
+		char *errbuf;
+	};
+	std::vector<PooledHandle> handle_pool; // finished easy handles reset for reuse (curl keeps their connection caches)
+	
+	bool curl_add_request(AsyncHandle async); // returns false if the priority class has no free slot
+	void curl_add_pending_requests();
+	void update_preemption();
+	void curl_release_handle(CURL *curl, char *errbuf, NetworkPriority priority);
+	int curl_read_finished_requests(); // returns the number of requests finished
+	void curl_fail_all_requests(const std::string &error);
+	void finish_request(const AsyncHandle &async);
+	void publish_in_flight(std::shared_ptr<InFlight> &in_flight, const NetworkResult &res);
+	int finish_coalesced_requests(); // the ones whose transfer finished, returns the number of requests finished
 public :
 	// used for libcurl
 	CURLM* curl_multi = NULL; // curl manages sessions within a single CURL *
-	struct RequestInternal {
+	struct ReceiveContext { // passed to the write/header callbacks of libcurl
 		CURL *curl;
+		const HttpRequest *request;
 		NetworkResult *res;
+		InFlight *in_flight; // non-NULL if other requests can join the transfer
+		bool keep_body = false; // a 2xx body passed to the data sink is also kept for the joined requests
+		bool body_started = false;
+	};
+	struct RequestInternal {
+		CURL *curl;
 		char *errbuf;
-		std::string orig_url;
-		HttpRequest::on_finish_callback_t on_finish;
+		ReceiveContext *receive_context;
+		curl_slist *headers_list;
+		AsyncHandle async;
+		std::shared_ptr<InFlight> in_flight; // non-null until the result is published to the joined requests
 	};
-	std::vector<RequestInternal> curl_requests; // {curl context, corresponding result, error buffer}
+	std::vector<RequestInternal> curl_requests; // requests added to curl_multi and not finished yet
 	
 	volatile bool inited = false;
 	
@@ -91,13 +183,64 @@ public :
 	void close_sessions();
 	
 	// network operations
+	// blocks until all of the requests finish, requests submitted with submit() also progress meanwhile
 	NetworkResult perform(const HttpRequest &request);
 	std::vector<NetworkResult> perform(const std::vector<HttpRequest> &requests);
 	
+	// asynchronous requests : submit() can be called from any thread and the request joins the running transfers immediately,
+	// but transfers only progress (and on_finish is only called) inside process() or perform() on the thread that owns this session list
+	AsyncHandle submit(const HttpRequest &request);
+	// runs the transfers until at least one request finishes or `timeout_ms` passes (returns earlier on wakeup())
+	// returns the number of requests not finished yet
+	int process(int timeout_ms);
+	void wakeup(); // can be called from any thread
+	
 	static void at_exit();
 	static void exit_request();
 };
 
+struct NetworkHostStats {
+	int request_num = 0;
+	int reused_num = 0; // the number of requests that didn't need a new connection
+};
+std::map<std::string, NetworkHostStats> network_get_host_stats();
+
+struct NetworkDedupStats {
+	int coalesced_num = 0; // the number of requests that joined a transfer already in flight instead of making their own
+	u64 saved_bytes = 0;
+};
+NetworkDedupStats network_get_dedup_stats();
+
+// transfer slots per priority class, shared by all session lists
+// while the stream being played is about to run out of buffer, PREFETCH and BACKGROUND transfers are paused and new ones are deferred
+void network_set_playback_margin_low(bool low); // called by the stream downloader
+bool network_is_playback_margin_low();
+struct NetworkScheduleStats {
+	int active_num[NETWORK_PRIORITY_NUM] = {0}; // transfers running now
+	int deferred_num = 0; // the number of times a request had to wait for a slot
+	int preemption_num = 0; // the number of times low priority transfers were paused for playback
+};
+NetworkScheduleStats network_get_schedule_stats();
+
+// timings of recent requests, aggregated per endpoint (host + path) for the debug overlay
+#define NETWORK_TIMING_BUCKET_NUM 8 // total time histogram : < 50ms, < 100ms, < 200ms, ... < 3200ms, >= 3200ms
+struct NetworkEndpointTiming {
+	std::string endpoint;
+	int request_num = 0;
+	int reused_num = 0;
+	u64 bytes_received = 0;
+	double ttfb_median = 0; // seconds
+	double total_median = 0;
+	double total_p90 = 0;
+	int histogram[NETWORK_TIMING_BUCKET_NUM] = {0};
+};
+std::vector<NetworkEndpointTiming> network_get_endpoint_timings(); // sorted by request_num in decreasing order
+void network_dump_timings_csv(); // writes every retained request to DEF_MAIN_DIR "network_log.csv" (TASK_DUMP_NETWORK_LOG)
+
+// addresses the hosts resolved to are kept on the SD card, so that the first requests after launch can skip DNS resolution
+void network_dns_cache_load(); // called from Menu_init(), before any request is made
+void network_dns_cache_save(); // called from the misc tasks thread (TASK_SAVE_DNS_CACHE)
+
 void lock_network_state();
 void unlock_network_state();
 
@@ -1,6 +1,7 @@
 #include "headers.hpp"
 #include "network_io.hpp"
 #include "thumbnail_loader.hpp"
+#include "data_io/thumbnail_cache.hpp"
 #include <set>
 #include <map>
 #include <queue>
@@ -39,6 +40,24 @@ static std::map<std::string, int> thumbnail_free_time;
 
 #define THUMBNAIL_CACHE_MAX 300 // 4 KB * 300 = 1.2 MB
 
+// decoded (and already cropped/rounded) BGR565 pixels, to skip Image_decode() when a freed thumbnail is requested again
+// only the thumbnail thread inserts or evicts entries, so the pointers it looks up stay valid until it evicts them itself
+struct DecodedThumbnail {
+	u8 *data;
+	int width;
+	int height;
+	bool night_mode; // icons are rounded with the background color baked in
+	double decode_time; // ms
+	int last_access;
+};
+static std::map<std::pair<std::string, ThumbnailType>, DecodedThumbnail> decoded_cache;
+static size_t decoded_cache_size = 0;
+static int decoded_cache_access_cnter = 0;
+static ThumbnailDecodeCacheStats decoded_cache_stats;
+
+#define DECODED_CACHE_BUDGET_OLD3DS (2 * 1024 * 1024)
+#define DECODED_CACHE_BUDGET_NEW3DS (8 * 1024 * 1024)
+
 
 struct URLStatus {
 	std::set<int> handles;
@@ -69,6 +88,7 @@ int thumbnail_request(const std::string &url, SceneType scene_id, int priority,
 	requested_urls[url].type = type;
 	thumbnail_free_time.erase(url);
 	resource_lock.unlock();
+	thread_network_session_list.wakeup(); // the thumbnail thread may be waiting for downloads to finish
 	if (requests.size() > 180) logger.warning("tloader", "request size too large, possible resource leak : " + std::to_string(requests.size()));
 	return handle;
 }
@@ -137,6 +157,47 @@ int thumbnail_get_status_code(int handle) {
 	return thumbnail_get_status_code(requests[handle].url);
 }
 
+ThumbnailDecodeCacheStats thumbnail_get_decode_cache_stats() {
+	resource_lock.lock();
+	auto res = decoded_cache_stats;
+	resource_lock.unlock();
+	return res;
+}
+
+// should be called with resource_lock locked
+static const DecodedThumbnail *decoded_cache_get(const std::string &url, ThumbnailType type) {
+	auto itr = decoded_cache.find({url, type});
+	if (itr == decoded_cache.end()) return NULL;
+	if (type == ThumbnailType::ICON && itr->second.night_mode != var_night_mode) return NULL;
+	itr->second.last_access = decoded_cache_access_cnter++;
+	return &itr->second;
+}
+// takes the ownership of `data` (allocated with malloc()), should be called with resource_lock locked
+static void decoded_cache_put(const std::string &url, ThumbnailType type, u8 *data, int w, int h, double decode_time) {
+	size_t budget = var_is_new3ds ? DECODED_CACHE_BUDGET_NEW3DS : DECODED_CACHE_BUDGET_OLD3DS;
+	size_t size = (size_t) w * h * 2;
+	if (size > budget / 4) {
+		free(data);
+		return;
+	}
+	auto itr = decoded_cache.find({url, type});
+	if (itr != decoded_cache.end()) {
+		decoded_cache_size -= (size_t) itr->second.width * itr->second.height * 2;
+		free(itr->second.data);
+		decoded_cache.erase(itr);
+	}
+	while (decoded_cache.size() && decoded_cache_size + size > budget) {
+		auto erase_itr = decoded_cache.begin();
+		for (auto i = decoded_cache.begin(); i != decoded_cache.end(); i++)
+			if (i->second.last_access < erase_itr->second.last_access) erase_itr = i;
+		decoded_cache_size -= (size_t) erase_itr->second.width * erase_itr->second.height * 2;
+		free(erase_itr->second.data);
+		decoded_cache.erase(erase_itr);
+	}
+	decoded_cache[{url, type}] = {data, w, h, var_night_mode, decode_time, decoded_cache_access_cnter++};
+	decoded_cache_size += size;
+}
+
 bool thumbnail_draw(int handle, int x_offset, int y_offset, int x_len, int y_len) {
 	if (handle == -1) return false;
 	bool res;
@@ -194,8 +255,121 @@ static std::vector<u8> http_get(const std::string &url, int &status_code) {
 	return result.data;
 }
 
+#define MAX_CONCURRENT_DOWNLOADS 8
+static std::set<std::string> downloading_urls; // only accessed from the thumbnail thread
+
+// decodes the downloaded (or cached) thumbnail and makes it available for drawing
+static void load_thumbnail(const std::string &url, ThumbnailType type, NetworkResult &res) {
+	int w, h;
+	u8 *decoded_data = NULL;
+	bool decoded_cached = false;
+	double decode_time = 0;
+	resource_lock.lock();
+	const DecodedThumbnail *decoded_entry = decoded_cache_get(url, type);
+	if (decoded_entry) {
+		decoded_data = decoded_entry->data;
+		w = decoded_entry->width;
+		h = decoded_entry->height;
+		decoded_cached = true;
+		decoded_cache_stats.hits++;
+		decoded_cache_stats.decode_time_saved += decoded_entry->decode_time;
+	} else decoded_cache_stats.misses++;
+	resource_lock.unlock();
+	
+	TickCounter decode_counter; // covers decoding (with the crop) and the rounding below
+	osTickCounterStart(&decode_counter);
+	if (!decoded_cached && res.data.size()) {
+		// some special operations on the picture here (it shouldn't be here but...)
+		// only the cropped region is converted by Image_decode()
+		auto crop = [&] (int w, int h) -> ImageRegion {
+			// for video thumbnail, crop to 16:9
+			if (type == ThumbnailType::VIDEO_THUMBNAIL && h > w * 9 / 16 + 1) {
+				int new_h = w * 9 / 16;
+				return {0, (h - new_h) / 2, w, new_h};
+			}
+			// for channel banners, the center 1024 pixels (the maximum texture width)
+			if (type == ThumbnailType::VIDEO_BANNER && w > 1024) return {(w - 1024) / 2, 0, 1024, h};
+			return {0, 0, w, h};
+		};
+		decoded_data = Image_decode(&res.data[0], res.data.size(), &w, &h, crop);
+	}
+	if (decoded_data && !decoded_cached) {
+		// update cache
+		resource_lock.lock();
+		if (thumbnail_cache.size() >= THUMBNAIL_CACHE_MAX) {
+			std::string erase_url;
+			int min_time = 1000000000;
+			for (auto &item : thumbnail_cache) {
+				if (!thumbnail_free_time.count(item.first)) continue;
+				int cur_time = thumbnail_free_time[item.first];
+				if (min_time > cur_time) {
+					min_time = cur_time;
+					erase_url = item.first;
+				}
+			}
+			if (erase_url != "") thumbnail_cache.erase(erase_url);
+		}
+		thumbnail_cache[url] = res.data;
+		if (thumbnail_cache.size() >= THUMBNAIL_CACHE_MAX + 10) logger.warning("tloader", "over caching : " + std::to_string(thumbnail_cache.size()));
+		resource_lock.unlock();
+		if (res.status_code != 0) thumbnail_disk_cache_put(url, res.data); // freshly downloaded
+		
+		// channel icon : round (definitely not the recommended way but we will fill the area outside the circle with white)
+		if (type == ThumbnailType::ICON) Image_round_icon((u16 *) decoded_data, w, h, var_night_mode);
+		
+		osTickCounterUpdate(&decode_counter);
+		decode_time = osTickCounterRead(&decode_counter);
+	}
+	if (decoded_data) {
+		Image_data result_image;
+		int texture_w = 1;
+		while (texture_w < w) texture_w <<= 1;
+		int texture_h = 1;
+		while (texture_h < h) texture_h <<= 1;
+		
+		Result_with_string result;
+		result = Draw_c2d_image_init(&result_image, texture_w, texture_h, GPU_RGB565);
+		if (result.code != 0) logger.error("thumb-dl", "out of linearmem");
+		else {
+			result = Draw_set_texture_data(&result_image, decoded_data, w, h, texture_w, texture_h, GPU_RGB565);
+			if (result.code != 0) logger.error("thumb-dl", "Draw_set_texture_data() failed");
+			else {
+				resource_lock.lock();
+				if (requested_urls.count(url)) { // in case the request is cancelled while downloading
+					requested_urls[url].is_loaded = true;
+					requested_urls[url].data = {w, h, texture_w, texture_h, result_image};
+				}
+				resource_lock.unlock();
+			}
+		}
+		if (!decoded_cached) {
+			resource_lock.lock();
+			decoded_cache_put(url, type, decoded_data, w, h, decode_time);
+			resource_lock.unlock();
+		}
+		decoded_data = NULL;
+	} else {
+		resource_lock.lock();
+		if (requested_urls.count(url)) {
+			requested_urls[url].is_loaded = false;
+			requested_urls[url].error = true;
+			if (res.status_code / 100 != 4 && res.status_code / 100 != 2) {
+				requested_urls[url].waiting_retry = true;
+				requested_urls[url].next_retry = time(NULL) + 3;
+			} else requested_urls[url].waiting_retry = false;
+			requested_urls[url].last_status_code = res.status_code;
+		}
+		resource_lock.unlock();
+		std::string err_msg = "load failed (http code : " + std::to_string(res.status_code) + ") size:" + std::to_string(res.data.size()) +
+			" err:" + res.error;
+		
+		logger.error("thumb-dl", err_msg);
+	}
+}
+
 static bool should_be_running = true;
 void thumbnail_downloader_thread_func(void *arg) {
+	confirm_thread_network_session_list_inited();
 	while (should_be_running) {
 		resource_lock.lock();
 		struct Item {
@@ -207,6 +381,7 @@ void thumbnail_downloader_thread_func(void *arg) {
 		{
 			for (auto &i : requested_urls) {
 				if (i.second.is_loaded) continue;
+				if (downloading_urls.count(i.first)) continue;
 				if (i.second.error && (!i.second.waiting_retry || time(NULL) < i.second.next_retry)) continue;
 				int priority = 0;
 				for (auto handle : i.second.handles) priority = std::max(priority,
@@ -217,7 +392,7 @@ void thumbnail_downloader_thread_func(void *arg) {
 		resource_lock.unlock();
 		
 		if (!download_list.size()) {
-			usleep(50000);
+			thread_network_session_list.process(50); // returns as soon as a download finishes or a new thumbnail is requested
 			continue;
 		}
 		
@@ -229,136 +404,42 @@ void thumbnail_downloader_thread_func(void *arg) {
 		if (download_list[0].priority >= PRIORITY_ACTIVE_SCENE + PRIORITY_FOREGROUND) // load thumbnails in the foreground first
 			while (download_list.back().priority < PRIORITY_ACTIVE_SCENE + PRIORITY_FOREGROUND) download_list.pop_back();
 		
-		std::vector<NetworkResult> results(download_list.size());
-		std::vector<int> uncached_index_list;
-		std::vector<int> cached_index_list;
-		for (size_t i = 0; i < download_list.size(); i++) {
-			if (thumbnail_cache.count(download_list[i].url)) {
-				results[i].status_code = 0; // cached
-				results[i].data = thumbnail_cache[download_list[i].url];
-				cached_index_list.push_back(i);
-			} else uncached_index_list.push_back(i);
-		}
-		
-		auto load_downloaded_thumbnail = [&] (int i) {
-			auto &res = results[i];
-			auto &info = download_list[i];
-			
-			int w, h;
-			u8 *decoded_data = NULL;
-			if (res.data.size()) decoded_data = Image_decode(&res.data[0], res.data.size(), &w, &h);
-			if (decoded_data) {
-				// update cache
-				resource_lock.lock();
-				if (thumbnail_cache.size() >= THUMBNAIL_CACHE_MAX) {
-					std::string erase_url;
-					int min_time = 1000000000;
-					for (auto &item : thumbnail_cache) {
-						if (!thumbnail_free_time.count(item.first)) continue;
-						int cur_time = thumbnail_free_time[item.first];
-						if (min_time > cur_time) {
-							min_time = cur_time;
-							erase_url = item.first;
-						}
-					}
-					if (erase_url != "") thumbnail_cache.erase(erase_url);
-				}
-				thumbnail_cache[info.url] = res.data;
-				if (thumbnail_cache.size() >= THUMBNAIL_CACHE_MAX + 10) logger.warning("tloader", "over caching : " + std::to_string(thumbnail_cache.size()));
-				resource_lock.unlock();
-				
-				// some special operations on the picture here (it shouldn't be here but...)
-				// for video thumbnail, crop to 16:9
-				if (info.type == ThumbnailType::VIDEO_THUMBNAIL && h > w * 9 / 16 + 1) {
-					int new_h = w * 9 / 16;
-					int vertical_offset = (h - new_h) / 2;
-					memmove(decoded_data, decoded_data + vertical_offset * w * 2, new_h * w * 2);
-					h = new_h;
-				}
-				// channel icon : round (definitely not the recommended way but we will fill the area outside the circle with white)
-				if (info.type == ThumbnailType::ICON) {
-					float radius = (float) h / 2;
-					for (int i = 0; i < h; i++) for (int j = 0; j < w; j++) {
-						float distance = std::hypot(radius - (i + 0.5), radius - (j + 0.5));
-						u8 b = decoded_data[(i * w + j) * 2 + 0] & ((1 << 5) - 1);
-						u8 g = (decoded_data[(i * w + j) * 2 + 0] >> 5) | ((decoded_data[(i * w + j) * 2 + 1] & ((1 << 3) - 1)) << 3);
-						u8 r = decoded_data[(i * w + j) * 2 + 1] >> 3;
-						float proportion = std::max(0.0f, std::min(1.0f, radius + 0.5f - distance));
-						b = b * proportion + (var_night_mode ? 0 : ((1 << 5) - 1)) * (1 - proportion);
-						g = g * proportion + (var_night_mode ? 0 : ((1 << 6) - 1)) * (1 - proportion);
-						r = r * proportion + (var_night_mode ? 0 : ((1 << 5) - 1)) * (1 - proportion);
-						decoded_data[(i * w + j) * 2 + 0] = b | g << 5;
-						decoded_data[(i * w + j) * 2 + 1] = g >> 3 | r << 3;
-					}
-				}
-				
-				Image_data result_image;
-				int texture_w = 1;
-				while (texture_w < w) texture_w <<= 1;
-				int texture_h = 1;
-				while (texture_h < h) texture_h <<= 1;
-				
-				Result_with_string result;
-				result = Draw_c2d_image_init(&result_image, texture_w, texture_h, GPU_RGB565);
-				if (result.code != 0) logger.error("thumb-dl", "out of linearmem");
-				else {
-					result = Draw_set_texture_data(&result_image, decoded_data, w, h, texture_w, texture_h, GPU_RGB565);
-					if (result.code != 0) logger.error("thumb-dl", "Draw_set_texture_data() failed");
-					else {
-						resource_lock.lock();
-						if (requested_urls.count(info.url)) { // in case the request is cancelled while downloading
-							requested_urls[info.url].is_loaded = true;
-							requested_urls[info.url].data = {w, h, texture_w, texture_h, result_image};
-						}
-						resource_lock.unlock();
-					}
-				}
-				free(decoded_data);
-				decoded_data = NULL;
-			} else {
-				resource_lock.lock();
-				if (requested_urls.count(info.url)) {
-					requested_urls[info.url].is_loaded = false;
-					requested_urls[info.url].error = true;
-					if (res.status_code / 100 != 4 && res.status_code / 100 != 2) {
-						requested_urls[info.url].waiting_retry = true;
-						requested_urls[info.url].next_retry = time(NULL) + 3;
-					} else requested_urls[info.url].waiting_retry = false;
-					requested_urls[info.url].last_status_code = res.status_code;
-				}
-				resource_lock.unlock();
-				std::string err_msg = "load failed (http code : " + std::to_string(res.status_code) + ") size:" + std::to_string(res.data.size()) +
-					" err:" + res.error;
-				
-				logger.error("thumb-dl", err_msg);
+		// cached ones are loaded right away, others are downloaded asynchronously so that new requests don't wait for a whole batch
+		for (auto &item : download_list) {
+			NetworkResult res;
+			resource_lock.lock();
+			bool decoded_cached = decoded_cache_get(item.url, item.type);
+			resource_lock.unlock();
+			if (decoded_cached) res.status_code = 0; // compressed data is not needed
+			else if (thumbnail_cache.count(item.url)) {
+				res.status_code = 0; // cached
+				res.data = thumbnail_cache[item.url];
+			} else if (thumbnail_disk_cache_get(item.url, res.data)) res.status_code = 0; // cached on the SD card
+			else {
+				if (downloading_urls.size() >= MAX_CONCURRENT_DOWNLOADS) continue;
+				downloading_urls.insert(item.url);
+				std::string url = item.url;
+				ThumbnailType type = item.type;
+				auto priority = item.priority >= PRIORITY_ACTIVE_SCENE + PRIORITY_FOREGROUND ? NetworkPriority::PREFETCH : NetworkPriority::BACKGROUND;
+				thread_network_session_list.submit(HttpRequest::GET(url, {}).with_priority(priority).with_on_finish_callback([url, type] (NetworkResult &res, int) {
+					downloading_urls.erase(url);
+					load_thumbnail(url, type, res);
+				}));
+				continue;
 			}
-		};
-		TickCounter counter;
-		osTickCounterStart(&counter);
-		// Util_log_save("thumb-dl", "load cached : " + std::to_string(cached_index_list.size()));
-		osTickCounterUpdate(&counter);
-		for (auto i : cached_index_list) load_downloaded_thumbnail(i);
-		osTickCounterUpdate(&counter);
-		// Util_log_save("thumb-dl", std::to_string((int) osTickCounterRead(&counter)) + " ms");
-		
-		// Util_log_save("thumb-dl", "start dl : " + std::to_string(uncached_index_list.size()));
-		// load uncached thumbnails
-		{
-			confirm_thread_network_session_list_inited();
-			std::vector<HttpRequest> requests;
-			for (auto i : uncached_index_list) requests.push_back(HttpRequest::GET(download_list[i].url, {}).with_on_finish_callback([&](NetworkResult &res, int index) {
-				results[uncached_index_list[index]] = res;
-				load_downloaded_thumbnail(uncached_index_list[index]);
-			}));
-			thread_network_session_list.perform(requests);
+			load_thumbnail(item.url, item.type, res);
 		}
-		osTickCounterUpdate(&counter);
-		// Util_log_save("thumb-dl", std::to_string((int) osTickCounterRead(&counter)) + " ms");
+		thread_network_session_list.process(50);
 	}
 	
 	resource_lock.lock();
 	for (auto i : requested_urls) if (i.second.is_loaded) Draw_c2d_image_free(i.second.data.data);
 	requested_urls.clear();
+	for (auto &i : decoded_cache) free(i.second.data);
+	decoded_cache.clear();
+	decoded_cache_size = 0;
+	logger.info("thumb-dl", "decode cache : " + std::to_string(decoded_cache_stats.hits) + " hits, " + std::to_string(decoded_cache_stats.misses) +
+		" misses, " + std::to_string((int) decoded_cache_stats.decode_time_saved) + " ms saved");
 	resource_lock.unlock();
 	
 	logger.info("thumb-dl", "Thread exit.");
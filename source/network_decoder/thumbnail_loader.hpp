@@ -5,7 +5,7 @@
 enum class ThumbnailType {
 	DEFAULT,
 	VIDEO_THUMBNAIL, // default.jpg is offered in 4:3 aspect ratio, so trim to 16:9
-	VIDEO_BANNER, // if width is 1060, it's manually trimmed into 1024
+	VIDEO_BANNER, // if wider than 1024 (e.g. 1060), the center 1024 pixels are kept
 	ICON, // rounded
 };
 
@@ -26,6 +26,14 @@ bool thumbnail_is_available(int handle);
 int thumbnail_get_status_code(const std::string &url);
 int thumbnail_get_status_code(int handle);
 
+// statistics of the cache of decoded pixels that sits in front of Image_decode()
+struct ThumbnailDecodeCacheStats {
+	int hits = 0;
+	int misses = 0;
+	double decode_time_saved = 0; // ms
+};
+ThumbnailDecodeCacheStats thumbnail_get_decode_cache_stats();
+
 bool thumbnail_draw(int handle, int x_offset, int y_offset, int x_len, int y_len);
 
 
@@ -120,6 +120,9 @@ void Menu_init(void)
 	for (int i = 0; i < FONT_BLOCK_NUM; i++) Extfont_request_extfont_status(i, true);
 	for (int i = 0; i < SYSTEM_FONT_NUM; i++) Extfont_request_sysfont_status(i, true);
 	
+	network_dns_cache_load(); // before the first request
+	misc_tasks_request(TASK_LOAD_STREAM_CACHE); // scans the SD card, so not done lazily on the first read of a stream
+	
 	menu_thread_run = true;
 	menu_worker_thread = threadCreate(Menu_worker_thread, (void*)(""), DEF_STACKSIZE, DEF_THREAD_PRIORITY_REALTIME, 1, false);
 	
@@ -291,6 +294,7 @@ bool Menu_main(void)
 	if (key.h_select && key.p_y) var_debug_mode = !var_debug_mode;
 	if (key.h_select && key.h_r && key.p_a) var_show_fps = !var_show_fps;
 	if (key.h_select && key.p_x) logger.draw_enabled ^= 1, var_need_reflesh = true; // toggle log drawing
+	if (var_debug_mode && key.h_select && key.p_l) misc_tasks_request(TASK_DUMP_NETWORK_LOG); // dump request timings to the SD card
 	logger.update(key);
 	if (key.h_touch || key.p_touch) var_need_reflesh = true;
 	if (((key.h_select && key.p_start) || (key.h_start && key.p_select)) && var_model != CFG_MODEL_2DS) bot_screen_disabled = !bot_screen_disabled;
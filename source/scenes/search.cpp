@@ -189,18 +189,20 @@ static View *result_item_to_view(const YouTubeSuccinctItem &item) {
 	View *res_view;
 	if (item.type == YouTubeSuccinctItem::CHANNEL) {
 		SuccinctChannelView *cur_view = new SuccinctChannelView(0, 0, 320, VIDEO_LIST_THUMBNAIL_HEIGHT);
-		cur_view->set_name(item.channel.name);
-		cur_view->set_auxiliary_lines({item.channel.subscribers, item.channel.video_num});
-		cur_view->set_thumbnail_url(item.channel.icon_url);
+		auto channel = item.get_channel();
+		cur_view->set_name(channel.name);
+		cur_view->set_auxiliary_lines({channel.subscribers, channel.video_num});
+		cur_view->set_thumbnail_url(channel.icon_url);
 		res_view = cur_view;
 	} else {
 		SuccinctVideoView *cur_view = new SuccinctVideoView(0, 0, 320, VIDEO_LIST_THUMBNAIL_HEIGHT);
 		cur_view->set_title_lines(truncate_str(item.get_name(), 320 - (VIDEO_LIST_THUMBNAIL_WIDTH + 3), 2, 0.5, 0.5));
 		if (item.type == YouTubeSuccinctItem::VIDEO) {
-			cur_view->set_auxiliary_lines({item.video.views_str, item.video.publish_date});
-			cur_view->set_bottom_right_overlay(item.video.duration_text);
+			auto video = item.get_video();
+			cur_view->set_auxiliary_lines({video.views_str, video.publish_date});
+			cur_view->set_bottom_right_overlay(video.duration_text);
 		} else if (item.type == YouTubeSuccinctItem::PLAYLIST) {
-			cur_view->set_auxiliary_lines({item.playlist.video_count_str});
+			cur_view->set_auxiliary_lines({item.get_playlist().video_count_str});
 		}
 		cur_view->set_thumbnail_url(item.get_thumbnail_url());
 		cur_view->set_is_playlist(item.type == YouTubeSuccinctItem::PLAYLIST);
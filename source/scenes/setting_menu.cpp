@@ -148,7 +148,7 @@ static void update_worker_thread_func(void *) {
 					new_error_message = "failed to parse json : " + error;
 				} else {
 					update_url_3dsx = update_url_cia;
-					for (auto item : result_json["assets"].array_items()) {
+					for (auto item : result_json["assets"].array_range()) {
 						auto url = item["browser_download_url"].string_value();
 						if (url.size() >= 5 && url.substr(url.size() - 5, 5) == ".3dsx") update_url_3dsx = url;
 						if (url.size() >= 4 && url.substr(url.size() - 4, 4) == ".cia") update_url_cia = url;
@@ -365,7 +365,20 @@ void Sem_init(void) {
 							snprintf(ratio_str, 16, "%.2f", var_forward_buffer_ratio);
 							return LOCALIZED(FORWARD_BUFFER_RATIO) + " : " + ratio_str;
 						})
-						->set_on_release([] (const BarView &view) { misc_tasks_request(TASK_SAVE_SETTINGS); })
+						->set_on_release([] (const BarView &view) { misc_tasks_request(TASK_SAVE_SETTINGS); }),
+					// Stream cache on the SD card
+					(new SelectorView(0, 0, 320, 35))
+						->set_texts({
+							(std::function<std::string ()>) []() { return LOCALIZED(DISABLED); },
+							(std::function<std::string ()>) []() { return LOCALIZED(ENABLED); }
+						}, var_stream_disk_cache)
+						->set_title([](const SelectorView &) { return LOCALIZED(STREAM_DISK_CACHE); })
+						->set_on_change([](const SelectorView &view) {
+							if (var_stream_disk_cache != view.selected_button) {
+								var_stream_disk_cache = view.selected_button;
+								misc_tasks_request(TASK_SAVE_SETTINGS);
+							}
+						})
 				}),
 			// Tab #3 : Data
 			(new ScrollView(0, 0, 320, 0))
@@ -10,6 +10,7 @@
 #include "network_decoder/network_io.hpp"
 #include "network_decoder/network_decoder_multiple.hpp"
 #include "network_decoder/thumbnail_loader.hpp"
+#include "data_io/history.hpp"
 #include "util/async_task.hpp"
 #include "util/misc_tasks.hpp"
 #include "util/util.hpp"
@@ -691,10 +692,11 @@ static SuccinctVideoView *suggestion_to_view(const YouTubeSuccinctItem &item) {
 	cur_view->set_title_lines(truncate_str(item.get_name(), SUGGESTION_TITLE_MAX_WIDTH, 2, 0.5, 0.5));
 	cur_view->set_thumbnail_url(item.get_thumbnail_url());
 	if (item.type == YouTubeSuccinctItem::VIDEO) {
-		cur_view->set_auxiliary_lines({item.video.author});
-		cur_view->set_bottom_right_overlay(item.video.duration_text);
+		auto video = item.get_video();
+		cur_view->set_auxiliary_lines({video.author});
+		cur_view->set_bottom_right_overlay(video.duration_text);
 	} else if (item.type == YouTubeSuccinctItem::PLAYLIST) {
-		cur_view->set_auxiliary_lines({item.playlist.video_count_str});
+		cur_view->set_auxiliary_lines({item.get_playlist().video_count_str});
 	}
 	cur_view->set_get_background_color(View::STANDARD_BACKGROUND);
 	cur_view->set_on_view_released([item] (View &view) {
@@ -757,6 +759,46 @@ static PostView *comment_to_view(const YouTubeVideoDetail::Comment &comment, int
 		});
 }
 
+// the streams `video_info` is played with : the requested quality falls back to 360p (New 3DS) or 144p, and then to audio only
+// urls is {audio}, {both} or {video, audio}, or empty if no usable stream was extracted
+struct StreamSelection {
+	bool audio_only;
+	int p_value;
+	std::vector<std::string> urls;
+};
+static StreamSelection select_streams(const YouTubeVideoDetail &video_info, bool audio_only, int p_value) {
+	// itag 18 (both_stream) of a long video takes too much time and sometimes leads to a crash
+	bool both_stream_usable = video_info.both_stream_url != "" && video_info.duration_ms <= 60 * 60 * 1000;
+	auto is_available = [&] (int p_value) { return video_info.video_stream_urls.count(p_value) || (p_value == 360 && both_stream_usable); };
+	if (!audio_only && !is_available(p_value)) {
+		p_value = var_is_new3ds ? 360 : 144;
+		if (!is_available(p_value)) audio_only = true;
+	}
+	
+	StreamSelection res;
+	res.audio_only = audio_only;
+	res.p_value = p_value;
+	if (audio_only) {
+		if (video_info.audio_stream_url != "") res.urls = {video_info.audio_stream_url};
+	} else if (p_value == 360 && both_stream_usable) res.urls = {video_info.both_stream_url};
+	else if (video_info.video_stream_urls.count(p_value) && video_info.video_stream_urls.at(p_value) != "" && video_info.audio_stream_url != "")
+		res.urls = {video_info.video_stream_urls.at(p_value), video_info.audio_stream_url};
+	return res;
+}
+
+static void add_to_watch_history(const YouTubeVideoDetail &video_info) {
+	if (video_info.title == "" || video_info.id == "") return;
+	HistoryVideo video;
+	video.id = video_info.id;
+	video.title = video_info.title;
+	video.author_name = video_info.author.name;
+	video.length_text = Util_convert_seconds_to_time((double) video_info.duration_ms / 1000);
+	video.my_view_count = 1;
+	video.last_watch_time = time(NULL);
+	add_watched_video(video);
+	misc_tasks_request(TASK_SAVE_HISTORY);
+}
+
 // arg : 
 //   cur_playing_url : only update the data for the player
 //   cur_displaying_url : only update the displayed data
@@ -1144,7 +1186,8 @@ static void load_video_page(void *arg) {
 			small_resource_lock.unlock();
 			return;
 		}
-		if (tmp_video_info.duration_ms > 60 * 60 * 1000) tmp_video_info.both_stream_url = ""; // for some reason, itag 18 causes problems when the video is long enough
+		// recorded when the video starts playing, not when its page is loaded (the page of the next video may have been prefetched)
+		if (playing_video_info.id != tmp_video_info.id) add_to_watch_history(tmp_video_info);
 		playing_video_info = tmp_video_info;
 		video_info_cache[url] = tmp_video_info;
 		
@@ -1169,11 +1212,9 @@ static void load_video_page(void *arg) {
 		for (auto i : available_qualities) if (var_is_new3ds || i <= 240) video_quality_selector_view->button_texts.push_back(std::to_string(i) + "p");
 		video_quality_selector_view->button_num = video_quality_selector_view->button_texts.size();
 		
-		auto is_available = [&] (int p_value) { return tmp_video_info.video_stream_urls.count(p_value) || (p_value == 360 && tmp_video_info.both_stream_url != ""); };
-		if (!audio_only_mode && !is_available(video_p_value)) {
-			video_p_value = var_is_new3ds ? 360 : 144;
-			if (!is_available(video_p_value)) audio_only_mode = true;
-		}
+		auto selection = select_streams(tmp_video_info, audio_only_mode, video_p_value);
+		audio_only_mode = selection.audio_only;
+		video_p_value = selection.p_value;
 		video_quality_selector_view->selected_button = audio_only_mode ? 0 : 1 + std::find(available_qualities.begin(), available_qualities.end(), (int) video_p_value) - available_qualities.begin();
 		video_quality_selector_view->set_on_change([available_qualities] (const SelectorView &view) {
 			bool changed = false;
@@ -1205,6 +1246,40 @@ static void load_video_page(void *arg) {
 		small_resource_lock.unlock();
 	}
 }
+// loads the page of the video autoplay will switch to and has the downloader prefetch the beginning of its streams
+// so that the switch doesn't have to wait for the page and the first blocks
+static void prefetch_next_video(void *) {
+	small_resource_lock.lock();
+	bool autoplay = !var_loop_mode && ((var_autoplay_level == 2 && playing_video_info.has_next_video()) ||
+		(var_autoplay_level == 1 && playing_video_info.has_next_video_in_playlist()));
+	std::string playing_url = cur_playing_url;
+	std::string url = autoplay ? playing_video_info.get_next_video().url : "";
+	bool need_loading = url != "" && !video_info_cache.count(url);
+	YouTubeVideoDetail next_video_info;
+	if (url != "" && !need_loading) next_video_info = video_info_cache[url];
+	small_resource_lock.unlock();
+	if (url == "") return;
+	
+	if (need_loading) {
+		logger.info("player/prefetch", "request : " + url);
+		add_cpu_limit(ADDITIONAL_CPU_LIMIT);
+		youtube_set_prefetch_mode(true); // not to compete with loads the user is waiting for
+		next_video_info = youtube_load_video_page(url);
+		youtube_set_prefetch_mode(false);
+		remove_cpu_limit(ADDITIONAL_CPU_LIMIT);
+	}
+	
+	small_resource_lock.lock();
+	if (!vid_already_init || cur_playing_url != playing_url) { // app shut down or the video changed while loading
+		small_resource_lock.unlock();
+		return;
+	}
+	if (need_loading && next_video_info.is_playable()) video_info_cache[url] = next_video_info; // picked up by load_video_page()
+	small_resource_lock.unlock();
+	if (!next_video_info.is_playable() || next_video_info.is_livestream) return;
+	
+	stream_downloader.set_prefetch_urls(select_streams(next_video_info, audio_only_mode, video_p_value).urls);
+}
 static void load_more_suggestions(void *arg_) {
 	YouTubeVideoDetail *arg = (YouTubeVideoDetail *) arg_;
 	
@@ -1430,6 +1505,7 @@ static void send_change_video_request_wo_lock(std::string url, bool update_playe
 	remove_all_async_tasks_with_type(load_video_page);
 	remove_all_async_tasks_with_type(load_more_suggestions);
 	remove_all_async_tasks_with_type(load_more_comments);
+	remove_all_async_tasks_with_type(prefetch_next_video);
 	
 	if (force_load) video_info_cache.erase(url);
 	
@@ -1638,6 +1714,7 @@ static void decode_thread(void* arg) {
 	int w = 0;
 	int h = 0;
 	bool key = false;
+	bool next_video_prefetch_requested = false;
 	std::string format = "";
 	std::string type = (char*)arg;
 	TickCounter counter0, counter1;
@@ -1663,6 +1740,7 @@ static void decode_thread(void* arg) {
 			vid_change_video_request = false;
 			vid_seek_request = false;
 			eof_reached = false;
+			next_video_prefetch_requested = false;
 			vid_play_request = true;
 			vid_total_time = 0;
 			vid_total_frames = 0;
@@ -1692,16 +1770,13 @@ static void decode_thread(void* arg) {
 			
 			// video page parsing sometimes randomly fails, so try several times
 			network_waiting_status = "Reading Stream";
-			if (audio_only_mode) {
-				result = network_decoder.init(playing_video_info.audio_stream_url, stream_downloader,
+			auto selection = select_streams(playing_video_info, audio_only_mode, video_p_value);
+			if (selection.urls.size() == 1) { // audio only or both_stream
+				result = network_decoder.init(selection.urls[0], stream_downloader,
 					playing_video_info.is_livestream ? playing_video_info.stream_fragment_len : -1, playing_video_info.needs_timestamp_adjusting(), var_is_new3ds);
-			} else if (video_p_value == 360 && playing_video_info.both_stream_url != "") {
-				// itag 18 (both_stream) of a long video takes too much time and sometimes leads to a crash 
-				result = network_decoder.init(playing_video_info.both_stream_url, stream_downloader,
-					playing_video_info.is_livestream ? playing_video_info.stream_fragment_len : -1, playing_video_info.needs_timestamp_adjusting(), var_is_new3ds);
-			} else if (playing_video_info.video_stream_urls[(int) video_p_value] != "" && playing_video_info.audio_stream_url != "") {
-				result = network_decoder.init(playing_video_info.video_stream_urls[(int) video_p_value], playing_video_info.audio_stream_url, stream_downloader,
-					playing_video_info.is_livestream ? playing_video_info.stream_fragment_len : -1, playing_video_info.needs_timestamp_adjusting(), var_is_new3ds && video_p_value == 360);
+			} else if (selection.urls.size() == 2) {
+				result = network_decoder.init(selection.urls[0], selection.urls[1], stream_downloader,
+					playing_video_info.is_livestream ? playing_video_info.stream_fragment_len : -1, playing_video_info.needs_timestamp_adjusting(), var_is_new3ds && selection.p_value == 360);
 			} else {
 				result.code = -1;
 				result.string = "YouTube parser error";
@@ -1788,6 +1863,12 @@ static void decode_thread(void* arg) {
 				if (vid_change_video_request || !vid_play_request) break;
 				vid_duration = network_decoder.get_duration();
 				
+				// the forward buffer is filled : prepare for autoplay
+				if (!next_video_prefetch_requested && !playing_video_info.is_livestream && stream_downloader.is_idle() && !network_is_playback_margin_low()) {
+					next_video_prefetch_requested = true;
+					queue_async_task(prefetch_next_video, NULL);
+				}
+				
 				auto type = network_decoder.next_decode_type();
 				
 				if (type == NetworkMultipleDecoder::PacketType::EoF) {
@@ -3,6 +3,7 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <dirent.h>
+#include <unistd.h>
 
 Result_with_string Path::write_file(const u8 *data, u32 size) {
 	Result_with_string res;
@@ -29,6 +30,25 @@ Result_with_string Path::write_file(const u8 *data, u32 size) {
 	if (res.string != "") res.code = errno;
 	return res;
 }
+Result_with_string Path::append_file(const u8 *data, u32 size) {
+	Result_with_string res;
+	res.string = [&] () -> std::string {
+		errno = 0;
+		FILE *fp = fopen(path.c_str(), "ab");
+		if (!fp) {
+			// the directory may not exist yet
+			if (!is_file()) return write_file(data, size).string;
+			return "fopen() failed";
+		}
+		errno = 0;
+		u32 written = fwrite(data, 1, size, fp);
+		fclose(fp);
+		if (written < size) return "fwrite() failed(" + std::to_string(written) + " < " + std::to_string(size) + ")";
+		return "";
+	}();
+	if (res.string != "") res.code = errno;
+	return res;
+}
 Result_with_string Path::read_file(u8 *data, u32 size, u32 &size_read, u64 offset) {
 	Result_with_string res;
 	res.string = [&] () {
@@ -51,6 +71,21 @@ Result_with_string Path::read_file(u8 *data, u32 size, u32 &size_read, u64 offse
 	if (res.string != "") res.code = errno;
 	return res;
 }
+Result_with_string Path::truncate_file(u64 size) {
+	Result_with_string res;
+	res.string = [&] () {
+		errno = 0;
+		FILE *fp = fopen(path.c_str(), "r+b");
+		if (!fp) return "fopen() failed";
+		errno = 0;
+		int ftruncate_res = ftruncate(fileno(fp), size);
+		fclose(fp);
+		if (ftruncate_res != 0) return "ftruncate() failed";
+		return "";
+	}();
+	if (res.string != "") res.code = errno;
+	return res;
+}
 Result_with_string Path::delete_file() {
 	Result_with_string res;
 	errno = 0;
@@ -8,6 +8,7 @@ struct Path {
 	Path () = default;
 	Path (const std::string &path) : path(path) {}
 	Result_with_string write_file(const u8 *data, u32 size);
+	Result_with_string append_file(const u8 *data, u32 size); // creates the file if it does not exist
 	Result_with_string read_file(u8 *data, u32 size, u32 &size_read, u64 offset = 0);
 	template<typename T> Result_with_string read_entire_file(T &resulting_data) {
 		u64 size;
@@ -17,6 +18,7 @@ struct Path {
 		u32 size_read;
 		return read_file((u8 *) &resulting_data[0], size, size_read, 0);
 	}
+	Result_with_string truncate_file(u64 size); // drops the data after `size` bytes
 	Result_with_string delete_file();
 	Result_with_string rename_to(const std::string &new_path);
 	Result_with_string get_size(u64 &res);
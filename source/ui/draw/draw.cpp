@@ -1,5 +1,6 @@
 #include "headers.hpp"
 #include "ui/colors.hpp"
+#include "network_decoder/network_io.hpp"
 
 namespace Draw_ {
 	double draw_frametime[20] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, };
@@ -539,6 +540,28 @@ void Draw_debug_info(void)
 	Draw("Frametime: " + std::to_string(draw_frametime[19]).substr(0, 6) + "ms", 0.0, 190.0, 0.4, 0.4, color);
 	Draw("RAM: " + std::to_string(var_free_ram / 1000.0).substr(0, 5) + " MB", 0.0, 200.0, 0.4, 0.4, color);
 	Draw("linear RAM: " + std::to_string(var_free_linear_ram / 1000.0 / 1000.0).substr(0, 5) +" MB", 0.0, 210.0, 0.4, 0.4, color);
+	
+	// request timings of the most used endpoints (select + L to dump all of them to the SD card)
+	auto timings = network_get_endpoint_timings();
+	int endpoint_num = std::min<int>(timings.size(), 4);
+	auto schedule = network_get_schedule_stats();
+	int line_num = 2 + endpoint_num * 3; // the two header lines, then three lines per endpoint, 10px each
+	Draw_texture(var_square_image[0], DEF_DRAW_WEAK_BLUE, 190.0, 20.0, 210.0, line_num * 10.0);
+	Draw("network (median/p90 ms, select+L : dump)", 190.0, 20.0, 0.4, 0.4, color);
+	Draw("active " + std::to_string(schedule.active_num[0]) + "/" + std::to_string(schedule.active_num[1]) + "/" + std::to_string(schedule.active_num[2]) + "/" +
+		std::to_string(schedule.active_num[3]) + " deferred " + std::to_string(schedule.deferred_num) + " preempted " + std::to_string(schedule.preemption_num) +
+		(network_is_playback_margin_low() ? " (margin low)" : ""), 190.0, 30.0, 0.4, 0.4, color);
+	for (int i = 0; i < endpoint_num; i++) {
+		const auto &cur = timings[i];
+		std::string endpoint = cur.endpoint.size() > 45 ? ".." + cur.endpoint.substr(cur.endpoint.size() - 43) : cur.endpoint;
+		std::string histogram;
+		for (int j = 0; j < NETWORK_TIMING_BUCKET_NUM; j++) histogram += std::to_string(cur.histogram[j]) + (j + 1 < NETWORK_TIMING_BUCKET_NUM ? "/" : "");
+		Draw(endpoint, 190.0, 40.0 + i * 30.0, 0.4, 0.4, color);
+		Draw(std::to_string(cur.request_num) + " reqs (" + std::to_string(cur.reused_num) + " reused) " + std::to_string(cur.bytes_received / 1000) + " KB ttfb " +
+			std::to_string((int) (cur.ttfb_median * 1000)), 190.0, 50.0 + i * 30.0, 0.4, 0.4, color);
+		Draw("total " + std::to_string((int) (cur.total_median * 1000)) + "/" + std::to_string((int) (cur.total_p90 * 1000)) + " hist " + histogram,
+			190.0, 60.0 + i * 30.0, 0.4, 0.4, color);
+	}
 }
 
 Result_with_string Draw_load_kanji_samples(void)
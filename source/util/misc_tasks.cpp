@@ -3,6 +3,9 @@
 #include "data_io/history.hpp"
 #include "data_io/subscription_util.hpp"
 #include "data_io/string_resource.hpp"
+#include "data_io/thumbnail_cache.hpp"
+#include "data_io/stream_cache.hpp"
+#include "network_decoder/network_io.hpp"
 #include "system/change_setting.hpp"
 #include "headers.hpp"
 
@@ -30,6 +33,21 @@ void misc_tasks_thread_func(void *arg) {
 		} else if (request[TASK_SAVE_SUBSCRIPTION]) {
 			request[TASK_SAVE_SUBSCRIPTION] = false;
 			save_subscription();
+		} else if (request[TASK_FLUSH_THUMBNAIL_CACHE]) {
+			request[TASK_FLUSH_THUMBNAIL_CACHE] = false;
+			thumbnail_disk_cache_flush();
+		} else if (request[TASK_SAVE_DNS_CACHE]) {
+			request[TASK_SAVE_DNS_CACHE] = false;
+			network_dns_cache_save();
+		} else if (request[TASK_DUMP_NETWORK_LOG]) {
+			request[TASK_DUMP_NETWORK_LOG] = false;
+			network_dump_timings_csv();
+		} else if (request[TASK_LOAD_STREAM_CACHE]) {
+			request[TASK_LOAD_STREAM_CACHE] = false;
+			stream_disk_cache_load();
+		} else if (request[TASK_FLUSH_STREAM_CACHE]) {
+			request[TASK_FLUSH_STREAM_CACHE] = false;
+			stream_disk_cache_flush();
 		} else usleep(50000);
 	}
 	
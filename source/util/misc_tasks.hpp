@@ -5,6 +5,11 @@
 #define TASK_RELOAD_STRING_RESOURCE 2
 #define TASK_SAVE_HISTORY 3
 #define TASK_SAVE_SUBSCRIPTION 4
+#define TASK_FLUSH_THUMBNAIL_CACHE 5
+#define TASK_SAVE_DNS_CACHE 6
+#define TASK_DUMP_NETWORK_LOG 7
+#define TASK_FLUSH_STREAM_CACHE 8
+#define TASK_LOAD_STREAM_CACHE 9
 
 void misc_tasks_request(int type);
 void misc_tasks_thread_func(void *);
@@ -17,6 +17,7 @@ bool var_full_dislike_like_count = false;
 bool var_video_show_debug_info = false;
 bool var_video_linear_filter = true;
 double var_forward_buffer_ratio = 0.8;
+bool var_stream_disk_cache = false;
 u8 var_wifi_state = 0;
 u8 var_wifi_signal = 0;
 u8 var_battery_charge = 0;
@@ -17,6 +17,7 @@ extern bool var_full_screen_mode;
 extern bool var_video_show_debug_info;
 extern bool var_video_linear_filter;
 extern double var_forward_buffer_ratio;
+extern bool var_stream_disk_cache;
 extern u8 var_wifi_state;
 extern u8 var_wifi_signal;
 extern u8 var_battery_charge;
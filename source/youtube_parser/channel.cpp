@@ -1,16 +1,11 @@
-#include <regex>
+#include <algorithm>
 #include "internal_common.hpp"
 #include "parser.hpp"
 
 
-static RJson get_initial_data(Document &json_root, const std::string &html) {
-	RJson res;
-	if (fast_extract_initial(json_root, html, "ytInitialData", res)) return res;
-	res = get_succeeding_json_regexes(json_root, html, {
-		"window\\[['\\\"]ytInitialData['\\\"]]\\s*=\\s*['\\{]",
-		"ytInitialData\\s*=\\s*['\\{]"
-	});
-	if (!res.is_valid()) return get_error_json("did not match any of the ytInitialData regexes");
+static RJson get_initial_data(Document &json_root, std::string &html) {
+	RJson res = extract_initial_json(json_root, html, "ytInitialData");
+	if (!res.is_valid()) return get_error_json("ytInitialData not found");
 	return res;
 }
 
@@ -27,9 +22,9 @@ static void parse_channel_data(RJson data, YouTubeChannelDetail &res) {
 		auto model = data["header"]["pageHeaderRenderer"]["content"]["pageHeaderViewModel"];
 		res.banner_url = get_thumbnail_url_exact(model["banner"]["imageBannerViewModel"]["image"]["sources"], 320);
 		res.icon_url = get_thumbnail_url_closest(model["image"]["decoratedAvatarViewModel"]["avatar"]["avatarViewModel"]["image"]["sources"], 88);
-		auto tmp = model["metadata"]["contentMetadataViewModel"]["metadataRows"].array_items();
+		auto tmp = model["metadata"]["contentMetadataViewModel"]["metadataRows"].array_range();
 		if (tmp.size()) {
-			tmp = tmp[0]["metadataParts"].array_items();
+			tmp = tmp[0]["metadataParts"].array_range();
 			if (tmp.size() >= 2) res.subscriber_count_str = tmp[1]["text"]["content"].string_value();
 		}
 	}
@@ -37,8 +32,8 @@ static void parse_channel_data(RJson data, YouTubeChannelDetail &res) {
 	res.url = "https://m.youtube.com/channel/" + metadata_renderer["externalId"].string_value();
 	res.description = metadata_renderer["description"].string_value();
 	
-	for (auto tab : data["contents"]["singleColumnBrowseResultsRenderer"]["tabs"].array_items()) {
-		for (auto i : tab["tabRenderer"]["content"]["richGridRenderer"]["contents"].array_items()) {
+	for (auto tab : data["contents"]["singleColumnBrowseResultsRenderer"]["tabs"].array_range()) {
+		for (auto i : tab["tabRenderer"]["content"]["richGridRenderer"]["contents"].array_range()) {
 			if (i.has_key("continuationItemRenderer")) 
 				res.continue_token = i["continuationItemRenderer"]["continuationEndpoint"]["continuationCommand"]["token"].string_value();
 			else if (i["richItemRenderer"]["content"].has_key("compactVideoRenderer")) 
@@ -85,7 +80,7 @@ YouTubeChannelDetail youtube_load_channel_page(std::string url_or_id) {
 		auto result = http_get(url);
 		if (!result.first) debug_error((res.error = "[ch-id] " + result.second));
 		else {
-			auto html = result.second;
+			std::string &html = result.second; // parsed in place
 			if (!html.size()) {
 				res.error = "[ch-id] html empty";
 				return res;
@@ -97,10 +92,8 @@ YouTubeChannelDetail youtube_load_channel_page(std::string url_or_id) {
 		std::string &id = url_or_id;
 		res.url_original = "https://m.youtube.com/channel/" + id;
 		
-		std::string post_content = R"({"context": {"client": {"hl": "%0", "gl": "%1", "clientName": "MWEB", "clientVersion": "2.20240304.08.00"}}, "browseId": "%2", "params":"EgZ2aWRlb3PyBgQKAjoA"})";
-		post_content = std::regex_replace(post_content, std::regex("%0"), language_code);
-		post_content = std::regex_replace(post_content, std::regex("%1"), country_code);
-		post_content = std::regex_replace(post_content, std::regex("%2"), id);
+		static const RequestTemplate post_template(R"({"context": {"client": {"hl": "%0", "gl": "%1", "clientName": "MWEB", "clientVersion": "2.20240304.08.00"}}, "browseId": "%2", "params":"EgZ2aWRlb3PyBgQKAjoA"})");
+		std::string post_content = post_template.render({language_code, country_code, id});
 		
 		access_and_parse_json(
 			[&] () { return http_post_json(get_innertube_api_url("browse"), post_content); },
@@ -116,42 +109,28 @@ YouTubeChannelDetail youtube_load_channel_page(std::string url_or_id) {
 std::vector<YouTubeChannelDetail> youtube_load_channel_page_multi(std::vector<std::string> ids, std::function<void (int, int)> progress) {
 	std::vector<YouTubeChannelDetail> res;
 	if (progress) progress(0, ids.size());
-#ifdef _WIN32
-	int finished = 0;
-	for (auto id : ids) {
-		res.push_back(youtube_load_channel_page(id));
-		if (progress) progress(++finished, ids.size());
-	}
-#else
-	
-	std::vector<HttpRequest> requests;
+	std::vector<std::pair<std::string, std::string> > url_json_list;
 	int n = ids.size();
 	int finished = 0;
-	for (int i = 0; i < n; i++) {
-		std::string post_content = R"({"context": {"client": {"hl": "%0", "gl": "%1", "clientName": "MWEB", "clientVersion": "2.20210711.08.00"}}, "browseId": "%2", "params":"EgZ2aWRlb3PyBgQKAjoA"})";
-		post_content = std::regex_replace(post_content, std::regex("%0"), language_code);
-		post_content = std::regex_replace(post_content, std::regex("%1"), country_code);
-		post_content = std::regex_replace(post_content, std::regex("%2"), ids[i]);
-		requests.push_back(http_post_json_request(get_innertube_api_url("browse"), post_content).with_on_finish_callback([&] (NetworkResult &, int cur) {
-			if (progress) progress(++finished, n);
-		}));
-	}
-	debug_info("access(multi)...");
-	auto results = thread_network_session_list.perform(requests);
-	debug_info("ok");
-	for (auto result : results) {
-		result.data.push_back('\0');
+	static const RequestTemplate post_template(R"({"context": {"client": {"hl": "%0", "gl": "%1", "clientName": "MWEB", "clientVersion": "2.20210711.08.00"}}, "browseId": "%2", "params":"EgZ2aWRlb3PyBgQKAjoA"})");
+	for (int i = 0; i < n; i++) url_json_list.push_back({get_innertube_api_url("browse"), post_template.render({language_code, country_code, ids[i]})});
+	auto results = http_post_json_multi(url_json_list, [&] () { if (progress) progress(++finished, n); });
+	for (auto &result : results) {
 		YouTubeChannelDetail cur_res;
-		parse_json_destructive((char *) &result.data[0],
-			[&] (Document &, RJson data) { parse_channel_data(data, cur_res); },
-			[&] (const std::string &error) {
-				cur_res.error = "[ch-mul] " + error;
-				debug_error(cur_res.error);
-			}
-		);
+		if (result.first) {
+			parse_json_destructive(&result.second[0],
+				[&] (Document &, RJson data) { parse_channel_data(data, cur_res); },
+				[&] (const std::string &error) {
+					cur_res.error = "[ch-mul] " + error;
+					debug_error(cur_res.error);
+				}
+			);
+		} else {
+			cur_res.error = "[ch-mul] " + result.second;
+			debug_error(cur_res.error);
+		}
 		res.push_back(cur_res);
 	}
-#endif
 	return res;
 }
 
@@ -162,18 +141,15 @@ void YouTubeChannelDetail::load_more_videos() {
 		return;
 	}
 	
-	std::string post_content = R"({"context": {"client": {"hl": "%0", "gl": "%1", "clientName": "MWEB", "clientVersion": "2.20210711.08.00", "utcOffsetMinutes": 0}, "request": {}, "user": {}}, "continuation": ")"
-		+ continue_token + "\"}";
-	post_content = std::regex_replace(post_content, std::regex("%0"), language_code);
-	post_content = std::regex_replace(post_content, std::regex("%1"), country_code);
+	std::string post_content = continuation_template.render({language_code, country_code, continue_token});
 	
 	access_and_parse_json(
 		[&] () { return http_post_json(get_innertube_api_url("browse"), post_content); },
 		[&] (Document &, RJson yt_result) {
 			continue_token = "";
 			
-			for (auto i : yt_result["onResponseReceivedActions"].array_items()) {
-				for (auto j : i["appendContinuationItemsAction"]["continuationItems"].array_items()) {
+			for (auto i : yt_result["onResponseReceivedActions"].array_range()) {
+				for (auto j : i["appendContinuationItemsAction"]["continuationItems"].array_range()) {
 					if (j["richItemRenderer"]["content"].has_key("videoWithContextRenderer")) 
 						videos.push_back(parse_succinct_video(j["richItemRenderer"]["content"]["videoWithContextRenderer"]));
 					else if (j.has_key("compactVideoRenderer"))
@@ -195,7 +171,7 @@ static void channel_load_playlists_(RJson yt_result, YouTubeChannelDetail &new_r
 		YouTubePlaylistSuccinct cur_list;
 		cur_list.title = get_text_from_object(playlist_renderer["title"]);
 		cur_list.video_count_str = get_text_from_object(playlist_renderer["videoCountText"]);
-		for (auto thumbnail : playlist_renderer["thumbnail"]["thumbnails"].array_items())
+		for (auto thumbnail : playlist_renderer["thumbnail"]["thumbnails"].array_range())
 			if (std::string(thumbnail["url"].string_value()).find("/default.jpg") != std::string::npos) cur_list.thumbnail_url = thumbnail["url"].string_value();
 		
 		cur_list.url = convert_url_to_mobile(playlist_renderer["shareUrl"].string_value());
@@ -213,21 +189,21 @@ static void channel_load_playlists_(RJson yt_result, YouTubeChannelDetail &new_r
 		return cur_list;
 	};
 	
-	for (auto tab : yt_result["contents"]["singleColumnBrowseResultsRenderer"]["tabs"].array_items()) {
-		for (auto i : tab["tabRenderer"]["content"]["sectionListRenderer"]["contents"].array_items()) {
+	for (auto tab : yt_result["contents"]["singleColumnBrowseResultsRenderer"]["tabs"].array_range()) {
+		for (auto i : tab["tabRenderer"]["content"]["sectionListRenderer"]["contents"].array_range()) {
 			if (i.has_key("shelfRenderer")) {
 				std::string category_name = get_text_from_object(i["shelfRenderer"]["title"]);
 				std::vector<YouTubePlaylistSuccinct> playlists;
-				for (auto j : i["shelfRenderer"]["content"]["verticalListRenderer"]["items"].array_items())
+				for (auto j : i["shelfRenderer"]["content"]["verticalListRenderer"]["items"].array_range())
 					if (j.has_key("compactPlaylistRenderer")) playlists.push_back(convert_compact_playlist_renderer(j["compactPlaylistRenderer"]));
 				if (playlists.size()) new_result.playlists.push_back({category_name, playlists});
 			}
 			if (i.has_key("itemSectionRenderer")) {
 				std::string category_name;
-				for (auto j : tab["tabRenderer"]["content"]["sectionListRenderer"]["subMenu"]["channelSubMenuRenderer"]["contentTypeSubMenuItems"].array_items())
+				for (auto j : tab["tabRenderer"]["content"]["sectionListRenderer"]["subMenu"]["channelSubMenuRenderer"]["contentTypeSubMenuItems"].array_range())
 					category_name += j["title"].string_value();
 				std::vector<YouTubePlaylistSuccinct> playlists;
-				for (auto j : i["itemSectionRenderer"]["contents"].array_items())
+				for (auto j : i["itemSectionRenderer"]["contents"].array_range())
 					if (j.has_key("compactPlaylistRenderer")) playlists.push_back(convert_compact_playlist_renderer(j["compactPlaylistRenderer"]));
 				// If the channel has no playlists, there's an itemSectionRenderer with only a messageRenderer in i["itemSectionRenderer"]["contents"]
 				if (playlists.size()) new_result.playlists.push_back({category_name, playlists});
@@ -243,11 +219,8 @@ void YouTubeChannelDetail::load_playlists() {
 	
 	if (error != "") return;
 	
-	std::string post_content = R"({"context": {"client": {"hl": "%0", "gl": "%1", "clientName": "MWEB", "clientVersion": "2.20210711.08.00", "utcOffsetMinutes": 0}}, "browseId": "%2", "params": "%3"})";
-	post_content = std::regex_replace(post_content, std::regex("%0"), language_code);
-	post_content = std::regex_replace(post_content, std::regex("%1"), country_code);
-	post_content = std::regex_replace(post_content, std::regex("%2"), playlist_tab_browse_id);
-	post_content = std::regex_replace(post_content, std::regex("%3"), playlist_tab_params);
+	static const RequestTemplate post_template(R"({"context": {"client": {"hl": "%0", "gl": "%1", "clientName": "MWEB", "clientVersion": "2.20210711.08.00", "utcOffsetMinutes": 0}}, "browseId": "%2", "params": "%3"})");
+	std::string post_content = post_template.render({language_code, country_code, playlist_tab_browse_id, playlist_tab_params});
 	
 	access_and_parse_json(
 		[&] () { return http_post_json(get_innertube_api_url("browse"), post_content); },
@@ -258,7 +231,7 @@ void YouTubeChannelDetail::load_playlists() {
 
 static void load_community_items(RJson contents, YouTubeChannelDetail &res) {
 	res.community_continuation_token = "";
-	for (auto post : contents.array_items()) {
+	for (auto post : contents.array_range()) {
 		if (post.has_key("backstagePostThreadRenderer")) {
 			auto post_renderer = post["backstagePostThreadRenderer"]["post"]["backstagePostRenderer"];
 			YouTubeChannelDetail::CommunityPost cur_post;
@@ -268,7 +241,7 @@ static void load_community_items(RJson contents, YouTubeChannelDetail &res) {
 			cur_post.time = get_text_from_object(post_renderer["publishedTimeText"]);
 			cur_post.upvotes_str = get_text_from_object(post_renderer["voteCount"]);
 			if (post_renderer["backstageAttachment"]["backstageImageRenderer"].is_valid()) {
-				auto tmp = post_renderer["backstageAttachment"]["backstageImageRenderer"]["image"]["thumbnails"].array_items();
+				auto tmp = post_renderer["backstageAttachment"]["backstageImageRenderer"]["image"]["thumbnails"].array_range();
 				if (tmp.size()) cur_post.image_url = tmp[0]["url"].string_value();
 			}
 			if (post_renderer["backstageAttachment"]["videoRenderer"].is_valid()) 
@@ -276,7 +249,7 @@ static void load_community_items(RJson contents, YouTubeChannelDetail &res) {
 			if (post_renderer["backstageAttachment"]["pollRenderer"].is_valid()) {
 				auto poll_renderer = post_renderer["backstageAttachment"]["pollRenderer"];
 				cur_post.poll_total_votes = get_text_from_object(poll_renderer["totalVotes"]);
-				for (auto choice : poll_renderer["choices"].array_items())
+				for (auto choice : poll_renderer["choices"].array_range())
 					cur_post.poll_choices.push_back(get_text_from_object(choice["text"]));
 			}
 			res.community_posts.push_back(cur_post);
@@ -299,7 +272,7 @@ void YouTubeChannelDetail::load_more_community_posts() {
 		auto result = http_get(url, {{"User-Agent", "Mozilla/5.0 (Windows NT 10.0; Win64; x64; rv:94.0) Gecko/20100101 Firefox/94.0"}});
 		if (!result.first) debug_error((this->error = "[ch/c+] " + result.second));
 		else {
-			auto html = result.second;
+			std::string &html = result.second; // parsed in place
 			if (!html.size()) {
 				error = "failed to download community page";
 				return;
@@ -308,22 +281,20 @@ void YouTubeChannelDetail::load_more_community_posts() {
 			RJson initial_data = get_initial_data(json_root, html);
 			
 			RJson contents;
-			for (auto tab : initial_data["contents"]["twoColumnBrowseResultsRenderer"]["tabs"].array_items())
-				for (auto i : tab["tabRenderer"]["content"]["sectionListRenderer"]["contents"].array_items())
+			for (auto tab : initial_data["contents"]["twoColumnBrowseResultsRenderer"]["tabs"].array_range())
+				for (auto i : tab["tabRenderer"]["content"]["sectionListRenderer"]["contents"].array_range())
 					contents = i["itemSectionRenderer"]["contents"];
 			load_community_items(contents, *this);
 		}
 	} else {
-		std::string post_content = R"({"context": {"client": {"hl": "%0", "gl": "%1", "clientName": "WEB", "clientVersion": "2.20210711.08.00", "utcOffsetMinutes": 0}}, "continuation": "%2"})";
-		post_content = std::regex_replace(post_content, std::regex("%0"), language_code);
-		post_content = std::regex_replace(post_content, std::regex("%1"), country_code);
-		post_content = std::regex_replace(post_content, std::regex("%2"), community_continuation_token);
+		static const RequestTemplate post_template(R"({"context": {"client": {"hl": "%0", "gl": "%1", "clientName": "WEB", "clientVersion": "2.20210711.08.00", "utcOffsetMinutes": 0}}, "continuation": "%2"})");
+		std::string post_content = post_template.render({language_code, country_code, community_continuation_token});
 		
 		access_and_parse_json(
 			[&] () { return http_post_json(get_innertube_api_url("browse"), post_content); },
 			[&] (Document &, RJson yt_result) {
 				RJson contents;
-				for (auto i : yt_result["onResponseReceivedEndpoints"].array_items()) if (i.has_key("appendContinuationItemsAction"))
+				for (auto i : yt_result["onResponseReceivedEndpoints"].array_range()) if (i.has_key("appendContinuationItemsAction"))
 					contents = i["appendContinuationItemsAction"]["continuationItems"];
 				load_community_items(contents, *this);
 			},
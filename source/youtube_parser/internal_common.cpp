@@ -1,4 +1,3 @@
-#include <regex>
 #include "internal_common.hpp"
 
 void youtube_change_content_language(std::string language_code) {
@@ -6,12 +5,21 @@ void youtube_change_content_language(std::string language_code) {
 	youtube_parser::country_code = language_code == "en" ? "US" : "JP";
 }
 
+static YouTubeTransport transport;
+void youtube_set_transport(YouTubeTransport new_transport) {
+	transport = new_transport;
+}
+static bool prefetch_mode = false;
+void youtube_set_prefetch_mode(bool prefetch) {
+	prefetch_mode = prefetch;
+}
+
 namespace youtube_parser {
 	std::string language_code = "en";
 	std::string country_code = "US";
 	
-#ifdef _WIN32
-	std::pair<bool, std::string> http_get(const std::string &url, std::map<std::string, std::string> headers) {
+#ifdef YOUTUBE_PARSER_HOST
+	static std::pair<bool, std::string> http_get_default(const std::string &url, std::map<std::string, std::string> headers) {
 		static int cnt = 0;
 		static const std::string user_agent = "com.google.ios.youtube/19.29.1 (iPhone16,2; U; CPU iOS 17_5_1 like Mac OS X;)";
 		if (!headers.count("User-Agent")) headers["User-Agent"] = user_agent;
@@ -33,7 +41,7 @@ namespace youtube_parser {
 		sstream << file.rdbuf();
 		return {true, sstream.str()};
 	}
-	std::pair<bool, std::string> http_post_json(const std::string &url, const std::string &json, std::map<std::string, std::string> headers) {
+	static std::pair<bool, std::string> http_post_json_default(const std::string &url, const std::string &json, std::map<std::string, std::string> headers) {
 		{
 			std::ofstream file("post_tmp.txt");
 			file << json;
@@ -61,17 +69,22 @@ namespace youtube_parser {
 	HttpRequest http_get_request(const std::string &url, std::map<std::string, std::string> headers) {
 		confirm_thread_network_session_list_inited();
 		if (!headers.count("Accept-Language")) headers["Accept-Language"] = language_code + ";q=0.9";
-		return HttpRequest::GET(url, headers);
+		return HttpRequest::GET(url, headers).with_priority(prefetch_mode ? NetworkPriority::PREFETCH : NetworkPriority::INTERACTIVE);
 	}
-	std::pair<bool, std::string> http_get(const std::string &url, std::map<std::string, std::string> headers) {
+	static std::pair<bool, std::string> http_get_default(const std::string &url, std::map<std::string, std::string> headers) {
 		debug_info("accessing...");
-		auto result = thread_network_session_list.perform(http_get_request(url, headers));
+		std::string body; // received directly instead of being copied from NetworkResult::data afterwards
+		auto result = thread_network_session_list.perform(http_get_request(url, headers).with_dedup().with_data_sink([&] (const u8 *data, size_t size) {
+			body.append((const char *) data, size);
+			return true;
+		}));
 		if (result.fail) {
 			debug_error("fail : " + result.error);
 			return {false, result.error};
 		} else {
 			debug_info("ok");
-			return {true, std::string(result.data.begin(), result.data.end())};
+			if (!result.status_code_is_success()) body = std::string(result.data.begin(), result.data.end()); // error bodies are not passed to the sink
+			return {true, std::move(body)};
 		}
 	}
 
@@ -92,24 +105,128 @@ namespace youtube_parser {
 		logger.info("curl", headersLog);
 
 		logger.error("net/dl", "failed to acquire x-head-seqnum");
-		return HttpRequest::POST(url, headers, json);
+		return HttpRequest::POST(url, headers, json).with_priority(prefetch_mode ? NetworkPriority::PREFETCH : NetworkPriority::INTERACTIVE);
 
 		logger.info("http_post_json_request url", url);
 		logger.info("http_post_json_request json", json);
 	}
 
-	std::pair<bool, std::string> http_post_json(const std::string &url, const std::string &json, std::map<std::string, std::string> headers) {
+	static std::pair<bool, std::string> http_post_json_default(const std::string &url, const std::string &json, std::map<std::string, std::string> headers) {
 		debug_info("accessing(POST)...");
-		auto result = thread_network_session_list.perform(http_post_json_request(url, json, headers));
+		std::string body; // received directly instead of being copied from NetworkResult::data afterwards
+		auto result = thread_network_session_list.perform(http_post_json_request(url, json, headers).with_dedup().with_data_sink([&] (const u8 *data, size_t size) {
+			body.append((const char *) data, size);
+			return true;
+		}));
 		if (result.fail) {
 			debug_error("fail : " + result.error);
 			return {false, result.error};
 		} else {
 			debug_info("ok");
-			return {true, std::string(result.data.begin(), result.data.end())};
+			if (!result.status_code_is_success()) body = std::string(result.data.begin(), result.data.end()); // error bodies are not passed to the sink
+			return {true, std::move(body)};
 		}
 	}
+	static std::vector<std::pair<bool, std::string> > http_post_json_multi_default(const std::vector<std::pair<std::string, std::string> > &url_json_list,
+		std::function<void ()> on_each_finish) {
+		
+		std::vector<std::pair<bool, std::string> > res(url_json_list.size());
+		std::vector<HttpRequest> requests;
+		for (size_t i = 0; i < url_json_list.size(); i++) {
+			requests.push_back(http_post_json_request(url_json_list[i].first, url_json_list[i].second).with_dedup().with_data_sink([&res, i] (const u8 *data, size_t size) {
+				res[i].second.append((const char *) data, size);
+				return true;
+			}).with_on_finish_callback([&] (NetworkResult &result, int index) {
+				if (result.fail) res[index] = {false, result.error};
+				else if (!result.status_code_is_success()) res[index] = {true, std::string(result.data.begin(), result.data.end())};
+				else res[index].first = true;
+				if (on_each_finish) on_each_finish();
+			}));
+		}
+		debug_info("accessing(multi)...");
+		auto results = thread_network_session_list.perform(requests);
+		for (size_t i = 0; i < results.size(); i++) if (results[i].fail) res[i] = {false, results[i].error}; // e.g. the app is exiting
+		debug_info("ok");
+		return res;
+	}
 #endif
+	std::pair<bool, std::string> http_get(const std::string &url, std::map<std::string, std::string> headers) {
+		if (transport) return transport("GET", url, headers, "");
+		return http_get_default(url, headers);
+	}
+	std::pair<bool, std::string> http_post_json(const std::string &url, const std::string &json, std::map<std::string, std::string> headers) {
+		if (transport) {
+			headers["Content-Type"] = "application/json";
+			return transport("POST", url, headers, json);
+		}
+		return http_post_json_default(url, json, headers);
+	}
+	std::vector<std::pair<bool, std::string> > http_post_json_multi(const std::vector<std::pair<std::string, std::string> > &url_json_list,
+		std::function<void ()> on_each_finish) {
+		
+#	ifndef YOUTUBE_PARSER_HOST
+		if (!transport) return http_post_json_multi_default(url_json_list, on_each_finish);
+#	endif
+		std::vector<std::pair<bool, std::string> > res;
+		for (auto &url_json : url_json_list) {
+			res.push_back(http_post_json(url_json.first, url_json.second));
+			if (on_each_finish) on_each_finish();
+		}
+		return res;
+	}
+	
+	const RequestTemplate continuation_template(R"({"context": {"client": {"hl": "%0", "gl": "%1", "clientName": "MWEB", "clientVersion": "2.20210711.08.00", "utcOffsetMinutes": 0}, "request": {}, "user": {}}, "continuation": "%2"})");
+	
+	RequestTemplate::RequestTemplate (const char *str) : source(str) {
+		size_t literal_begin = 0;
+		for (size_t i = 0; i < source.size(); i++) {
+			if (source[i] == '%' && i + 1 < source.size() && isdigit(source[i + 1])) {
+				if (i > literal_begin) segments.push_back({literal_begin, i - literal_begin, -1});
+				segments.push_back({0, 0, source[i + 1] - '0'});
+				literal_size += i - literal_begin;
+				literal_begin = i + 2;
+				i++;
+			}
+		}
+		if (source.size() > literal_begin) segments.push_back({literal_begin, source.size() - literal_begin, -1});
+		literal_size += source.size() - literal_begin;
+	}
+	void RequestTemplate::render(std::string &out, std::initializer_list<Value> values) const {
+		size_t size = literal_size;
+		for (auto &value : values) size += value.str->size();
+		out.clear();
+		out.reserve(size + 16); // a little room for escaping
+		for (auto &segment : segments) {
+			if (segment.slot == -1) out.append(source, segment.begin, segment.len);
+			else if ((size_t) segment.slot < values.size()) {
+				const Value &value = values.begin()[segment.slot];
+				if (value.raw) out += *value.str;
+				else append_json_escaped(out, *value.str);
+			}
+		}
+	}
+	std::string RequestTemplate::render(std::initializer_list<Value> values) const {
+		std::string res;
+		render(res, values);
+		return res;
+	}
+	void append_json_escaped(std::string &out, const std::string &str) {
+		for (char c : str) {
+			switch (c) {
+				case '"' : out += "\\\""; break;
+				case '\\' : out += "\\\\"; break;
+				case '\n' : out += "\\n"; break;
+				case '\r' : out += "\\r"; break;
+				case '\t' : out += "\\t"; break;
+				default :
+					if ((unsigned char) c < 0x20) {
+						char buf[7];
+						snprintf(buf, sizeof(buf), "\\u%04x", (unsigned char) c);
+						out += buf;
+					} else out.push_back(c);
+			}
+		}
+	}
 	
 	bool starts_with(const std::string &str, const std::string &pattern, size_t offset) {
 		return str.substr(offset, pattern.size()) == pattern;
@@ -156,7 +273,7 @@ namespace youtube_parser {
 		if (json["simpleText"].is_valid()) return json["simpleText"].string_value();
 		if (json["runs"].is_valid()) {
 			std::string res;
-			for (auto i : json["runs"].array_items()) res += i["text"].string_value();
+			for (auto i : json["runs"].array_range()) res += i["text"].string_value();
 			return res;
 		}
 		return "";
@@ -180,7 +297,7 @@ namespace youtube_parser {
 	std::string get_thumbnail_url_closest(RJson thumbnails, int target_width) {
 		int min_distance = 100000;
 		std::string best_icon_url;
-		for (auto thumbnail : thumbnails.array_items()) {
+		for (auto thumbnail : thumbnails.array_range()) {
 			int cur_width = thumbnail["width"].int_value();
 			if (min_distance > std::abs(target_width - cur_width)) {
 				min_distance = std::abs(target_width - cur_width);
@@ -191,8 +308,8 @@ namespace youtube_parser {
 		return best_icon_url;
 	}
 	std::string get_thumbnail_url_exact(RJson thumbnails, int target_width) {
-		if (!thumbnails.array_items().size()) return "";
-		auto thumbnail = thumbnails.array_items()[0];
+		if (!thumbnails.array_range().size()) return "";
+		auto thumbnail = thumbnails.array_range()[0];
 		std::string icon_url = thumbnail["url"].string_value();
 		std::string icon_url_modified;
 		std::string replace_from = std::to_string(thumbnail["width"].int_value()) + "-";
@@ -208,111 +325,127 @@ namespace youtube_parser {
 		return icon_url_modified;
 	}
 
-	std::string remove_garbage(const std::string &str, size_t start) {
-		while (start < str.size() && str[start] == ' ') start++;
-		if (start >= str.size()) {
-			debug_warning("remove_garbage : empty");
-			return "";
+#define JSON_ARENA_SIZE_INIT (64 * 1024)
+#define JSON_ARENA_SIZE_MAX (1024 * 1024)
+#define JSON_ARENA_CHUNK_SIZE (64 * 1024)
+	static CrtAllocator json_arena_base_allocator; // for the chunks beyond the arena buffer, freed after each parse
+	static u8 *json_arena_buffer = NULL;
+	static size_t json_arena_size = 0;
+	static MemoryPoolAllocator<> *json_arena = NULL; // placed over json_arena_buffer
+	static bool json_arena_in_use = false;
+	static void json_arena_resize(size_t size) {
+		delete json_arena;
+		json_arena = NULL;
+		free(json_arena_buffer);
+		json_arena_buffer = (u8 *) malloc(size);
+		json_arena_size = json_arena_buffer ? size : 0;
+		if (json_arena_buffer) json_arena = new MemoryPoolAllocator<>(json_arena_buffer, size, JSON_ARENA_CHUNK_SIZE, &json_arena_base_allocator);
+	}
+	JsonArenaLease::JsonArenaLease () {
+		if (!json_arena_in_use && !json_arena) json_arena_resize(JSON_ARENA_SIZE_INIT);
+		uses_arena = !json_arena_in_use && json_arena;
+		if (uses_arena) {
+			json_arena_in_use = true;
+			allocator = json_arena;
+		} else allocator = new MemoryPoolAllocator<>();
+	}
+	JsonArenaLease::~JsonArenaLease () {
+		if (!uses_arena) {
+			delete allocator;
+			return;
 		}
-		if (str[start] == '\'') {
-			std::string res_str;
-			size_t pos = start + 1;
-			for (; pos < str.size(); pos++) {
-				if (str[pos] == '\\') {
-					if (pos + 1 == str.size()) break;
-					if (str[pos + 1] == 'x') {
-						if (pos + 3 >= str.size()) break;
-						int char_code = 0;
-						bool ok = true;
-						for (int i = 0; i < 2; i++) {
-							if (pos + 2 + i >= str.size()) {
-								ok = false;
-								break;
-							}
-							char cur_char = str[pos + 2 + i];
-							char_code <<= 4; // * 16
-							if ('0' <= cur_char && cur_char <= '9') char_code += cur_char - '0';
-							else if ('a' <= cur_char && cur_char <= 'f') char_code += cur_char - 'a' + 10;
-							else if ('A' <= cur_char && cur_char <= 'F') char_code += cur_char - 'A' + 10;
-							else {
-								ok = false;
-								break;
-							}
-						}
-						if (!ok) {
-							debug_error("remove_garbage : failed to parse " + str.substr(pos + 2, 2) + " as hex");
-							return "";
-						}
-						res_str.push_back(char_code);
-						pos += 3;
-					} else {
-						res_str.push_back(str[pos + 1]);
-						pos++;
-					}
-				} else if (str[pos] == '\'') break;
-				else res_str.push_back(str[pos]);
-			}
-			return res_str;
-		} else if (str[start] == '(' || str[start] == '{' || str[start] == '[') {
-			size_t pos = start + 1;
-			int level = 1;
-			bool in_string = false;
-			for (; pos < str.size(); pos++) {
-				if (str[pos] == '"') in_string = !in_string;
-				else if (in_string) {
-					if (str[pos] == '\\') pos++;
-				} else if (str[pos] == '{' || str[pos] == '[' || str[pos] == '(') level++;
-				else if (str[pos] == '}' || str[pos] == ']' || str[pos] == ')') level--;
-				if (level == 0) break;
-			}
-			if (level != 0) {
-				debug_error("remove_garbage : the first parenthesis is never closed");
-				return "";
-			}
-			return str.substr(start, pos - start + 1);
-		} else {
-			debug_error("remove_garbage : (, {, [, or ' expected");
-			return "";
+		size_t used = json_arena->Size() + 1024; // + the headers of the pool
+		json_arena->Clear();
+		if (used > json_arena_size && json_arena_size < JSON_ARENA_SIZE_MAX) {
+			size_t new_size = std::min<size_t>(JSON_ARENA_SIZE_MAX, used + used / 4);
+			json_arena_resize(new_size);
+			if (!json_arena) json_arena_resize(JSON_ARENA_SIZE_INIT); // out of memory
 		}
+		json_arena_in_use = false;
 	}
-	// `html` can contain unnecessary garbage at the end of the actual json data
-	RJson to_json(Document &json_root, const std::string &html, size_t start) {
-		auto content = remove_garbage(html, start);
-		std::string error;
-		auto res = RJson::parse(json_root, (char *) &content[0], error);
-		if (error != "") get_error_json(error);
-		return res;
-	}
-	// search for `var_name` = ' or `var_name` = {
-	bool fast_extract_initial(Document &json_root, const std::string &html, const std::string &var_name, RJson &res) {
-		size_t head = 0;
-		while (head < html.size()) {
-			auto pos = html.find(var_name, head);
-			if (pos == std::string::npos) break;
-			pos += var_name.size();
-			while (pos < html.size() && isspace(html[pos])) pos++;
-			if (pos < html.size() && html[pos] == '=') {
-				pos++;
-				while (pos < html.size() && isspace(html[pos])) pos++;
-				if (pos < html.size() && (html[pos] == '\'' || html[pos] == '{')) {
-					res = to_json(json_root, html, pos);
-					if (res.has_key("Error")) debug_error(std::string("fast_extract_initial : ") + res["Error"].string_value());
-					else if (res.is_valid()) return true;
+	
+	// returns the end of the json object/array starting at `begin` ('{' or '['), or NULL if it's never closed
+	static char *find_json_end(char *begin, char *end) {
+		int level = 0;
+		for (char *cur = begin; cur < end; cur++) {
+			if (*cur == '"') { // strings are most of the bytes, so skip them with memchr
+				while (1) {
+					cur = (char *) memchr(cur + 1, '"', end - cur - 1);
+					if (!cur) return NULL;
+					int backslash_num = 0; // the quote is escaped if preceded by an odd number of backslashes
+					for (char *i = cur - 1; *i == '\\'; i--) backslash_num++;
+					if (!(backslash_num & 1)) break;
 				}
+			} else if (*cur == '{' || *cur == '[') level++;
+			else if (*cur == '}' || *cur == ']') {
+				if (--level == 0) return cur + 1;
 			}
-			head = pos;
 		}
-		return false;
-	}
-	RJson get_succeeding_json_regexes(Document &json_root, const std::string &html, std::vector<const char *> patterns) {
-		for (auto pattern_str : patterns) {
-			std::regex pattern = std::regex(std::string(pattern_str));
-			std::smatch match_res;
-			if (std::regex_search(html, match_res, pattern)) {
-				size_t start = match_res.suffix().first - html.begin() - 1;
-				auto res = to_json(json_root, html, start);
-				if (!res.has_key("Error")) return res;
+		return NULL;
+	}
+	// decodes the javascript string literal starting at `begin` ('\'') in place, returns the end of the decoded content or NULL on error
+	static char *decode_js_string(char *begin, char *end) {
+		char *write = begin;
+		for (char *read = begin + 1; read < end; read++) {
+			if (*read == '\'') return write;
+			if (*read != '\\') {
+				*write++ = *read;
+				continue;
+			}
+			if (++read == end) break;
+			if (*read != 'x') {
+				*write++ = *read;
+				continue;
+			}
+			int char_code = 0;
+			for (int i = 0; i < 2; i++) {
+				if (++read == end) return NULL;
+				char_code <<= 4; // * 16
+				if ('0' <= *read && *read <= '9') char_code += *read - '0';
+				else if ('a' <= *read && *read <= 'f') char_code += *read - 'a' + 10;
+				else if ('A' <= *read && *read <= 'F') char_code += *read - 'A' + 10;
+				else return NULL;
+			}
+			*write++ = char_code;
+		}
+		return NULL;
+	}
+	RJson extract_initial_json(Document &json_root, std::string &html, const char *var_name) {
+		size_t var_name_len = strlen(var_name);
+		char *html_end = &html[0] + html.size();
+		char *head = &html[0];
+		while (head + var_name_len < html_end) {
+			// memchr for the first character, then compare the rest
+			char *cur = (char *) memchr(head, var_name[0], html_end - head - var_name_len);
+			if (!cur) break;
+			head = cur + 1;
+			if (memcmp(cur, var_name, var_name_len)) continue;
+			cur += var_name_len;
+			
+			// `var_name` = ... or window["`var_name`"] = ...
+			if (cur < html_end && (*cur == '"' || *cur == '\'')) cur++;
+			if (cur < html_end && *cur == ']') cur++;
+			while (cur < html_end && isspace(*cur)) cur++;
+			if (cur == html_end || *cur != '=') continue;
+			cur++;
+			while (cur < html_end && isspace(*cur)) cur++;
+			if (cur == html_end) break;
+			
+			char *json_end;
+			if (*cur == '{' || *cur == '[') json_end = find_json_end(cur, html_end);
+			else if (*cur == '\'') json_end = decode_js_string(cur, html_end);
+			else continue;
+			if (!json_end) {
+				debug_error(std::string("extract_initial_json : ") + var_name + " never closed");
+				continue;
 			}
+			// html can contain garbage right after the json, which is cut off here
+			*json_end = '\0';
+			std::string error;
+			RJson res = RJson::parse_inplace(json_root, cur, error);
+			if (error == "") return res;
+			debug_error(std::string("extract_initial_json : ") + error);
+			head = json_end + 1;
 		}
 		return RJson();
 	}
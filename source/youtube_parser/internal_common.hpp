@@ -5,7 +5,13 @@
 #include "cipher.hpp"
 #include "rapidjson_wrapper.hpp"
 
-#ifdef _WIN32
+// off-device builds of the parser (Windows, or a Linux host) don't have libctru nor the rest of the app
+#if defined(_WIN32) || !defined(__3DS__)
+#	define YOUTUBE_PARSER_HOST
+#endif
+
+#ifdef YOUTUBE_PARSER_HOST
+#	include <cstdint>
 #	include <iostream> // <------------
 #	include <fstream> // <-------
 #	include <sstream> // <-------
@@ -51,13 +57,50 @@ namespace youtube_parser {
 	inline std::string get_innertube_api_url(std::string api_name) { return "https://m.youtube.com/youtubei/v1/" + api_name + "?key=" + INNERTUBE_KEY + "&prettyPrint=false"; }
 	
 	// network operation related
-#	ifndef _WIN32
+	// all of these go through the transport set by youtube_set_transport() if any
+#	ifndef YOUTUBE_PARSER_HOST
 	extern NetworkSessionList thread_network_session_list;
 	HttpRequest http_get_request(const std::string &url, std::map<std::string, std::string> headers = {});
 	HttpRequest http_post_json_request(const std::string &url, const std::string &json, std::map<std::string, std::string> headers = {});
 #	endif
 	std::pair<bool, std::string> http_get(const std::string &url, std::map<std::string, std::string> header = {});
 	std::pair<bool, std::string> http_post_json(const std::string &url, const std::string &json, std::map<std::string, std::string> header = {});
+	// posts {url, json} pairs at once (in parallel on the 3ds), `on_each_finish` is called each time one of them finishes
+	std::vector<std::pair<bool, std::string> > http_post_json_multi(const std::vector<std::pair<std::string, std::string> > &url_json_list,
+		std::function<void ()> on_each_finish = nullptr);
+	
+	// a JSON request body with placeholders %0 .. %9, split into literal and slot segments once (meant to be constructed as a static)
+	// values are JSON-escaped when rendered unless passed through RequestTemplate::raw()
+	class RequestTemplate {
+	public :
+		struct Value {
+			const std::string *str;
+			bool raw;
+			Value (const std::string &str) : str(&str), raw(false) {}
+		};
+		static Value raw(const std::string &str) {
+			Value res(str);
+			res.raw = true;
+			return res;
+		}
+		
+		RequestTemplate (const char *str);
+		// missing values are rendered as empty strings
+		void render(std::string &out, std::initializer_list<Value> values) const;
+		std::string render(std::initializer_list<Value> values) const;
+	private :
+		struct Segment {
+			size_t begin;
+			size_t len;
+			int slot; // -1 for literal segments
+		};
+		std::string source;
+		std::vector<Segment> segments;
+		size_t literal_size = 0;
+	};
+	void append_json_escaped(std::string &out, const std::string &str);
+	// {hl, gl, continuation token}, shared by the "load more" requests of the MWEB client
+	extern const RequestTemplate continuation_template;
 	
 	// string util
 	bool starts_with(const std::string &str, const std::string &pattern, size_t offset = 0);
@@ -77,28 +120,53 @@ namespace youtube_parser {
 	std::string get_thumbnail_url_exact(RJson thumbnails, int target_width); // modify the url to make its width match `target_width`
 	
 
-	// str[0] must be '(', '[', '{', or '\''
-	// returns the prefix of str until the corresponding parenthesis or quote of str[0]
-	std::string remove_garbage(const std::string &str, size_t start);
-	// html can contain unnecessary garbage at the end of the actual json data
-	RJson to_json(Document &json_root, const std::string &html, size_t start);
-
-	// search for `var_name` = ' or `var_name` = {
-	bool fast_extract_initial(Document &json_root, const std::string &html, const std::string &var_name, RJson &res);
+	// finds `var_name` = {...}, `var_name` = '...' or window["`var_name`"] = ... in `html` and parses the json in place
+	// `html` is modified and must outlive `json_root` ; returns an invalid RJson if not found
+	RJson extract_initial_json(Document &json_root, std::string &html, const char *var_name);
 	
-	RJson get_succeeding_json_regexes(Document &json_root, const std::string &html, std::vector<const char *> patterns);
 	
+	// the allocator of the documents of parse_json_*destructive(), whose memory is reused instead of being malloc-ed and freed on every parse
+	// after each parse the pool is reset, and if it had to grow, its buffer is enlarged to the high-water mark (up to a cap)
+	// so that the next parse of the same size allocates nothing
+	// the parser only runs on the async task thread (as with thread_network_session_list), so there is one arena ;
+	// a parse nested in the callback of another one gets a plain allocator as the outer document is still alive
+	class JsonArenaLease {
+	private :
+		bool uses_arena;
+		MemoryPoolAllocator<> *allocator;
+	public :
+		// the parse stack of the document is allocated once at this size instead of growing from 1 KiB step by step
+		static constexpr size_t STACK_CAPACITY = 16 * 1024;
+		
+		JsonArenaLease ();
+		JsonArenaLease (const JsonArenaLease &) = delete;
+		JsonArenaLease & operator = (const JsonArenaLease &) = delete;
+		~JsonArenaLease ();
+		MemoryPoolAllocator<> &get() { return *allocator; }
+	};
 	
 	// parses `str` as json and calls `on_success` or `on_fail` based on the result of the parsing
 	// the content of `str` will be modified
 	template<class Func1, class Func2>
 	void parse_json_destructive(char *str, const Func1 &on_success, const Func2 &on_fail) {
 		std::string json_err;
-		Document json_root;
+		JsonArenaLease arena;
+		Document json_root(&arena.get(), JsonArenaLease::STACK_CAPACITY);
 		RJson data = RJson::parse_inplace(json_root, str, json_err);
 		if (json_err != "") on_fail(json_err);
 		else on_success(json_root, data); // both `json_root` and `str` is alive at this point
 	}
+	// the same as above, except that only the values at `paths` (e.g. "streamingData.adaptiveFormats") are stored in the document
+	// meant for large responses of which only a few parts are read ; anything outside the paths looks missing to `on_success`
+	template<class Func1, class Func2>
+	void parse_json_selective_destructive(char *str, const std::vector<const char *> &paths, const Func1 &on_success, const Func2 &on_fail) {
+		std::string json_err;
+		JsonArenaLease arena;
+		Document json_root(&arena.get(), JsonArenaLease::STACK_CAPACITY);
+		RJson data = RJson::parse_inplace_selective(json_root, str, paths, json_err);
+		if (json_err != "") on_fail(json_err);
+		else on_success(json_root, data);
+	}
 	// calls `access` to fetch json and calls `parse` to parse the json
 	// properly handles the lifetime of json objects
 	template<class Func1, class Func2, class Func3>
@@ -107,6 +175,12 @@ namespace youtube_parser {
 		if (result.first) parse_json_destructive(&result.second[0], on_success, on_fail);
 		else on_fail(result.second);
 	}
+	template<class Func1, class Func2, class Func3>
+	void access_and_parse_json_selective(const Func1 &access, const std::vector<const char *> &paths, const Func2 &on_success, const Func3 &on_fail) {
+		auto result = access();
+		if (result.first) parse_json_selective_destructive(&result.second[0], paths, on_success, on_fail);
+		else on_fail(result.second);
+	}
 	
 	std::string convert_url_to_mobile(std::string url);
 	std::string convert_url_to_desktop(std::string url);
@@ -3,6 +3,8 @@
 #include <string>
 #include <map>
 #include <functional>
+#include <algorithm>
+#include <cstdint>
 
 struct YouTubeChannelSuccinct {
 	std::string name;
@@ -27,26 +29,55 @@ struct YouTubePlaylistSuccinct {
 	std::string thumbnail_url;
 };
 
+// an item of search results or suggestions : a video, a channel or a playlist
+// only the fields of `type` are kept, packed into one buffer instead of a std::string each
+// (long lists of these are copied between the parser and the scenes, and each view keeps a copy of its item)
 struct YouTubeSuccinctItem {
-	// TODO : use union or std::variant
 	enum {
 		VIDEO,
 		CHANNEL,
 		PLAYLIST
-	} type;
-	YouTubeVideoSuccinct video;
-	YouTubeChannelSuccinct channel;
-	YouTubePlaylistSuccinct playlist;
+	} type = VIDEO;
 	
 	YouTubeSuccinctItem () = default;
-	YouTubeSuccinctItem (YouTubeVideoSuccinct video) : type(VIDEO), video(video) {}
-	YouTubeSuccinctItem (YouTubeChannelSuccinct channel) : type(CHANNEL), channel(channel) {}
-	YouTubeSuccinctItem (YouTubePlaylistSuccinct playlist) : type(PLAYLIST), playlist(playlist) {}
+	YouTubeSuccinctItem (const YouTubeVideoSuccinct &video) : type(VIDEO) {
+		pack({&video.url, &video.title, &video.duration_text, &video.publish_date, &video.views_str, &video.author, &video.thumbnail_url});
+	}
+	YouTubeSuccinctItem (const YouTubeChannelSuccinct &channel) : type(CHANNEL) {
+		pack({&channel.name, &channel.id, &channel.icon_url, &channel.subscribers, &channel.video_num});
+	}
+	YouTubeSuccinctItem (const YouTubePlaylistSuccinct &playlist) : type(PLAYLIST) {
+		pack({&playlist.url, &playlist.title, &playlist.video_count_str, &playlist.thumbnail_url});
+	}
+	
+	// unpacks the fields, only valid for the matching `type`
+	YouTubeVideoSuccinct get_video() const { return {field(0), field(1), field(2), field(3), field(4), field(5), field(6)}; }
+	YouTubeChannelSuccinct get_channel() const { return {field(0), field(1), field(2), field(3), field(4)}; }
+	YouTubePlaylistSuccinct get_playlist() const { return {field(0), field(1), field(2), field(3)}; }
 	
 	// returns channel id in case of type == CHANNEL
-	std::string get_url() const { return type == VIDEO ? video.url : type == CHANNEL ? channel.id : playlist.url; }
-	std::string get_thumbnail_url() const { return type == VIDEO ? video.thumbnail_url : type == CHANNEL ? channel.icon_url : playlist.thumbnail_url; }
-	std::string get_name() const { return type == VIDEO ? video.title : type == CHANNEL ? channel.name : playlist.title; }
+	const char *get_url() const { return field(type == CHANNEL ? 1 : 0); }
+	const char *get_thumbnail_url() const { return field(type == VIDEO ? 6 : type == CHANNEL ? 2 : 3); }
+	const char *get_name() const { return field(type == CHANNEL ? 0 : 1); }
+private :
+	static constexpr int FIELD_NUM_MAX = 7;
+	std::string buffer; // '\0'-terminated fields
+	uint16_t offsets[FIELD_NUM_MAX] = {0}; // the start of each field in `buffer`
+	
+	void pack(std::initializer_list<const std::string *> fields) {
+		size_t size = 0;
+		for (auto field : fields) size += field->size() + 1;
+		buffer.reserve(std::min<size_t>(size, UINT16_MAX));
+		int index = 0;
+		for (auto field : fields) {
+			if (buffer.size() + field->size() + 1 > UINT16_MAX) break; // never happens in practice, the rest is left empty
+			offsets[index++] = buffer.size();
+			buffer.append(field->c_str()); // stops at '\0' in the field, if any
+			buffer.push_back('\0');
+		}
+		for (; index < FIELD_NUM_MAX; index++) offsets[index] = buffer.size(); // pointing to the terminator of `buffer`
+	}
+	const char *field(int index) const { return buffer.c_str() + offsets[index]; }
 };
 
 
@@ -145,13 +176,13 @@ struct YouTubeVideoDetail {
 	
 	bool has_next_video() const {
 		if (playlist.videos.size() && playlist.selected_index != (int) playlist.videos.size() - 1) return true;
-		for (auto suggestion : suggestions) if (suggestion.type == YouTubeSuccinctItem::VIDEO) return true;
+		for (auto &suggestion : suggestions) if (suggestion.type == YouTubeSuccinctItem::VIDEO) return true;
 		return false;
 	}
 	bool has_next_video_in_playlist() const { return playlist.videos.size() && playlist.selected_index != (int) playlist.videos.size() - 1; }
 	YouTubeVideoSuccinct get_next_video() const {
 		if (playlist.videos.size() && playlist.selected_index != (int) playlist.videos.size() - 1) return playlist.videos[std::max(0, playlist.selected_index + 1)];
-		for (auto suggestion : suggestions) if (suggestion.type == YouTubeSuccinctItem::VIDEO) return suggestion.video;
+		for (auto &suggestion : suggestions) if (suggestion.type == YouTubeSuccinctItem::VIDEO) return suggestion.get_video();
 		return YouTubeVideoSuccinct();
 	}
 	bool has_more_suggestions() const { return suggestions_continue_token != ""; }
@@ -225,6 +256,13 @@ YouTubeHomeResult youtube_load_home_page();
 
 
 void youtube_change_content_language(std::string language_code);
+// replaces how the parser performs HTTP requests (e.g. to replay recorded innertube responses off-device), nullptr restores the default
+// arguments : method ("GET" or "POST"), url, headers, body / returns : {success, response body or error message}
+using YouTubeTransport = std::function<std::pair<bool, std::string> (const std::string &, const std::string &,
+	const std::map<std::string, std::string> &, const std::string &)>;
+void youtube_set_transport(YouTubeTransport transport);
+// while set, the parser sends its requests with the prefetch priority class instead of the interactive one (for speculative loads)
+void youtube_set_prefetch_mode(bool prefetch);
 void youtube_set_cipher_decrypter(std::string decrypter); // cipher.cpp
 
 /* -------------------------------- utils.cpp -------------------------------- */
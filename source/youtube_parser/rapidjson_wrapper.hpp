@@ -4,6 +4,223 @@
 #include "rapidjson/stringbuffer.h"
 #include <vector>
 #include <string>
+#include <cstring>
+#include <initializer_list>
+
+// SAX handler that builds into `out` only the values at `paths` and the objects on the way to them
+// a path is a dot-separated list of keys from the root (e.g. "streamingData.adaptiveFormats"), so arrays can only be at the end of a path
+// only for in-situ parsing : keys and strings are referenced without copying
+class RJsonSelectiveHandler {
+private :
+	using Key_ = std::pair<const char *, rapidjson::SizeType>;
+	rapidjson::Document &out;
+	std::vector<std::vector<std::string> > paths;
+	std::vector<Key_> cur_path; // the keys of the objects on the way being built (the root excluded)
+	std::vector<rapidjson::SizeType> member_nums; // the number of members built for each of the objects on the way
+	int capture_depth = 0; // > 0 while building a value at one of the paths
+	int skip_depth = 0; // > 0 while skipping a value not needed
+	enum { ROOT, CAPTURE, PREFIX, SKIP } next = ROOT; // how to treat the value after the last key
+	Key_ next_key = {NULL, 0};
+	
+	static bool key_matches(const std::string &path_key, const Key_ &key) {
+		return path_key.size() == key.second && !memcmp(path_key.data(), key.first, key.second);
+	}
+	void classify_next() {
+		next = SKIP;
+		for (auto &path : paths) {
+			if (path.size() <= cur_path.size() || !key_matches(path[cur_path.size()], next_key)) continue;
+			bool match = true;
+			for (size_t i = 0; match && i < cur_path.size(); i++) match = key_matches(path[i], cur_path[i]);
+			if (!match) continue;
+			if (path.size() == cur_path.size() + 1) {
+				next = CAPTURE;
+				return;
+			}
+			next = PREFIX;
+		}
+	}
+	bool forward_key() {
+		member_nums.back()++;
+		return out.Key(next_key.first, next_key.second, false);
+	}
+	template<class Func> bool scalar(const Func &forward) {
+		if (skip_depth) return true;
+		if (capture_depth || next == ROOT) return forward();
+		if (next == CAPTURE) return forward_key() && forward();
+		return true; // an object was expected
+	}
+	template<class Func> bool start(bool is_object, const Func &forward) {
+		if (skip_depth) return skip_depth++, true;
+		if (capture_depth) return capture_depth++, forward();
+		if (next == CAPTURE || (next == ROOT && !is_object)) {
+			capture_depth = 1;
+			return (next == ROOT || forward_key()) && forward();
+		}
+		if (is_object && next != SKIP) { // one of the objects on the way
+			if (next == PREFIX) {
+				if (!forward_key()) return false;
+				cur_path.push_back(next_key);
+			}
+			member_nums.push_back(0);
+			return forward();
+		}
+		skip_depth = 1;
+		return true;
+	}
+public :
+	RJsonSelectiveHandler (rapidjson::Document &out, const std::vector<const char *> &paths) : out(out) {
+		for (auto path : paths) {
+			this->paths.push_back({""});
+			for (const char *c = path; *c; c++) {
+				if (*c == '.') this->paths.back().push_back("");
+				else this->paths.back().back().push_back(*c);
+			}
+		}
+	}
+	
+	bool Null() { return scalar([&] () { return out.Null(); }); }
+	bool Bool(bool b) { return scalar([&] () { return out.Bool(b); }); }
+	bool Int(int i) { return scalar([&] () { return out.Int(i); }); }
+	bool Uint(unsigned i) { return scalar([&] () { return out.Uint(i); }); }
+	bool Int64(int64_t i) { return scalar([&] () { return out.Int64(i); }); }
+	bool Uint64(uint64_t i) { return scalar([&] () { return out.Uint64(i); }); }
+	bool Double(double d) { return scalar([&] () { return out.Double(d); }); }
+	bool RawNumber(const char *str, rapidjson::SizeType len, bool copy) { return scalar([&] () { return out.RawNumber(str, len, copy); }); }
+	bool String(const char *str, rapidjson::SizeType len, bool copy) { return scalar([&] () { return out.String(str, len, copy); }); }
+	bool StartObject() { return start(true, [&] () { return out.StartObject(); }); }
+	bool StartArray() { return start(false, [&] () { return out.StartArray(); }); }
+	bool Key(const char *str, rapidjson::SizeType len, bool copy) {
+		if (skip_depth) return true;
+		if (capture_depth) return out.Key(str, len, copy);
+		next_key = {str, len};
+		classify_next();
+		return true;
+	}
+	bool EndObject(rapidjson::SizeType member_num) {
+		if (skip_depth) return skip_depth--, true;
+		if (capture_depth) return capture_depth--, out.EndObject(member_num);
+		member_num = member_nums.back();
+		member_nums.pop_back();
+		if (member_nums.size()) cur_path.pop_back();
+		return out.EndObject(member_num);
+	}
+	bool EndArray(rapidjson::SizeType element_num) {
+		if (skip_depth) return skip_depth--, true;
+		return capture_depth--, out.EndArray(element_num);
+	}
+};
+
+// a pair of iterators of rapidjson, dereferenced as `Element`
+template<class Element, class Iterator> class RJsonRange {
+private :
+	Iterator begin_ = Iterator();
+	Iterator end_ = Iterator();
+public :
+	class iterator {
+	private :
+		Iterator cur;
+	public :
+		iterator (Iterator cur) : cur(cur) {}
+		Element operator * () const { return Element(*cur); }
+		iterator & operator ++ () { ++cur; return *this; }
+		bool operator != (const iterator &rhs) const { return cur != rhs.cur; }
+		bool operator == (const iterator &rhs) const { return cur == rhs.cur; }
+	};
+	RJsonRange () = default;
+	RJsonRange (Iterator begin, Iterator end) : begin_(begin), end_(end) {}
+	iterator begin() const { return begin_; }
+	iterator end() const { return end_; }
+	size_t size() const { return end_ - begin_; }
+	bool empty() const { return begin_ == end_; }
+	Element operator [] (size_t index) const { return Element(*(begin_ + index)); }
+};
+struct RJsonMember;
+
+// a chain of keys compiled once (meant to be constructed as a static), e.g. RJsonPath("playabilityStatus.status")
+// RJson::operator [] resolves it with one member search per level and no allocation
+class RJsonPath {
+private :
+	std::string source;
+	std::vector<std::pair<size_t, size_t> > keys; // {offset in `source`, length}
+public :
+	RJsonPath (const char *path) : source(path) {
+		size_t start = 0;
+		for (size_t i = 0; i <= source.size(); i++) if (i == source.size() || source[i] == '.') {
+			keys.push_back({start, i - start});
+			start = i + 1;
+		}
+	}
+	RJsonPath (std::initializer_list<const char *> keys) { // for keys containing '.'
+		for (auto key : keys) source += key;
+		size_t start = 0;
+		for (auto key : keys) {
+			this->keys.push_back({start, strlen(key)});
+			start += strlen(key);
+		}
+	}
+	size_t size() const { return keys.size(); }
+	rapidjson::Value key(size_t index) const { return rapidjson::Value(rapidjson::StringRef(source.data() + keys[index].first, keys[index].second)); }
+	const rapidjson::Value *resolve(const rapidjson::Value *json) const {
+		for (size_t i = 0; i < keys.size() && json; i++) {
+			if (!json->IsObject()) return NULL;
+			auto itr = json->FindMember(key(i));
+			json = itr == json->MemberEnd() ? NULL : &itr->value;
+		}
+		return json;
+	}
+};
+// several paths compiled into a tree of keys, extracted from one object at once
+// each object on the way is scanned only once however many of the paths go through it
+// e.g. static const RJsonPathSet paths({"title", "videoId", "thumbnail.thumbnails"}); RJson res[3]; json.extract(paths, res);
+class RJsonPathSet {
+private :
+	struct Node {
+		std::string key;
+		int result_index = -1; // the index of the path ending here
+		std::vector<Node> children;
+	};
+	Node root;
+	size_t path_num = 0;
+	
+	template<class Result> static void extract_(const Node &node, rapidjson::Value &json, Result *res) {
+		if (!json.IsObject()) return;
+		for (auto &member : json.GetObject()) {
+			for (auto &child : node.children) {
+				if (child.key.size() != member.name.GetStringLength() || memcmp(child.key.data(), member.name.GetString(), child.key.size())) continue;
+				if (child.result_index != -1) res[child.result_index] = member.value;
+				if (child.children.size()) extract_(child, member.value, res);
+				break;
+			}
+		}
+	}
+public :
+	RJsonPathSet (std::initializer_list<const char *> paths) {
+		for (auto path : paths) {
+			Node *cur = &root;
+			std::string key;
+			for (const char *c = path; ; c++) {
+				if (*c && *c != '.') {
+					key.push_back(*c);
+					continue;
+				}
+				Node *next = NULL;
+				for (auto &child : cur->children) if (child.key == key) next = &child;
+				if (!next) {
+					cur->children.push_back(Node());
+					next = &cur->children.back();
+					next->key = key;
+				}
+				cur = next;
+				key.clear();
+				if (!*c) break;
+			}
+			cur->result_index = path_num++;
+		}
+	}
+	size_t size() const { return path_num; }
+	// res[i] is set to the value at the i-th path, and left untouched if there's no value there
+	template<class Result> void extract(rapidjson::Value &json, Result *res) const { extract_(root, json, res); }
+};
 
 // rapidjson wrapper
 class RJson {
@@ -34,7 +251,27 @@ public :
 		}
 	}
 	
+	// the same as parse_inplace(), except that only the values at `paths` (see RJsonSelectiveHandler) are stored in the document
+	// the rest of the json is still parsed but never materialized, so the document is as large as the values needed
+	// the result has the same structure as the whole json would have, anything outside the paths just looks missing
+	static RJson parse_inplace_selective(rapidjson::Document &data, char *s, const std::vector<const char *> &paths, std::string &error) {
+		RJsonSelectiveHandler handler(data, paths);
+		rapidjson::InsituStringStream stream(s);
+		rapidjson::Reader reader;
+		rapidjson::ParseResult parse_result;
+		auto generator = [&] (rapidjson::Document &) { return !(parse_result = reader.Parse<rapidjson::kParseInsituFlag>(stream, handler)).IsError(); };
+		data.Populate(generator);
+		if (parse_result.IsError()) {
+			error = "Parsing error " + std::to_string(parse_result.Code()) + " at " + std::to_string(parse_result.Offset());
+			return RJson();
+		} else {
+			error = "";
+			return RJson(data);
+		}
+	}
+	
 	bool is_valid() const { return json != NULL; }
+	bool has_key(const char *key) const { return (*this)[key].is_valid(); }
 	bool has_key(const std::string &str) const { return (*this)[str].is_valid(); }
 	
 	const char *cstring_value() const { return json && json->IsString() ? json->GetString() : ""; }
@@ -47,6 +284,11 @@ public :
 		return std::vector<RJson>(array.Begin(), array.End());
 	}
 	
+	// views of the items of an array / the members of an object, iterated without copying them into a vector
+	// (empty if it's not an array / an object) ; valid as long as the document is alive and not modified
+	RJsonRange<RJson, rapidjson::Value *> array_range() const;
+	RJsonRange<RJsonMember, rapidjson::Value::MemberIterator> object_range() const;
+	
 	void set_str(rapidjson::Document &json_root, const char *key, const char *value) {
 		if (!json || !json->IsObject()) return;
 		if (has_key(key)) (*this)[key].json->SetString(value, json_root.GetAllocator());
@@ -59,7 +301,20 @@ public :
 		}
 	}
 	
-	RJson operator [] (const char *key) const { return json && json->IsObject() && json->HasMember(key) ? (*json)[key] : RJson(); }
+	RJson operator [] (const char *key) const {
+		if (!json || !json->IsObject()) return RJson();
+		auto itr = json->FindMember(key);
+		return itr == json->MemberEnd() ? RJson() : RJson(itr->value);
+	}
+	RJson operator [] (const RJsonPath &path) const {
+		const rapidjson::Value *res = path.resolve(json);
+		return res ? RJson(*const_cast<rapidjson::Value *>(res)) : RJson();
+	}
+	// res[i] : the value at the i-th path of `paths` (invalid if missing)
+	void extract(const RJsonPathSet &paths, RJson *res) const {
+		for (size_t i = 0; i < paths.size(); i++) res[i] = RJson();
+		if (json) paths.extract(*json, res);
+	}
 	RJson operator [] (const std::string &str) const { return (*this)[str.c_str()]; }
 	RJson operator [] (size_t index) const { return json && json->IsArray() ? (*json)[index] : RJson(); }
 	
@@ -71,3 +326,16 @@ public :
 		return buffer.GetString();
 	}
 };
+struct RJsonMember {
+	const char *key;
+	RJson value;
+	RJsonMember (rapidjson::Value::Member &member) : key(member.name.GetString()), value(member.value) {}
+};
+inline RJsonRange<RJson, rapidjson::Value *> RJson::array_range() const {
+	if (!json || !json->IsArray()) return {};
+	return {json->Begin(), json->End()};
+}
+inline RJsonRange<RJsonMember, rapidjson::Value::MemberIterator> RJson::object_range() const {
+	if (!json || !json->IsObject()) return {};
+	return {json->MemberBegin(), json->MemberEnd()};
+}
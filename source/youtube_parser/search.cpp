@@ -1,4 +1,3 @@
-#include <regex>
 #include "internal_common.hpp"
 #include "parser.hpp"
 
@@ -34,7 +33,7 @@ static bool parse_searched_item(RJson content, std::vector<YouTubeSuccinctItem>
         YouTubePlaylistSuccinct cur_list;
         cur_list.title = get_text_from_object(playlist_renderer["title"]);
         cur_list.video_count_str = get_text_from_object(playlist_renderer["videoCountText"]);
-        for (auto thumbnail : playlist_renderer["thumbnail"]["thumbnails"].array_items()) {
+        for (auto thumbnail : playlist_renderer["thumbnail"]["thumbnails"].array_range()) {
             if (thumbnail.has_key("url") && 
                 thumbnail["url"].string_value().find("/default.jpg") != std::string::npos) {
                 cur_list.thumbnail_url = thumbnail["url"].string_value();
@@ -94,10 +93,8 @@ YouTubeSearchResult youtube_load_search(std::string url) {
     }
     query_word = new_query_word;
 
-    std::string post_content = R"({"context": {"client": {"hl": "%0", "gl": "%1", "clientName": "MWEB", "clientVersion": "2.20210711.08.00"}}, "query": ")"
-        + query_word + "\"}";
-    post_content = std::regex_replace(post_content, std::regex("%0"), language_code);
-    post_content = std::regex_replace(post_content, std::regex("%1"), country_code);
+    static const RequestTemplate post_template(R"({"context": {"client": {"hl": "%0", "gl": "%1", "clientName": "MWEB", "clientVersion": "2.20210711.08.00"}}, "query": "%2"})");
+    std::string post_content = post_template.render({language_code, country_code, query_word});
 
     access_and_parse_json(
         [&] () { return http_post_json(get_innertube_api_url("search"), post_content); },
@@ -112,9 +109,9 @@ YouTubeSearchResult youtube_load_search(std::string url) {
             if (yt_result.has_key("contents") &&
                 yt_result["contents"].has_key("sectionListRenderer") &&
                 yt_result["contents"]["sectionListRenderer"].has_key("contents")) {
-                for (auto i : yt_result["contents"]["sectionListRenderer"]["contents"].array_items()) {
+                for (auto i : yt_result["contents"]["sectionListRenderer"]["contents"].array_range()) {
                     if (i.has_key("itemSectionRenderer")) {
-                        for (auto j : i["itemSectionRenderer"]["contents"].array_items()) {
+                        for (auto j : i["itemSectionRenderer"]["contents"].array_range()) {
                             if (!parse_searched_item(j, res.results)) {
                                 debug_error("Error parsing search result item");
                                 success = false; 
@@ -151,20 +148,17 @@ void YouTubeSearchResult::load_more_results() {
 	}
 	
 	// POST to get more results
-	std::string post_content = R"({"context": {"client": {"hl": "%0", "gl": "%1", "clientName": "MWEB", "clientVersion": "2.20210711.08.00", "utcOffsetMinutes": 0}, "request": {}, "user": {}}, "continuation": ")"
-		+ continue_token + "\"}";
-	post_content = std::regex_replace(post_content, std::regex("%0"), language_code);
-	post_content = std::regex_replace(post_content, std::regex("%1"), country_code);
+	std::string post_content = continuation_template.render({language_code, country_code, continue_token});
 	
 	access_and_parse_json(
 		[&] () { return http_post_json(get_innertube_api_url("search"), post_content); },
 		[&] (Document &, RJson yt_result) {
 			estimated_result_num = yt_result["estimatedResults"].string_value();
 			continue_token = "";
-			for (auto i : yt_result["onResponseReceivedCommands"].array_items()) {
-				for (auto j : i["appendContinuationItemsAction"]["continuationItems"].array_items()) {
+			for (auto i : yt_result["onResponseReceivedCommands"].array_range()) {
+				for (auto j : i["appendContinuationItemsAction"]["continuationItems"].array_range()) {
 					if (j.has_key("itemSectionRenderer")) {
-						for (auto item : j["itemSectionRenderer"]["contents"].array_items()) parse_searched_item(item, results);
+						for (auto item : j["itemSectionRenderer"]["contents"].array_range()) parse_searched_item(item, results);
 					} else if (j.has_key("continuationItemRenderer"))
 						continue_token = j["continuationItemRenderer"]["continuationEndpoint"]["continuationCommand"]["token"].string_value();
 				}
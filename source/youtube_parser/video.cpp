@@ -1,23 +1,30 @@
-#include <regex>
 #include "internal_common.hpp"
 #include "parser.hpp"
 #include <iostream>
-#include "../variables.hpp"
+#ifndef YOUTUBE_PARSER_HOST
+#	include "../variables.hpp"
+#else
+static bool var_full_dislike_like_count = false;
+#endif
 #include <iomanip>
 #include <algorithm>
 
 static std::map<std::string, std::string> nparam_transform_results_cache;
 static bool extract_player_data(Document &json_root, RJson player_response, YouTubeVideoDetail &res) {
-	res.playability_status = player_response["playabilityStatus"]["status"].string_value();
-	res.playability_reason = player_response["playabilityStatus"]["reason"].string_value();
-	res.is_upcoming = player_response["videoDetails"]["isUpcoming"].bool_value();
-	res.livestream_type = player_response["videoDetails"]["isLiveContent"].bool_value() ?
+	static const RJsonPathSet player_paths({"playabilityStatus.status", "playabilityStatus.reason", "videoDetails.isUpcoming",
+		"videoDetails.isLiveContent", "streamingData.formats", "streamingData.adaptiveFormats"});
+	RJson player_fields[6];
+	player_response.extract(player_paths, player_fields);
+	res.playability_status = player_fields[0].string_value();
+	res.playability_reason = player_fields[1].string_value();
+	res.is_upcoming = player_fields[2].bool_value();
+	res.livestream_type = player_fields[3].bool_value() ?
 		YouTubeVideoDetail::LivestreamType::LIVESTREAM : YouTubeVideoDetail::LivestreamType::PREMIERE;
 	
 	// extract stream formats
 	std::vector<RJson> formats;
-	for (auto i : player_response["streamingData"]["formats"].array_items()) formats.push_back(i);
-	for (auto i : player_response["streamingData"]["adaptiveFormats"].array_items()) formats.push_back(i);
+	for (auto i : player_fields[4].array_range()) formats.push_back(i);
+	for (auto i : player_fields[5].array_range()) formats.push_back(i);
 	
 	// for obfuscated signatures & n parameter modification
 	for (auto &i : formats) { // handle decipher
@@ -51,21 +58,24 @@ static bool extract_player_data(Document &json_root, RJson player_response, YouT
 	res.stream_fragment_len = -1;
 	res.is_livestream = false;
 	std::vector<RJson> audio_formats, video_formats;
+	static const RJsonPathSet format_paths({"targetDurationSec", "approxDurationMs", "type", "mimeType"});
 	for (auto i : formats) {
 		// std::cerr << i["itag"].int_value() << " : " << (i["contentLength"].string_value().size() ? "Yes" : "No") << std::endl;
 		// if (i["contentLength"].string_value() == "") continue;
-		if (i.has_key("targetDurationSec")) {
-			int new_stream_fragment_len = i["targetDurationSec"].int_value();
+		RJson format_fields[4];
+		i.extract(format_paths, format_fields);
+		if (format_fields[0].is_valid()) {
+			int new_stream_fragment_len = format_fields[0].int_value();
 			if (res.stream_fragment_len != -1 && res.stream_fragment_len != new_stream_fragment_len)
 				debug_warning("[unexp] diff targetDurationSec for diff streams");
 			res.stream_fragment_len = new_stream_fragment_len;
 			res.is_livestream = true;
 		}
-		if (i["approxDurationMs"].string_value() != "")
-			res.duration_ms = stoll(i["approxDurationMs"].string_value());
+		if (format_fields[1].string_value() != "")
+			res.duration_ms = stoll(format_fields[1].string_value());
 		
-		if (i["type"].string_value() == "FORMAT_STREAM_TYPE_OTF") continue;
-		auto mime_type = i["mimeType"].string_value();
+		if (format_fields[2].string_value() == "FORMAT_STREAM_TYPE_OTF") continue;
+		auto mime_type = format_fields[3].string_value();
 		if (mime_type.substr(0, 5) == "video") {
 			// H.264 is virtually the only playable video codec
 			if (mime_type.find("avc1") != std::string::npos) video_formats.push_back(i);
@@ -101,27 +111,26 @@ static bool extract_player_data(Document &json_root, RJson player_response, YouT
 	}
 	
 	// extract caption data
-    std::string captions_content = R"({"context": {"client": {"hl": "%0","gl": "%1","clientName": "MWEB","clientVersion": "2.20220308.01.00"}}, "videoId": "%2"})";
-    captions_content = std::regex_replace(captions_content, std::regex("%0"), language_code);
-    captions_content = std::regex_replace(captions_content, std::regex("%1"), country_code);
-    captions_content = std::regex_replace(captions_content, std::regex("%2"), res.id);
+    static const RequestTemplate captions_template(R"({"context": {"client": {"hl": "%0","gl": "%1","clientName": "MWEB","clientVersion": "2.20220308.01.00"}}, "videoId": "%2"})");
+    std::string captions_content = captions_template.render({language_code, country_code, res.id});
 
-    access_and_parse_json(
+    access_and_parse_json_selective(
         [&]() { return http_post_json(get_innertube_api_url("player"), captions_content); },
+        {"captions"},
         [&](Document &, RJson mweb_data) {
             RJson captions = mweb_data["captions"]["playerCaptionsTracklistRenderer"];
             
-            for (auto base_lang : captions["captionTracks"].array_items()) {
+            for (auto base_lang : captions["captionTracks"].array_range()) {
                 YouTubeVideoDetail::CaptionBaseLanguage cur_lang;
                 cur_lang.name = get_text_from_object(base_lang["name"]);
                 cur_lang.id = base_lang["languageCode"].string_value();
                 cur_lang.base_url = base_lang["baseUrl"].string_value();
                 cur_lang.is_translatable = base_lang["isTranslatable"].bool_value();
                 res.caption_base_languages.push_back(cur_lang);
-                logger.info("Caption Data", cur_lang.base_url);
+                debug_info("Caption Data : " + cur_lang.base_url);
             }
 
-            for (auto translation_lang : captions["translationLanguages"].array_items()) {
+            for (auto translation_lang : captions["translationLanguages"].array_range()) {
                 YouTubeVideoDetail::CaptionTranslationLanguage cur_lang;
                 cur_lang.name = get_text_from_object(translation_lang["languageName"]);
                 cur_lang.id = translation_lang["languageCode"].string_value();
@@ -137,46 +146,37 @@ static bool extract_player_data(Document &json_root, RJson player_response, YouT
 static void extract_like_dislike_counts(RJson buttons, YouTubeVideoDetail &res) {
     res.like_count_str = "0";   // Default to "0" for like count
     res.dislike_count_str = "0"; // Default to "0" for dislike count
+    
+    static const RJsonPathSet button_paths({
+        "slimMetadataToggleButtonRenderer", // legacy?
+        "slimMetadataButtonRenderer.button.segmentedLikeDislikeButtonRenderer", // old?
+        "slimMetadataButtonRenderer.button.segmentedLikeDislikeButtonViewModel"
+    });
+    static const RJsonPathSet toggle_paths({"isLike", "isDislike", "target.videoId", "button.toggleButtonRenderer.defaultText"});
+    static const RJsonPath view_model_title_path("likeButtonViewModel.likeButtonViewModel.toggleButtonViewModel.toggleButtonViewModel.defaultButtonViewModel.buttonViewModel.title");
+    static const RJsonPath toggle_text_path("toggleButtonRenderer.defaultText");
+    auto number_or_zero = [] (const std::string &text) -> std::string {
+        if (text.size() && !isdigit(text[0])) return "0"; // Default to "0" if not a number
+        return text;
+    };
 
-    for (auto button : buttons.array_items()) {
-        if (button.has_key("slimMetadataToggleButtonRenderer")) { // legacy?
-            auto get_text = [](RJson button) -> std::string {
-                auto content = get_text_from_object(button["button"]["toggleButtonRenderer"]["defaultText"]);
-                if (content.size() && !isdigit(content[0])) return "0"; // Default to "0" if not a number
-                return content;
-            };
-
-            if (button["slimMetadataToggleButtonRenderer"]["isLike"].bool_value()) {
-                res.like_count_str = get_text(button["slimMetadataToggleButtonRenderer"]);
-            }
-            if (button["slimMetadataToggleButtonRenderer"]["isDislike"].bool_value()) {
-                res.dislike_count_str = get_text(button["slimMetadataToggleButtonRenderer"]);
-            }
-            if (button["slimMetadataToggleButtonRenderer"]["target"]["videoId"].is_valid()) {
-                res.id = button["slimMetadataToggleButtonRenderer"]["target"]["videoId"].string_value();
-            }
+    for (auto button : buttons.array_range()) {
+        RJson renderers[3];
+        button.extract(button_paths, renderers);
+        if (renderers[0].is_valid()) {
+            RJson toggle[4]; // isLike, isDislike, videoId, text
+            renderers[0].extract(toggle_paths, toggle);
+            if (toggle[0].bool_value()) res.like_count_str = number_or_zero(get_text_from_object(toggle[3]));
+            if (toggle[1].bool_value()) res.dislike_count_str = number_or_zero(get_text_from_object(toggle[3]));
+            if (toggle[2].is_valid()) res.id = toggle[2].string_value();
         }
-
-        if (button.has_key("slimMetadataButtonRenderer") && button["slimMetadataButtonRenderer"]["button"].has_key("segmentedLikeDislikeButtonRenderer")) { // old?
-            auto renderer = button["slimMetadataButtonRenderer"]["button"]["segmentedLikeDislikeButtonRenderer"];
-            auto get_text = [](RJson button) -> std::string {
-                auto text = get_text_from_object(button["toggleButtonRenderer"]["defaultText"]);
-                if (text.size() && !isdigit(text[0])) return "0"; // Default to "0" if not a number
-                return text;
-            };
-            res.like_count_str = get_text(renderer["likeButton"]);
-            res.dislike_count_str = get_text(renderer["dislikeButton"]);
+        if (renderers[1].is_valid()) {
+            res.like_count_str = number_or_zero(get_text_from_object(renderers[1]["likeButton"][toggle_text_path]));
+            res.dislike_count_str = number_or_zero(get_text_from_object(renderers[1]["dislikeButton"][toggle_text_path]));
         }
-
-        if (button.has_key("slimMetadataButtonRenderer") && button["slimMetadataButtonRenderer"]["button"].has_key("segmentedLikeDislikeButtonViewModel")) {
-            auto get_text_from_view_model = [](RJson button) -> std::string {
-                auto text = button["slimMetadataButtonRenderer"]["button"]["segmentedLikeDislikeButtonViewModel"]["likeButtonViewModel"]
-                    ["likeButtonViewModel"]["toggleButtonViewModel"]["toggleButtonViewModel"]["defaultButtonViewModel"]["buttonViewModel"]["title"].string_value();
-                if (text.size() && !isdigit(text[0])) return "0"; // Default to "0" if not a number
-                return text;
-            };
-            res.like_count_str = get_text_from_view_model(button);
-            res.dislike_count_str = get_text_from_view_model(button); // Update the dislike count similarly
+        if (renderers[2].is_valid()) {
+            res.like_count_str = number_or_zero(renderers[2][view_model_title_path].string_value());
+            res.dislike_count_str = res.like_count_str; // Update the dislike count similarly
         }
     }
 }
@@ -199,7 +199,7 @@ static void extract_item(RJson content, YouTubeVideoDetail &res) {
 		extract_like_dislike_counts(metadata_renderer["buttons"], res);
 		extract_owner(metadata_renderer["owner"]["slimOwnerRenderer"], res);
 	} else if (content.has_key("compactAutoplayRenderer")) {
-		for (auto j : content["compactAutoplayRenderer"]["contents"].array_items()) if (j.has_key("videoWithContextRenderer"))
+		for (auto j : content["compactAutoplayRenderer"]["contents"].array_range()) if (j.has_key("videoWithContextRenderer"))
 			res.suggestions.push_back(parse_succinct_video(j["videoWithContextRenderer"]));
 	} else if (content.has_key("videoWithContextRenderer"))
 		res.suggestions.push_back(parse_succinct_video(content["videoWithContextRenderer"]));
@@ -211,7 +211,7 @@ static void extract_item(RJson content, YouTubeVideoDetail &res) {
 		YouTubePlaylistSuccinct cur_list;
 		cur_list.title = get_text_from_object(playlist_renderer["title"]);
 		cur_list.video_count_str = get_text_from_object(playlist_renderer["videoCountText"]);
-		for (auto thumbnail : playlist_renderer["thumbnail"]["thumbnails"].array_items())
+		for (auto thumbnail : playlist_renderer["thumbnail"]["thumbnails"].array_range())
 			if (thumbnail["url"].string_value().find("/default.jpg") != std::string::npos) cur_list.thumbnail_url = thumbnail["url"].string_value();
 		
 		cur_list.url = convert_url_to_mobile(playlist_renderer["shareUrl"].string_value());
@@ -269,7 +269,7 @@ void fetch_like_dislike_counts(const std::string &video_id, YouTubeVideoDetail &
     std::map<std::string, std::string> headers;
     auto response = http_get(api_url, headers);
 
-    logger.info("Raw JSON response", response.second);
+    debug_info("Raw JSON response : " + response.second);
 
     if (response.first) {
         rapidjson::Document document;
@@ -283,14 +283,14 @@ void fetch_like_dislike_counts(const std::string &video_id, YouTubeVideoDetail &
                 int likes = data["likes"].int_value();
                 res.like_count_str = var_full_dislike_like_count ? 
                     format_with_commas(likes) : format_count(likes);
-                logger.info("Like count", res.like_count_str);
+                debug_info("Like count : " + res.like_count_str);
             }
 
             if (data.has_key("dislikes")) {
                 int dislikes = data["dislikes"].int_value();
                 res.dislike_count_str = var_full_dislike_like_count ? 
                     format_with_commas(dislikes) : format_count(dislikes);
-                logger.info("Dislike count", res.dislike_count_str);
+                debug_info("Dislike count : " + res.dislike_count_str);
             }
 
         } else {
@@ -308,11 +308,11 @@ void fetch_like_dislike_counts(const std::string &video_id, YouTubeVideoDetail &
 static void extract_metadata(RJson data, YouTubeVideoDetail &res) {
 	{
 		auto contents = data["contents"]["singleColumnWatchNextResults"]["results"]["results"]["contents"];
-		for (auto content : contents.array_items()) {
+		for (auto content : contents.array_range()) {
 			if (content.has_key("itemSectionRenderer")) {
-				for (auto i : content["itemSectionRenderer"]["contents"].array_items()) extract_item(i, res);
+				for (auto i : content["itemSectionRenderer"]["contents"].array_range()) extract_item(i, res);
 			} else if (content.has_key("slimVideoMetadataSectionRenderer")) {
-				for (auto i : content["slimVideoMetadataSectionRenderer"]["contents"].array_items()) {
+				for (auto i : content["slimVideoMetadataSectionRenderer"]["contents"].array_range()) {
 					if (i.has_key("slimVideoInformationRenderer")) res.title = get_text_from_object(i["slimVideoInformationRenderer"]["title"]);
 					if (i.has_key("slimOwnerRenderer")) extract_owner(i["slimOwnerRenderer"], res);
 					if (i.has_key("slimVideoDescriptionRenderer")) res.description = get_text_from_object(i["slimVideoDescriptionRenderer"]["description"]);
@@ -330,7 +330,7 @@ static void extract_metadata(RJson data, YouTubeVideoDetail &res) {
 		res.playlist.author_name = get_text_from_object(playlist_object["ownerName"]);
 		res.playlist.title = playlist_object["title"].string_value();
 		res.playlist.total_videos = playlist_object["totalVideos"].int_value();
-		for (auto playlist_item : playlist_object["contents"].array_items()) {
+		for (auto playlist_item : playlist_object["contents"].array_range()) {
 			if (playlist_item.has_key("playlistPanelVideoRenderer")) {
 				auto renderer = playlist_item["playlistPanelVideoRenderer"];
 				YouTubeVideoSuccinct cur_video = parse_succinct_video(renderer);
@@ -342,20 +342,20 @@ static void extract_metadata(RJson data, YouTubeVideoDetail &res) {
 	}
 	res.comment_continue_type = -1;
 	res.comments_disabled = true;
-	for (auto i : data["engagementPanels"].array_items()) {
-		for (auto j : i["engagementPanelSectionListRenderer"]["content"]["sectionListRenderer"]["continuations"].array_items()) if (j.has_key("reloadContinuationData")) {
+	for (auto i : data["engagementPanels"].array_range()) {
+		for (auto j : i["engagementPanelSectionListRenderer"]["content"]["sectionListRenderer"]["continuations"].array_range()) if (j.has_key("reloadContinuationData")) {
 			res.comment_continue_token = j["reloadContinuationData"]["continuation"].string_value();
 			res.comment_continue_type = 0;
 			res.comments_disabled = false;
 		}
-		for (auto j : i["engagementPanelSectionListRenderer"]["content"]["sectionListRenderer"]["contents"].array_items()) {
-			for (auto k : j["itemSectionRenderer"]["contents"].array_items()) if (k.has_key("continuationItemRenderer")) {
+		for (auto j : i["engagementPanelSectionListRenderer"]["content"]["sectionListRenderer"]["contents"].array_range()) {
+			for (auto k : j["itemSectionRenderer"]["contents"].array_range()) if (k.has_key("continuationItemRenderer")) {
 				res.comment_continue_token = k["continuationItemRenderer"]["continuationEndpoint"]["continuationCommand"]["token"].string_value();
 				res.comment_continue_type = 1;
 				res.comments_disabled = false;
 			}
 		}
-		for (auto j : i["engagementPanelSectionListRenderer"]["content"]["structuredDescriptionContentRenderer"]["items"].array_items()) {
+		for (auto j : i["engagementPanelSectionListRenderer"]["content"]["structuredDescriptionContentRenderer"]["items"].array_range()) {
 			if (j["expandableVideoDescriptionBodyRenderer"].has_key("descriptionBodyText"))
 				res.description = get_text_from_object(j["expandableVideoDescriptionBodyRenderer"]["descriptionBodyText"]);
 			if (j["expandableVideoDescriptionBodyRenderer"].has_key("attributedDescriptionBodyText"))
@@ -381,71 +381,41 @@ YouTubeVideoDetail youtube_load_video_page(std::string url) {
     
     std::string playlist_id = youtube_get_playlist_id_by_url(url);
     
-    std::string video_content = R"({"videoId": "%0", %1"context": {"client": {"hl": "%2","gl": "%3","clientName": "IOS","clientVersion": "19.29.1","deviceMake": "Apple","deviceModel": "19.29.1","osName": "iPhone","userAgent": "com.google.ios.youtube/19.29.1 (iPhone16,2; U; CPU iOS 17_5_1 like Mac OS X;)\"","osVersion": "17.5.1.21F90"}}, "playbackContext": {"contentPlaybackContext": {"signatureTimestamp": %4}}})";
-    video_content = std::regex_replace(video_content, std::regex("%0"), res.id);
-    video_content = std::regex_replace(video_content, std::regex("%1"), playlist_id.empty() ? "" : "\"playlistId\": \"" + playlist_id + "\", ");
-    video_content = std::regex_replace(video_content, std::regex("%2"), language_code);
-    video_content = std::regex_replace(video_content, std::regex("%3"), country_code);
-    video_content = std::regex_replace(video_content, std::regex("%4"), std::to_string(get_sts()));
-
-    std::string post_content = R"({"videoId": "%0", %1"context": {"client": {"hl": "%2","gl": "%3","clientName": "MWEB","clientVersion": "2.20220308.01.00"}}, "playbackContext": {"contentPlaybackContext": {"signatureTimestamp": %4}}})";
-    post_content = std::regex_replace(post_content, std::regex("%0"), res.id);
-    post_content = std::regex_replace(post_content, std::regex("%1"), playlist_id.empty() ? "" : "\"playlistId\": \"" + playlist_id + "\", ");
-    post_content = std::regex_replace(post_content, std::regex("%2"), language_code);
-    post_content = std::regex_replace(post_content, std::regex("%3"), country_code);
-    post_content = std::regex_replace(post_content, std::regex("%4"), std::to_string(get_sts()));
+    // %1 is a raw JSON fragment (the playlist id member or nothing), %4 a number
+    static const RequestTemplate video_template(R"({"videoId": "%0", %1"context": {"client": {"hl": "%2","gl": "%3","clientName": "IOS","clientVersion": "19.29.1","deviceMake": "Apple","deviceModel": "19.29.1","osName": "iPhone","userAgent": "com.google.ios.youtube/19.29.1 (iPhone16,2; U; CPU iOS 17_5_1 like Mac OS X;)\"","osVersion": "17.5.1.21F90"}}, "playbackContext": {"contentPlaybackContext": {"signatureTimestamp": %4}}})");
+    static const RequestTemplate post_template(R"({"videoId": "%0", %1"context": {"client": {"hl": "%2","gl": "%3","clientName": "MWEB","clientVersion": "2.20220308.01.00"}}, "playbackContext": {"contentPlaybackContext": {"signatureTimestamp": %4}}})");
+    std::string playlist_member;
+    if (!playlist_id.empty()) {
+        playlist_member = "\"playlistId\": \"";
+        append_json_escaped(playlist_member, playlist_id);
+        playlist_member += "\", ";
+    }
+    std::string sts_str = std::to_string(get_sts());
+    std::string video_content = video_template.render({res.id, RequestTemplate::raw(playlist_member), language_code, country_code, RequestTemplate::raw(sts_str)});
+    std::string post_content = post_template.render({res.id, RequestTemplate::raw(playlist_member), language_code, country_code, RequestTemplate::raw(sts_str)});
 
     std::string urls[2] = {
         get_innertube_api_url("next"),
         get_innertube_api_url("player")
     };
 
-    #ifdef _WIN32
-    std::string json_str[2];
+    auto results = http_post_json_multi({{urls[0], post_content}, {urls[1], video_content}});
     bool success = true;
     for (int i = 0; i < 2; i++) {
-        std::string json_data;
-        if (!http_post_json(urls[i], i == 0 ? post_content : video_content, json_data)) {
-            res.error = "[v-#" + std::to_string(i) + "] Failed to get data";
+        if (!results[i].first) {
+            res.error = "[v-#" + std::to_string(i) + "] Network request failed";
+            debug_error(res.error);
             success = false;
-        } else {
-            parse_json_destructive(&json_data[0],
-                [&](Document &json_root, RJson data) {
-                    if (i == 0) extract_metadata(data, res);
-                    else extract_player_data(json_root, data, res);
-                },
-                [&](const std::string &error) {
-                    res.error = "[v-#" + std::to_string(i) + "] " + error;
-                    debug_error(res.error);
-                }
-            );
-        }
-    }
-    if (success) debug_info(res.title.empty() ? "preason: " + res.playability_reason : res.title);
-    #else
-    debug_info("accessing(multi)...");
-    std::vector<NetworkResult> results;
-    bool success = true;
-    {
-        std::vector<HttpRequest> requests;
-        requests.push_back(http_post_json_request(urls[0], post_content));   
-        requests.push_back(http_post_json_request(urls[1], video_content));  
-
-        results = thread_network_session_list.perform(requests);
-        for (int i = 0; i < 2; i++) {
-            if (results[i].fail) {
-                res.error = "[v-#" + std::to_string(i) + "] Network request failed";
-                debug_error(res.error);
-                success = false;
-            }
         }
     }
 
     if (success) {
         for (int i = 0; i < 2; i++) {
-            if (!results[i].data.empty()) {
-                results[i].data.push_back('\0');
-                parse_json_destructive((char *) &results[i].data[0],
+            if (!results[i].second.empty()) {
+                // the player response is mostly things we don't use (storyboards, microformat, ad placements...)
+                static const std::vector<const char *> player_paths = {"playabilityStatus", "videoDetails", "streamingData"};
+                static const std::vector<const char *> next_paths = {"contents.singleColumnWatchNextResults", "engagementPanels"};
+                parse_json_selective_destructive(&results[i].second[0], i == 0 ? next_paths : player_paths,
                     [&](Document &json_root, RJson data) {
                         if (i == 0) extract_metadata(data, res);
                         else extract_player_data(json_root, data, res);
@@ -464,22 +434,8 @@ YouTubeVideoDetail youtube_load_video_page(std::string url) {
     }
 
 	if (res.id != "") res.succinct_thumbnail_url = youtube_get_video_thumbnail_url_by_id(res.id);
-#	ifndef _WIN32
-	if (res.title != "" && res.id != "") {
-		HistoryVideo video;
-		video.id = res.id;
-		video.title = res.title;
-		video.author_name = res.author.name;
-		video.length_text = Util_convert_seconds_to_time((double) res.duration_ms / 1000);
-		video.my_view_count = 1;
-		video.last_watch_time = time(NULL);
-		add_watched_video(video);
-		misc_tasks_request(TASK_SAVE_HISTORY);
-	}
-#	endif
 
     if (success) debug_info(res.title.empty() ? "preason: " + res.playability_reason : res.title);
-    #endif
     
     return res;
 }
@@ -491,17 +447,14 @@ void YouTubeVideoDetail::load_more_suggestions() {
 	}
 	
 	// POST to get more results
-	std::string post_content = R"({"context": {"client": {"hl": "%0", "gl": "%1", "clientName": "MWEB", "clientVersion": "2.20210711.08.00", "utcOffsetMinutes": 0}, "request": {}, "user": {}}, "continuation": ")"
-		+ suggestions_continue_token + "\"}";
-	post_content = std::regex_replace(post_content, std::regex("%0"), language_code);
-	post_content = std::regex_replace(post_content, std::regex("%1"), country_code);
+	std::string post_content = continuation_template.render({language_code, country_code, suggestions_continue_token});
 	
 	access_and_parse_json(
 		[&] () { return http_post_json(get_innertube_api_url("next"), post_content); },
 		[&] (Document &, RJson yt_result) {
 			suggestions_continue_token = "";
-			for (auto i : yt_result["onResponseReceivedEndpoints"].array_items())
-				for (auto j : i["appendContinuationItemsAction"]["continuationItems"].array_items())
+			for (auto i : yt_result["onResponseReceivedEndpoints"].array_range())
+				for (auto j : i["appendContinuationItemsAction"]["continuationItems"].array_range())
 					extract_item(j, *this);
 		},
 		[&] (const std::string &error) { debug_error((this->error = "[v-sug+] " + error)); }
@@ -532,7 +485,7 @@ void YouTubeVideoDetail::load_more_comments() {
 	auto parse_comment_thread_renderer = [&] (RJson comment_thread_renderer) {
 		auto cur_comment = extract_comment_from_comment_renderer(comment_thread_renderer["commentThreadRenderer"]["comment"]["commentRenderer"], 48);
 		// get the icon of the author with minimum size
-		for (auto i : comment_thread_renderer["commentThreadRenderer"]["replies"]["commentRepliesRenderer"]["contents"].array_items()) if (i.has_key("continuationItemRenderer"))
+		for (auto i : comment_thread_renderer["commentThreadRenderer"]["replies"]["commentRepliesRenderer"]["contents"].array_range()) if (i.has_key("continuationItemRenderer"))
 			cur_comment.replies_continue_token = i["continuationItemRenderer"]["button"]["buttonRenderer"]["command"]["continuationCommand"]["token"].string_value();
 		return cur_comment;
 	};
@@ -545,10 +498,10 @@ void YouTubeVideoDetail::load_more_comments() {
 			[&] (Document &, RJson yt_result) {
 				comment_continue_type = -1;
 				comment_continue_token = "";
-				for (auto i : yt_result.array_items()) {
-					for (auto comment : i["response"]["continuationContents"]["commentSectionContinuation"]["items"].array_items()) if (comment.has_key("commentThreadRenderer"))
+				for (auto i : yt_result.array_range()) {
+					for (auto comment : i["response"]["continuationContents"]["commentSectionContinuation"]["items"].array_range()) if (comment.has_key("commentThreadRenderer"))
 						comments.push_back(parse_comment_thread_renderer(comment));
-					for (auto j : i["response"]["continuationContents"]["commentSectionContinuation"]["continuations"].array_items()) if (j.has_key("nextContinuationData")) {
+					for (auto j : i["response"]["continuationContents"]["commentSectionContinuation"]["continuations"].array_range()) if (j.has_key("nextContinuationData")) {
 						comment_continue_token = j["nextContinuationData"]["continuation"].string_value();
 						comment_continue_type = 0;
 					}
@@ -557,21 +510,18 @@ void YouTubeVideoDetail::load_more_comments() {
 			[&] (const std::string &error) { debug_error((this->error = "[v-com+0] " + error)); }
 		);
 	} else {
-		std::string post_content = R"({"context": {"client": {"hl": "%0", "gl": "%1", "clientName": "MWEB", "clientVersion": "2.20210711.08.00", "utcOffsetMinutes": 0}, "request": {}, "user": {}}, "continuation": ")"
-			+ comment_continue_token + "\"}";
-		post_content = std::regex_replace(post_content, std::regex("%0"), language_code);
-		post_content = std::regex_replace(post_content, std::regex("%1"), country_code);
+		std::string post_content = continuation_template.render({language_code, country_code, comment_continue_token});
 		
 		access_and_parse_json(
 			[&] () { return http_post_json(get_innertube_api_url("next"), post_content); },
 			[&] (Document &, RJson yt_result) {
 				comment_continue_type = -1;
 				comment_continue_token = "";
-				for (auto i : yt_result["onResponseReceivedEndpoints"].array_items()) {
+				for (auto i : yt_result["onResponseReceivedEndpoints"].array_range()) {
 					RJson continuation_items = i.has_key("reloadContinuationItemsCommand") ? i["reloadContinuationItemsCommand"]["continuationItems"]
 						: i["appendContinuationItemsAction"]["continuationItems"];
 					
-					for (auto comment : continuation_items.array_items()) {
+					for (auto comment : continuation_items.array_range()) {
 						if (comment.has_key("commentThreadRenderer")) comments.push_back(parse_comment_thread_renderer(comment));
 						if (comment.has_key("continuationItemRenderer")) {
 							comment_continue_token = comment["continuationItemRenderer"]["continuationEndpoint"]["continuationCommand"]["token"].string_value();
@@ -591,17 +541,14 @@ void YouTubeVideoDetail::Comment::load_more_replies() {
 		return;
 	}
 	
-	std::string post_content = R"({"context": {"client": {"hl": "%0", "gl": "%1", "clientName": "MWEB", "clientVersion": "2.20210711.08.00", "utcOffsetMinutes": 0}, "request": {}, "user": {}}, "continuation": ")"
-		+ replies_continue_token + "\"}";
-	post_content = std::regex_replace(post_content, std::regex("%0"), language_code);
-	post_content = std::regex_replace(post_content, std::regex("%1"), country_code);
+	std::string post_content = continuation_template.render({language_code, country_code, replies_continue_token});
 	
 	access_and_parse_json(
 		[&] () { return http_post_json(get_innertube_api_url("next"), post_content); },
 		[&] (Document &, RJson yt_result) {
 			replies_continue_token = "";
-			for (auto i : yt_result["onResponseReceivedEndpoints"].array_items()) {
-				for (auto item : i["appendContinuationItemsAction"]["continuationItems"].array_items()) {
+			for (auto i : yt_result["onResponseReceivedEndpoints"].array_range()) {
+				for (auto item : i["appendContinuationItemsAction"]["continuationItems"].array_range()) {
 					if (item.has_key("commentRenderer")) replies.push_back(extract_comment_from_comment_renderer(item["commentRenderer"], 32));
 					if (item.has_key("continuationItemRenderer"))
 						replies_continue_token = item["continuationItemRenderer"]["button"]["buttonRenderer"]["command"]["continuationCommand"]["token"].string_value();
@@ -643,12 +590,12 @@ void YouTubeVideoDetail::load_caption(const std::string &base_lang_id, const std
 		[&] () { return http_get(url); },
 		[&] (Document &, RJson yt_result) {
 			std::vector<YouTubeVideoDetail::CaptionPiece> cur_caption;
-			for (auto caption_piece : yt_result["events"].array_items()) {
+			for (auto caption_piece : yt_result["events"].array_range()) {
 				if (!caption_piece.has_key("segs")) continue;
 				YouTubeVideoDetail::CaptionPiece cur_caption_piece;
 				cur_caption_piece.start_time = caption_piece["tStartMs"].int_value() / 1000.0;
 				cur_caption_piece.end_time = cur_caption_piece.start_time + caption_piece["dDurationMs"].int_value() / 1000.0;
-				for (auto seg : caption_piece["segs"].array_items()) cur_caption_piece.content += seg["utf8"].string_value();
+				for (auto seg : caption_piece["segs"].array_range()) cur_caption_piece.content += seg["utf8"].string_value();
 				
 				cur_caption.push_back(cur_caption_piece);
 			}
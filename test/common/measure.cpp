@@ -0,0 +1,82 @@
+// time, heap allocation and peak heap measurement shared by the host benchmarks (see Makefile.host)
+#include <chrono>
+#include <cstdio>
+#include <malloc.h>
+#include "measure.hpp"
+
+// every heap allocation of the process goes through these (glibc), including the ones of operator new and rapidjson
+static size_t alloc_num = 0;
+static size_t alloc_bytes = 0;
+static size_t live_bytes = 0;
+static size_t peak_live_bytes = 0;
+
+extern "C" {
+	void *__libc_malloc(size_t size);
+	void *__libc_calloc(size_t num, size_t size);
+	void *__libc_realloc(void *ptr, size_t size);
+	void __libc_free(void *ptr);
+
+	static void record_alloc(void *ptr) {
+		if (!ptr) return;
+		size_t size = malloc_usable_size(ptr);
+		alloc_num++;
+		alloc_bytes += size;
+		live_bytes += size;
+		if (peak_live_bytes < live_bytes) peak_live_bytes = live_bytes;
+	}
+	static void record_free(void *ptr) {
+		if (ptr) live_bytes -= malloc_usable_size(ptr);
+	}
+	void *malloc(size_t size) {
+		void *res = __libc_malloc(size);
+		record_alloc(res);
+		return res;
+	}
+	void *calloc(size_t num, size_t size) {
+		void *res = __libc_calloc(num, size);
+		record_alloc(res);
+		return res;
+	}
+	void *realloc(void *ptr, size_t size) {
+		record_free(ptr);
+		void *res = __libc_realloc(ptr, size);
+		if (res) record_alloc(res);
+		else if (ptr && size) { // failed, `ptr` is still alive
+			live_bytes += malloc_usable_size(ptr);
+		}
+		return res;
+	}
+	void free(void *ptr) {
+		record_free(ptr);
+		__libc_free(ptr);
+	}
+}
+
+volatile size_t bench_sink = 0;
+
+Measurement measure(int iterations, const std::function<void ()> &func) {
+	func(); // warm-up (static data, arenas and caches of the measured code)
+
+	size_t alloc_num_start = alloc_num;
+	size_t alloc_bytes_start = alloc_bytes;
+	size_t live_bytes_start = live_bytes;
+	peak_live_bytes = live_bytes;
+	auto time_start = std::chrono::steady_clock::now();
+	for (int i = 0; i < iterations; i++) func();
+	auto time_end = std::chrono::steady_clock::now();
+
+	Measurement res;
+	res.us = std::chrono::duration<double, std::micro>(time_end - time_start).count() / iterations;
+	res.allocs = (double) (alloc_num - alloc_num_start) / iterations;
+	res.bytes = (double) (alloc_bytes - alloc_bytes_start) / iterations;
+	res.peak_bytes = peak_live_bytes - live_bytes_start;
+	return res;
+}
+
+void print_header(const char *title) {
+	printf("\n%s\n", title);
+	printf("%-44s %12s %12s %14s %14s\n", "", "us/run", "allocs/run", "bytes/run", "peak bytes");
+}
+void print_measurement(const std::string &name, const Measurement &m) {
+	printf("%-44s %12.1f %12.1f %14.0f %14zu\n", name.c_str(), m.us, m.allocs, m.bytes, m.peak_bytes);
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include <functional>
+#include <string>
+
+// time, heap allocations and peak heap usage of a piece of code
+// every malloc()/calloc()/realloc()/free() of the process is counted (measure.cpp replaces them), including the ones of operator new
+
+struct Measurement {
+	double us; // per iteration
+	double allocs;
+	double bytes;
+	size_t peak_bytes; // above what was live before the first iteration
+};
+// results of the measured code are stored here so that the compiler cannot drop the code as unused
+extern volatile size_t bench_sink;
+// runs `func` once to warm up, then `iterations` times
+Measurement measure(int iterations, const std::function<void ()> &func);
+
+void print_header(const char *title);
+void print_measurement(const std::string &name, const Measurement &m);
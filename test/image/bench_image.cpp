@@ -0,0 +1,34 @@
+// measures the image code used for thumbnails : time, heap allocations and peak heap usage per run
+// usage : bench_image [fixture directory] [iterations]
+// (each benchmark runs `iterations` times a per-case factor)
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include "bench_image.hpp"
+
+static std::string fixture_dir = "test/image/fixtures";
+const std::string &get_fixture(const std::string &name) {
+	static std::map<std::string, std::string> cache;
+	if (!cache.count(name)) {
+		std::ifstream file(fixture_dir + "/" + name, std::ios::binary);
+		std::stringstream sstream;
+		sstream << file.rdbuf();
+		cache[name] = sstream.str();
+		if (cache[name].empty()) fprintf(stderr, "fixture %s missing or empty\n", name.c_str());
+	}
+	return cache[name];
+}
+
+int main(int argc, char **argv) {
+	if (argc >= 2) fixture_dir = argv[1];
+	int iterations = argc >= 3 ? atoi(argv[2]) : 50;
+	if (iterations <= 0) iterations = 1;
+
+	bool ok = true;
+	ok &= bench_image_kernels(iterations);
+	ok &= bench_image_decode(iterations);
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,11 @@
+#pragma once
+#include <string>
+#include "measure.hpp"
+
+// the content of a file in the fixture directory (read once, empty if missing)
+const std::string &get_fixture(const std::string &name);
+
+// benchmarks comparing the image code with what it used to do, one bench_*.cpp each
+// they run `iterations` times a per-case factor and return false if the two versions disagree
+bool bench_image_kernels(int iterations);
+bool bench_image_decode(int iterations);
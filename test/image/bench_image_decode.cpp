@@ -0,0 +1,113 @@
+// Image_decode() with the thumbnail loader's crop vs what the loader used to do, per ThumbnailType, on the JPEGs in fixtures/
+// the old path converted the whole image into a second buffer, then memmove()d the 16:9 crop to the front and realloc()ed it
+// (channel banners were not trimmed at all back then, so that row compares 1060 columns against 1024)
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include "stb_image/stb_image.h"
+#include "image.hpp"
+#include "bench_image.hpp"
+
+// mirrors ThumbnailType in thumbnail_loader.hpp, which can't be included off-device
+enum class ThumbnailType {
+	DEFAULT,
+	VIDEO_THUMBNAIL,
+	VIDEO_BANNER,
+	ICON,
+};
+
+// the crop of load_thumbnail() in thumbnail_loader.cpp
+static ImageRegion thumbnail_crop(ThumbnailType type, int w, int h) {
+	if (type == ThumbnailType::VIDEO_THUMBNAIL && h > w * 9 / 16 + 1) {
+		int new_h = w * 9 / 16;
+		return {0, (h - new_h) / 2, w, new_h};
+	}
+	if (type == ThumbnailType::VIDEO_BANNER && w > 1024) return {(w - 1024) / 2, 0, 1024, h};
+	return {0, 0, w, h};
+}
+
+static u8 *old_decode(const std::string &input, int *w, int *h, ThumbnailType type) {
+	int image_ch = 0;
+	u8 *rgb_image = stbi_load_from_memory((const u8 *) input.data(), input.size(), w, h, &image_ch, STBI_rgb);
+	if (!rgb_image) return NULL;
+	u8 *decoded_data = (u8 *) malloc(*w * *h * 2);
+	if (!decoded_data) {
+		stbi_image_free(rgb_image);
+		return NULL;
+	}
+	Image_rgb888_to_bgr565(rgb_image, (u16 *) decoded_data, *w * *h);
+	stbi_image_free(rgb_image);
+
+	if (type == ThumbnailType::VIDEO_THUMBNAIL && *h > *w * 9 / 16 + 1) {
+		int new_h = *w * 9 / 16;
+		int vertical_offset = (*h - new_h) / 2;
+		memmove(decoded_data, decoded_data + vertical_offset * *w * 2, new_h * *w * 2);
+		*h = new_h;
+	}
+	if (type == ThumbnailType::ICON) Image_round_icon((u16 *) decoded_data, *w, *h, false);
+	u8 *shrunk = (u8 *) realloc(decoded_data, *w * *h * 2);
+	return shrunk ? shrunk : decoded_data;
+}
+static u8 *new_decode(const std::string &input, int *w, int *h, ThumbnailType type) {
+	u8 *decoded_data = Image_decode((u8 *) input.data(), input.size(), w, h,
+		[type] (int w, int h) { return thumbnail_crop(type, w, h); });
+	if (decoded_data && type == ThumbnailType::ICON) Image_round_icon((u16 *) decoded_data, *w, *h, false);
+	return decoded_data;
+}
+
+bool bench_image_decode(int iterations) {
+	bool ok = true;
+	struct Case {
+		const char *fixture;
+		ThumbnailType type;
+		const char *type_name;
+	};
+	const Case cases[] = {
+		{"default.jpg", ThumbnailType::VIDEO_THUMBNAIL, "VIDEO_THUMBNAIL"}, // 120x90 -> 120x67
+		{"hqdefault.jpg", ThumbnailType::VIDEO_THUMBNAIL, "VIDEO_THUMBNAIL"}, // 480x360 -> 480x270
+		{"mqdefault.jpg", ThumbnailType::DEFAULT, "DEFAULT"}, // 320x180
+		{"icon_88.jpg", ThumbnailType::ICON, "ICON"},
+		{"icon_176.jpg", ThumbnailType::ICON, "ICON"},
+		{"banner.jpg", ThumbnailType::VIDEO_BANNER, "VIDEO_BANNER"}, // 1060x175 -> 1024x175
+	};
+	print_header("thumbnail decode (jpeg -> bgr565, crop, icon rounding)");
+	for (auto &cur_case : cases) {
+		const std::string &input = get_fixture(cur_case.fixture);
+		if (input.empty()) {
+			ok = false;
+			continue;
+		}
+		std::string name = std::string(cur_case.fixture) + " " + cur_case.type_name;
+		int old_w, old_h, new_w, new_h;
+		// the result is freed right away, as its size is the same for both (except banners) and the peak during the decode is what matters
+		print_measurement(name + ", old", measure(iterations, [&] () {
+			u8 *res = old_decode(input, &old_w, &old_h, cur_case.type);
+			bench_sink += res ? res[0] : 0;
+			free(res);
+		}));
+		print_measurement(name + ", new", measure(iterations, [&] () {
+			u8 *res = new_decode(input, &new_w, &new_h, cur_case.type);
+			bench_sink += res ? res[0] : 0;
+			free(res);
+		}));
+
+		// the new result must be the old one, or its center 1024 columns for banners
+		u8 *old_res = old_decode(input, &old_w, &old_h, cur_case.type);
+		u8 *new_res = new_decode(input, &new_w, &new_h, cur_case.type);
+		bool same = old_res && new_res;
+		if (same) {
+			ImageRegion region = thumbnail_crop(cur_case.type, old_w, old_h);
+			same = new_w == region.width && new_h == old_h;
+			for (int i = 0; same && i < new_h; i++)
+				same = !memcmp(new_res + i * new_w * 2, old_res + (i * old_w + region.x) * 2, new_w * 2);
+		}
+		if (!same) {
+			fprintf(stderr, "image decode : %s differs from the old path\n", name.c_str());
+			ok = false;
+		}
+		free(old_res);
+		free(new_res);
+	}
+	return ok;
+}
@@ -0,0 +1,63 @@
+// the batched Image_rgb888_to_bgr565() / Image_round_icon() vs the per-pixel loops, on the thumbnail sizes the app decodes
+// note that the host compiler may vectorize the loops differently than devkitARM does for the ARM11, so only the ratio is meaningful
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include "image_kernels.hpp"
+#include "bench_image.hpp"
+
+bool bench_image_kernels(int iterations) {
+	iterations *= 10;
+	bool ok = true;
+	// default.jpg, mqdefault.jpg and a channel banner
+	const int sizes[][2] = {{120, 90}, {320, 180}, {1060, 175}};
+
+	print_header("rgb888 -> bgr565 conversion");
+	for (auto size : sizes) {
+		int pixel_num = size[0] * size[1];
+		std::vector<u8> src(pixel_num * 3);
+		for (auto &byte : src) byte = rand() & 0xFF;
+		std::vector<u16> scalar_dst(pixel_num), batched_dst(pixel_num);
+		std::string name = std::to_string(size[0]) + "x" + std::to_string(size[1]);
+		print_measurement(name + " scalar", measure(iterations, [&] () {
+			Image_rgb888_to_bgr565_scalar(src.data(), scalar_dst.data(), pixel_num);
+			bench_sink += scalar_dst[pixel_num / 2];
+		}));
+		print_measurement(name + " batched", measure(iterations, [&] () {
+			Image_rgb888_to_bgr565(src.data(), batched_dst.data(), pixel_num);
+			bench_sink += batched_dst[pixel_num / 2];
+		}));
+		if (scalar_dst != batched_dst) {
+			fprintf(stderr, "image kernels : conversion mismatch at %s\n", name.c_str());
+			ok = false;
+		}
+	}
+
+	// the icon sizes the app requests, and the thumbnail sizes in case a non-square image is passed
+	const int icon_sizes[][2] = {{88, 88}, {176, 176}, {120, 90}, {320, 180}, {1060, 175}};
+	print_header("icon rounding");
+	for (auto size : icon_sizes) {
+		int pixel_num = size[0] * size[1];
+		std::vector<u16> image(pixel_num);
+		for (auto &pixel : image) pixel = rand() & 0xFFFF;
+		// the kernels work in place, so each run starts from a fresh copy (the copy is timed for both)
+		std::vector<u16> scalar_image, batched_image;
+		std::string name = std::to_string(size[0]) + "x" + std::to_string(size[1]);
+		print_measurement(name + " scalar", measure(iterations, [&] () {
+			scalar_image = image;
+			Image_round_icon_scalar(scalar_image.data(), size[0], size[1], false);
+			bench_sink += scalar_image[0];
+		}));
+		print_measurement(name + " batched", measure(iterations, [&] () {
+			batched_image = image;
+			Image_round_icon(batched_image.data(), size[0], size[1], false);
+			bench_sink += batched_image[0];
+		}));
+		if (scalar_image != batched_image) {
+			fprintf(stderr, "image kernels : icon rounding mismatch at %s\n", name.c_str());
+			ok = false;
+		}
+	}
+	return ok;
+}
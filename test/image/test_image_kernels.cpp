@@ -0,0 +1,142 @@
+// checks the batched pixel kernels against the per-pixel loops they replaced, bit for bit
+// usage : test_image_kernels
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "image_kernels.hpp"
+
+static int check_num = 0;
+static int fail_num = 0;
+#define CHECK(cond, what) do { \
+	check_num++; \
+	if (!(cond)) { \
+		fail_num++; \
+		std::cerr << __FILE__ << ":" << __LINE__ << " : CHECK(" #cond ") failed : " << (what) << std::endl; \
+	} \
+} while (0)
+
+// the thumbnail sizes : default.jpg, mqdefault.jpg and a channel banner
+static const int SIZES[][2] = {{120, 90}, {320, 180}, {1060, 175}};
+
+static std::vector<u8> random_bytes(size_t size) {
+	std::vector<u8> res(size);
+	for (auto &byte : res) byte = rand() & 0xFF;
+	return res;
+}
+
+// the conversion loop of Image_decode() before the kernels were batched
+static void original_rgb888_to_bgr565(const u8 *rgb_image, u16 *out_head, int pixel_num) {
+	int in_size = pixel_num * 3;
+	for (int i = 0; i < in_size; i += 3) {
+		u16 r = rgb_image[i + 0];
+		u16 g = rgb_image[i + 1];
+		u16 b = rgb_image[i + 2];
+		*out_head++ = ((r & 0b11111000) << 8) | ((g & 0b11111100) << 3) | (b >> 3);
+	}
+}
+// the icon rounding loop of the thumbnail loader before it moved to Image_round_icon()
+static void original_round_icon(u8 *decoded_data, int w, int h, bool var_night_mode) {
+	float radius = (float) h / 2;
+	for (int i = 0; i < h; i++) for (int j = 0; j < w; j++) {
+		float distance = std::hypot(radius - (i + 0.5), radius - (j + 0.5));
+		u8 b = decoded_data[(i * w + j) * 2 + 0] & ((1 << 5) - 1);
+		u8 g = (decoded_data[(i * w + j) * 2 + 0] >> 5) | ((decoded_data[(i * w + j) * 2 + 1] & ((1 << 3) - 1)) << 3);
+		u8 r = decoded_data[(i * w + j) * 2 + 1] >> 3;
+		float proportion = std::max(0.0f, std::min(1.0f, radius + 0.5f - distance));
+		b = b * proportion + (var_night_mode ? 0 : ((1 << 5) - 1)) * (1 - proportion);
+		g = g * proportion + (var_night_mode ? 0 : ((1 << 6) - 1)) * (1 - proportion);
+		r = r * proportion + (var_night_mode ? 0 : ((1 << 5) - 1)) * (1 - proportion);
+		decoded_data[(i * w + j) * 2 + 0] = b | g << 5;
+		decoded_data[(i * w + j) * 2 + 1] = g >> 3 | r << 3;
+	}
+}
+
+static void check_conversion(const u8 *src, int pixel_num, const std::string &what) {
+	std::vector<u16> expected(pixel_num), scalar(pixel_num), batched(pixel_num);
+	original_rgb888_to_bgr565(src, expected.data(), pixel_num);
+	Image_rgb888_to_bgr565_scalar(src, scalar.data(), pixel_num);
+	Image_rgb888_to_bgr565(src, batched.data(), pixel_num);
+	CHECK(scalar == expected, "scalar, " + what);
+	CHECK(batched == expected, "batched, " + what);
+}
+
+static void test_conversion() {
+	for (auto size : SIZES) {
+		int pixel_num = size[0] * size[1];
+		auto src = random_bytes(pixel_num * 3);
+		check_conversion(src.data(), pixel_num, std::to_string(size[0]) + "x" + std::to_string(size[1]));
+	}
+	// every tail length of the 8-pixel groups, from every byte alignment of the source
+	auto src = random_bytes(64 * 3 + 3);
+	for (int offset = 0; offset < 4; offset++) for (int pixel_num = 0; pixel_num <= 64; pixel_num++)
+		check_conversion(src.data() + offset, pixel_num, std::to_string(pixel_num) + " pixels at offset " + std::to_string(offset));
+	// a destination that is only 2-byte aligned
+	for (auto size : SIZES) {
+		int pixel_num = size[0] * size[1];
+		auto src = random_bytes(pixel_num * 3);
+		std::vector<u16> expected(pixel_num), batched(pixel_num + 1);
+		original_rgb888_to_bgr565(src.data(), expected.data(), pixel_num);
+		Image_rgb888_to_bgr565(src.data(), batched.data() + 1, pixel_num);
+		CHECK(std::vector<u16>(batched.begin() + 1, batched.end()) == expected, "unaligned destination, " + std::to_string(size[0]) + "x" + std::to_string(size[1]));
+	}
+}
+
+// converts `region` of a width x height RGB888 image in place row by row, as Image_decode() does with a crop
+static void test_in_place_crop() {
+	struct Crop {
+		int width, height, x, y, region_width, region_height;
+	};
+	const Crop crops[] = {
+		{120, 90, 0, 11, 120, 67}, // the 16:9 crop of default.jpg (contiguous)
+		{320, 180, 0, 0, 320, 180}, // no crop
+		{1060, 175, 18, 0, 1024, 175}, // the center 1024 columns of a banner
+		{101, 77, 3, 5, 57, 33}, // odd sizes and offsets
+		{33, 9, 1, 1, 31, 7},
+	};
+	for (auto &crop : crops) {
+		auto image = random_bytes(crop.width * crop.height * 3);
+		std::vector<u16> expected(crop.region_width * crop.region_height);
+		for (int i = 0; i < crop.region_height; i++)
+			original_rgb888_to_bgr565(&image[((crop.y + i) * crop.width + crop.x) * 3], &expected[i * crop.region_width], crop.region_width);
+
+		u16 *bgr_image = (u16 *) image.data();
+		if (crop.x == 0 && crop.region_width == crop.width)
+			Image_rgb888_to_bgr565(&image[crop.y * crop.width * 3], bgr_image, crop.region_width * crop.region_height);
+		else for (int i = 0; i < crop.region_height; i++)
+			Image_rgb888_to_bgr565(&image[((crop.y + i) * crop.width + crop.x) * 3], bgr_image + i * crop.region_width, crop.region_width);
+		CHECK(!memcmp(bgr_image, expected.data(), expected.size() * 2),
+			"in place, " + std::to_string(crop.width) + "x" + std::to_string(crop.height) + " -> " + std::to_string(crop.region_width) + "x" + std::to_string(crop.region_height));
+	}
+}
+
+static void check_round_icon(int width, int height, bool dark_background) {
+	auto image = random_bytes(width * height * 2);
+	auto expected = image, scalar = image, batched = image;
+	original_round_icon(expected.data(), width, height, dark_background);
+	Image_round_icon_scalar((u16 *) scalar.data(), width, height, dark_background);
+	Image_round_icon((u16 *) batched.data(), width, height, dark_background);
+	std::string what = std::to_string(width) + "x" + std::to_string(height) + (dark_background ? " dark" : " light");
+	CHECK(scalar == expected, "scalar, " + what);
+	CHECK(batched == expected, "batched, " + what);
+}
+
+static void test_round_icon() {
+	// every square size up to the largest icon the app requests (176x176) and a bit beyond, where the span edges fall on every fraction
+	for (int size = 1; size <= 256; size++) for (bool dark : {false, true}) check_round_icon(size, size, dark);
+	// the radius comes from the height, so wider and narrower images too
+	for (auto size : SIZES) for (bool dark : {false, true}) check_round_icon(size[0], size[1], dark);
+	for (int width = 1; width <= 64; width++) for (int height : {1, 2, 7, 32, 33}) check_round_icon(width, height, width & 1);
+}
+
+int main() {
+	srand(1);
+	test_conversion();
+	test_in_place_crop();
+	test_round_icon();
+
+	std::cout << check_num << " checks, " << fail_num << " failures" << std::endl;
+	return fail_num ? 1 : 0;
+}
@@ -0,0 +1,16 @@
+#pragma once
+#include <functional>
+#include <string>
+#include "measure.hpp"
+
+// the content of a file in the fixture directory (read once)
+const std::string &get_fixture(const std::string &name);
+
+// micro benchmarks comparing a part of the parser with what it used to do, one bench_*.cpp each
+// they run `iterations` times a per-case factor and return false if the two versions disagree
+bool bench_request_template(int iterations);
+bool bench_selective_parse(int iterations);
+bool bench_json_arena(int iterations);
+bool bench_json_path(int iterations);
+bool bench_succinct_item(int iterations);
+bool bench_initial_json(int iterations);
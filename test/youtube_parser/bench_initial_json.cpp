@@ -0,0 +1,175 @@
+// extract_initial_json() vs the ytInitialData extraction of the channel page it replaced
+// (find() for `var_name =` plus std::regex for window["var_name"], then a copy of the json out of the page, unescaped char by char)
+// on the channel page fixture in its three forms : var ytInitialData = '...', var ytInitialData = {...}, window["ytInitialData"] = '...'
+#include <cstdio>
+#include <regex>
+#include "internal_common.hpp"
+#include "bench.hpp"
+
+namespace old_extract { // as it was before extract_initial_json()
+	std::string remove_garbage(const std::string &str, size_t start) {
+		while (start < str.size() && str[start] == ' ') start++;
+		if (start >= str.size()) {
+			debug_warning("remove_garbage : empty");
+			return "";
+		}
+		if (str[start] == '\'') {
+			std::string res_str;
+			size_t pos = start + 1;
+			for (; pos < str.size(); pos++) {
+				if (str[pos] == '\\') {
+					if (pos + 1 == str.size()) break;
+					if (str[pos + 1] == 'x') {
+						if (pos + 3 >= str.size()) break;
+						int char_code = 0;
+						bool ok = true;
+						for (int i = 0; i < 2; i++) {
+							if (pos + 2 + i >= str.size()) {
+								ok = false;
+								break;
+							}
+							char cur_char = str[pos + 2 + i];
+							char_code <<= 4; // * 16
+							if ('0' <= cur_char && cur_char <= '9') char_code += cur_char - '0';
+							else if ('a' <= cur_char && cur_char <= 'f') char_code += cur_char - 'a' + 10;
+							else if ('A' <= cur_char && cur_char <= 'F') char_code += cur_char - 'A' + 10;
+							else {
+								ok = false;
+								break;
+							}
+						}
+						if (!ok) {
+							debug_error("remove_garbage : failed to parse " + str.substr(pos + 2, 2) + " as hex");
+							return "";
+						}
+						res_str.push_back(char_code);
+						pos += 3;
+					} else {
+						res_str.push_back(str[pos + 1]);
+						pos++;
+					}
+				} else if (str[pos] == '\'') break;
+				else res_str.push_back(str[pos]);
+			}
+			return res_str;
+		} else if (str[start] == '(' || str[start] == '{' || str[start] == '[') {
+			size_t pos = start + 1;
+			int level = 1;
+			bool in_string = false;
+			for (; pos < str.size(); pos++) {
+				if (str[pos] == '"') in_string = !in_string;
+				else if (in_string) {
+					if (str[pos] == '\\') pos++;
+				} else if (str[pos] == '{' || str[pos] == '[' || str[pos] == '(') level++;
+				else if (str[pos] == '}' || str[pos] == ']' || str[pos] == ')') level--;
+				if (level == 0) break;
+			}
+			if (level != 0) {
+				debug_error("remove_garbage : the first parenthesis is never closed");
+				return "";
+			}
+			return str.substr(start, pos - start + 1);
+		} else {
+			debug_error("remove_garbage : (, {, [, or ' expected");
+			return "";
+		}
+	}
+	
+	// `html` can contain unnecessary garbage at the end of the actual json data
+	RJson to_json(Document &json_root, const std::string &html, size_t start) {
+		auto content = remove_garbage(html, start);
+		std::string error;
+		auto res = RJson::parse(json_root, (char *) &content[0], error);
+		if (error != "") get_error_json(error);
+		return res;
+	}
+	// search for `var_name` = ' or `var_name` = {
+	bool fast_extract_initial(Document &json_root, const std::string &html, const std::string &var_name, RJson &res) {
+		size_t head = 0;
+		while (head < html.size()) {
+			auto pos = html.find(var_name, head);
+			if (pos == std::string::npos) break;
+			pos += var_name.size();
+			while (pos < html.size() && isspace(html[pos])) pos++;
+			if (pos < html.size() && html[pos] == '=') {
+				pos++;
+				while (pos < html.size() && isspace(html[pos])) pos++;
+				if (pos < html.size() && (html[pos] == '\'' || html[pos] == '{')) {
+					res = to_json(json_root, html, pos);
+					if (res.has_key("Error")) debug_error(std::string("fast_extract_initial : ") + res["Error"].string_value());
+					else if (res.is_valid()) return true;
+				}
+			}
+			head = pos;
+		}
+		return false;
+	}
+	RJson get_succeeding_json_regexes(Document &json_root, const std::string &html, std::vector<const char *> patterns) {
+		for (auto pattern_str : patterns) {
+			std::regex pattern = std::regex(std::string(pattern_str));
+			std::smatch match_res;
+			if (std::regex_search(html, match_res, pattern)) {
+				size_t start = match_res.suffix().first - html.begin() - 1;
+				auto res = to_json(json_root, html, start);
+				if (!res.has_key("Error")) return res;
+			}
+		}
+		return RJson();
+	}
+	RJson get_initial_data(Document &json_root, const std::string &html) {
+		RJson res;
+		if (fast_extract_initial(json_root, html, "ytInitialData", res)) return res;
+		res = get_succeeding_json_regexes(json_root, html, {
+			"window\\[['\\\"]ytInitialData['\\\"]]\\s*=\\s*['\\{]",
+			"ytInitialData\\s*=\\s*['\\{]"
+		});
+		if (!res.is_valid()) return get_error_json("did not match any of the ytInitialData regexes");
+		return res;
+	}
+}
+
+bool bench_initial_json(int iterations) {
+	bool ok = true;
+	const std::string &escaped_page = get_fixture("channel_page.html");
+	const std::string &raw_json = get_fixture("channel_browse.json"); // the same data as the one embedded in the page
+	const std::string var_prefix = "var ytInitialData = '";
+	size_t json_start = escaped_page.find(var_prefix);
+	size_t json_end = json_start == std::string::npos ? std::string::npos : escaped_page.find("';", json_start);
+	if (json_end == std::string::npos) {
+		fprintf(stderr, "initial json : ytInitialData not found in channel_page.html\n");
+		return false;
+	}
+	std::string object_page = escaped_page.substr(0, json_start) + "var ytInitialData = " + raw_json + escaped_page.substr(json_end + 1);
+	std::string window_page = escaped_page.substr(0, json_start) + "window[\"ytInitialData\"] = " + escaped_page.substr(json_start + var_prefix.size() - 1);
+	struct Case {
+		const char *name;
+		const std::string *page;
+	};
+	Case cases[] = {
+		{"var ytInitialData = '...'", &escaped_page},
+		{"var ytInitialData = {...}", &object_page},
+		{"window[\"ytInitialData\"] = '...'", &window_page},
+	};
+	
+	print_header(("channel page (" + std::to_string(escaped_page.size() / 1024) + " KiB), extraction + parse").c_str());
+	for (auto &cur_case : cases) {
+		const std::string &page = *cur_case.page;
+		auto run_old = [&] () {
+			Document json_root;
+			return old_extract::get_initial_data(json_root, page)["metadata"].dump();
+		};
+		auto run_new = [&] () {
+			std::string html = page; // modified in place (the parser hands over the response body instead)
+			Document json_root;
+			return extract_initial_json(json_root, html, "ytInitialData")["metadata"].dump();
+		};
+		std::string old_res = run_old(), new_res = run_new();
+		if (old_res != new_res || old_res == "(null)") {
+			fprintf(stderr, "initial json : %s : the extracted data differ\n", cur_case.name);
+			ok = false;
+		}
+		print_measurement(std::string(cur_case.name) + ", old", measure(iterations, [&] () { bench_sink = run_old().size(); }));
+		print_measurement(std::string(cur_case.name) + ", new", measure(iterations, [&] () { bench_sink = run_new().size(); }));
+	}
+	return ok;
+}
@@ -0,0 +1,60 @@
+// parse_json_destructive() (documents allocated from the arena, arrays iterated with array_range())
+// vs what it used to do (a fresh Document per parse, arrays copied out with array_items()), walking every item and thumbnail of a browse response
+#include <cstdio>
+#include "internal_common.hpp"
+#include "bench.hpp"
+
+// the number of thumbnails seen, so that both walks can be compared and none of them is optimized out
+static int walk_with_range(RJson data) {
+	int res = 0;
+	for (auto tab : data["contents"]["singleColumnBrowseResultsRenderer"]["tabs"].array_range())
+		for (auto section : tab["tabRenderer"]["content"]["sectionListRenderer"]["contents"].array_range())
+			for (auto item : section["itemSectionRenderer"]["contents"].array_range())
+				for (auto thumbnail : item["videoWithContextRenderer"]["thumbnail"]["thumbnails"].array_range())
+					res += thumbnail["width"].int_value() > 0;
+	return res;
+}
+static int walk_with_items(RJson data) {
+	int res = 0;
+	for (auto tab : data["contents"]["singleColumnBrowseResultsRenderer"]["tabs"].array_items())
+		for (auto section : tab["tabRenderer"]["content"]["sectionListRenderer"]["contents"].array_items())
+			for (auto item : section["itemSectionRenderer"]["contents"].array_items())
+				for (auto thumbnail : item["videoWithContextRenderer"]["thumbnail"]["thumbnails"].array_items())
+					res += thumbnail["width"].int_value() > 0;
+	return res;
+}
+
+bool bench_json_arena(int iterations) {
+	iterations *= 10;
+	const std::string &body = get_fixture("home.json");
+	int arena_num = -1, plain_num = -2;
+	auto parse_arena = [&] () {
+		std::string buffer = body;
+		parse_json_destructive(&buffer[0],
+			[&] (Document &, RJson data) { arena_num = walk_with_range(data); },
+			[&] (const std::string &) { arena_num = -1; });
+	};
+	auto parse_arena_items = [&] () { // the two changes apart
+		std::string buffer = body;
+		parse_json_destructive(&buffer[0],
+			[&] (Document &, RJson data) { walk_with_items(data); },
+			[&] (const std::string &) {});
+	};
+	auto parse_plain = [&] () {
+		std::string buffer = body;
+		std::string error;
+		Document json_root;
+		RJson data = RJson::parse_inplace(json_root, &buffer[0], error);
+		plain_num = error == "" ? walk_with_items(data) : -2;
+	};
+	parse_arena();
+	parse_plain();
+	bool ok = arena_num > 0 && arena_num == plain_num;
+	if (!ok) fprintf(stderr, "json arena : the walks disagree (%d vs %d)\n", arena_num, plain_num);
+
+	print_header(("home.json (" + std::to_string(body.size() / 1024) + " KiB), parse + walk, copy of the body included").c_str());
+	print_measurement("fresh Document, array_items()", measure(iterations, parse_plain));
+	print_measurement("arena, array_items()", measure(iterations, parse_arena_items));
+	print_measurement("arena, array_range()", measure(iterations, parse_arena));
+	return ok;
+}
@@ -0,0 +1,107 @@
+// RJsonPath / RJsonPathSet vs chains of the old RJson::operator[] (HasMember() followed by a second lookup), on the fields video.cpp reads
+#include <cstdio>
+#include "internal_common.hpp"
+#include "bench.hpp"
+
+static Value *old_get(Value *json, const char *key) {
+	return json && json->IsObject() && json->HasMember(key) ? &(*json)[key] : nullptr;
+}
+static Value *old_get(Value *json, std::initializer_list<const char *> keys) {
+	for (auto key : keys) json = old_get(json, key);
+	return json;
+}
+static std::string old_string(const Value *json) { return json && json->IsString() ? json->GetString() : ""; }
+
+bool bench_json_path(int iterations) {
+	iterations *= 100;
+	bool ok = true;
+	const int REPEAT = 100; // lookups per run, as one takes well under a microsecond
+
+	std::string next_body = get_fixture("next.json");
+	std::string player_body = get_fixture("player.json");
+	Document next_document, player_document;
+	next_document.ParseInsitu(&next_body[0]);
+	player_document.ParseInsitu(&player_body[0]);
+
+	// the like count, in the first button of the action bar of the watch page
+	Value *button = nullptr;
+	Value *contents = old_get(&next_document, {"contents", "singleColumnWatchNextResults", "results", "results", "contents"});
+	if (contents && contents->IsArray()) for (auto &content : contents->GetArray()) {
+		Value *items = old_get(&content, {"slimVideoMetadataSectionRenderer", "contents"});
+		if (items && items->IsArray()) for (auto &item : items->GetArray()) {
+			Value *buttons = old_get(&item, {"slimVideoActionBarRenderer", "buttons"});
+			if (!button && buttons && buttons->IsArray() && buttons->Size()) button = &(*buttons)[0];
+		}
+	}
+	if (!button) {
+		fprintf(stderr, "json path : no like button in next.json\n");
+		return false;
+	}
+	auto old_like = [&] () {
+		std::string res;
+		// as extract_like_dislike_counts() did : a has_key() for each renderer, then the whole chain from the button
+		if (old_get(button, "slimMetadataToggleButtonRenderer")) res = "?";
+		if (old_get(button, "slimMetadataButtonRenderer") && old_get(button, {"slimMetadataButtonRenderer", "button", "segmentedLikeDislikeButtonRenderer"})) res = "?";
+		if (old_get(button, "slimMetadataButtonRenderer") && old_get(button, {"slimMetadataButtonRenderer", "button", "segmentedLikeDislikeButtonViewModel"}))
+			res = old_string(old_get(button, {"slimMetadataButtonRenderer", "button", "segmentedLikeDislikeButtonViewModel", "likeButtonViewModel",
+				"likeButtonViewModel", "toggleButtonViewModel", "toggleButtonViewModel", "defaultButtonViewModel", "buttonViewModel", "title"}));
+		return res;
+	};
+	static const RJsonPathSet button_paths({
+		"slimMetadataToggleButtonRenderer",
+		"slimMetadataButtonRenderer.button.segmentedLikeDislikeButtonRenderer",
+		"slimMetadataButtonRenderer.button.segmentedLikeDislikeButtonViewModel"
+	});
+	static const RJsonPath view_model_title_path("likeButtonViewModel.likeButtonViewModel.toggleButtonViewModel.toggleButtonViewModel.defaultButtonViewModel.buttonViewModel.title");
+	auto new_like = [&] () {
+		std::string res;
+		RJson renderers[3];
+		RJson(*button).extract(button_paths, renderers);
+		if (renderers[0].is_valid() || renderers[1].is_valid()) res = "?";
+		if (renderers[2].is_valid()) res = renderers[2][view_model_title_path].string_value();
+		return res;
+	};
+
+	// the fields of each stream format
+	std::vector<Value *> formats;
+	for (auto key : {"formats", "adaptiveFormats"}) {
+		Value *list = old_get(&player_document, {"streamingData", key});
+		if (list && list->IsArray()) for (auto &format : list->GetArray()) formats.push_back(&format);
+	}
+	auto old_formats = [&] () {
+		size_t res = 0; // a checksum of the fields read
+		for (auto format : formats) {
+			// as extract_player_data() did
+			if (old_get(format, "targetDurationSec")) res += old_get(format, "targetDurationSec")->GetInt();
+			if (old_string(old_get(format, "approxDurationMs")) != "") res += old_string(old_get(format, "approxDurationMs")).size();
+			if (old_string(old_get(format, "type")) == "FORMAT_STREAM_TYPE_OTF") continue;
+			res += old_string(old_get(format, "mimeType")).size();
+		}
+		return res;
+	};
+	static const RJsonPathSet format_paths({"targetDurationSec", "approxDurationMs", "type", "mimeType"});
+	auto new_formats = [&] () {
+		size_t res = 0; // a checksum of the fields read
+		for (auto format : formats) {
+			RJson format_fields[4];
+			RJson(*format).extract(format_paths, format_fields);
+			if (format_fields[0].is_valid()) res += format_fields[0].int_value();
+			if (format_fields[1].string_value() != "") res += format_fields[1].string_value().size();
+			if (format_fields[2].string_value() == "FORMAT_STREAM_TYPE_OTF") continue;
+			res += format_fields[3].string_value().size();
+		}
+		return res;
+	};
+
+	if (old_like() != new_like() || old_like() != "18M" || !old_formats() || old_formats() != new_formats()) {
+		fprintf(stderr, "json path : compiled paths and chained lookups disagree\n");
+		ok = false;
+	}
+
+	print_header(("compiled json paths vs chained lookups, x" + std::to_string(REPEAT) + " per run").c_str());
+	print_measurement("like count, chained operator[]", measure(iterations, [&] () { for (int i = 0; i < REPEAT; i++) bench_sink = old_like().size(); }));
+	print_measurement("like count, RJsonPathSet + RJsonPath", measure(iterations, [&] () { for (int i = 0; i < REPEAT; i++) bench_sink = new_like().size(); }));
+	print_measurement(std::to_string(formats.size()) + " formats, chained operator[]", measure(iterations, [&] () { for (int i = 0; i < REPEAT; i++) bench_sink = old_formats(); }));
+	print_measurement(std::to_string(formats.size()) + " formats, RJsonPathSet", measure(iterations, [&] () { for (int i = 0; i < REPEAT; i++) bench_sink = new_formats(); }));
+	return ok;
+}
@@ -0,0 +1,92 @@
+// measures the parser on the recorded responses in fixtures/ : time, heap allocations and peak heap usage per run
+// usage : bench_parser [fixture directory] [iterations]
+// (the micro benchmarks run `iterations` times a per-case factor)
+// the numbers include copying each response body out of the replay transport, as the network layer hands the parser a fresh string too
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "parser.hpp"
+#include "replay.hpp"
+#include "bench.hpp"
+
+static std::string fixture_dir = "test/youtube_parser/fixtures";
+const std::string &get_fixture(const std::string &name) {
+	static std::map<std::string, std::string> cache;
+	if (!cache.count(name)) {
+		std::ifstream file(fixture_dir + "/" + name, std::ios::binary);
+		std::stringstream sstream;
+		sstream << file.rdbuf();
+		cache[name] = sstream.str();
+		if (cache[name].empty()) fprintf(stderr, "fixture %s missing or empty\n", name.c_str());
+	}
+	return cache[name];
+}
+
+struct Scenario {
+	std::string name;
+	std::function<void ()> func;
+};
+
+static std::vector<Scenario> get_scenarios() {
+	return {
+		{"search + more results", [] () {
+			auto result = youtube_load_search("https://m.youtube.com/results?search_query=3ds%20homebrew");
+			result.load_more_results();
+		}},
+		{"video page", [] () {
+			youtube_load_video_page("https://m.youtube.com/watch?v=dQw4w9WgXcQ&list=PLtest");
+		}},
+		{"video suggestions + comments + caption", [] () {
+			static auto base = youtube_load_video_page("https://m.youtube.com/watch?v=dQw4w9WgXcQ");
+			auto result = base;
+			result.load_more_suggestions();
+			result.load_more_comments();
+			result.load_caption("en", "");
+		}},
+		{"channel by id", [] () {
+			youtube_load_channel_page("UC2OAPZZqBKRCK_Z1IyYLSWF");
+		}},
+		{"channel by url (html)", [] () {
+			youtube_load_channel_page("https://m.youtube.com/@nightchannel");
+		}},
+		{"channel x3 + playlists", [] () {
+			auto results = youtube_load_channel_page_multi({"UC2OAPZZqBKRCK_Z1IyYLSWF", "UC2OAPZZqBKRCK_Z1IyYLSWF", "UC2OAPZZqBKRCK_Z1IyYLSWF"}, nullptr);
+			results[0].load_playlists();
+		}},
+		{"home + more results", [] () {
+			auto result = youtube_load_home_page();
+			result.load_more_results();
+		}},
+	};
+}
+
+int main(int argc, char **argv) {
+	if (argc >= 2) fixture_dir = argv[1];
+	int iterations = argc >= 3 ? atoi(argv[2]) : 50;
+	if (iterations <= 0) iterations = 1;
+	if (!replay_load(fixture_dir)) return 1;
+	youtube_set_transport(replay_transport());
+	std::cerr.rdbuf(nullptr); // the debug output of the parser would dominate the timings
+
+	print_header("scenarios (replayed responses)");
+	for (auto &scenario : get_scenarios())
+		print_measurement(scenario.name, measure(iterations, scenario.func));
+
+	// comparisons with what the parser used to do
+	bool ok = true;
+	ok &= bench_request_template(iterations);
+	ok &= bench_selective_parse(iterations);
+	ok &= bench_json_arena(iterations);
+	ok &= bench_json_path(iterations);
+	ok &= bench_succinct_item(iterations);
+	ok &= bench_initial_json(iterations);
+
+	for (auto &request : replay_get_unmatched()) fprintf(stderr, "unmatched request : %s\n", request.c_str());
+	return ok && replay_get_unmatched().empty() ? 0 : 1;
+}
@@ -0,0 +1,53 @@
+// RequestTemplate::render() vs the std::regex_replace pass per placeholder the innertube POST bodies used to be built with
+#include <regex>
+#include <cstdio>
+#include "internal_common.hpp"
+#include "bench.hpp"
+
+static const char *VIDEO_BODY = R"({"videoId": "%0", %1"context": {"client": {"hl": "%2","gl": "%3","clientName": "IOS","clientVersion": "19.29.1","deviceMake": "Apple","deviceModel": "19.29.1","osName": "iPhone","userAgent": "com.google.ios.youtube/19.29.1 (iPhone16,2; U; CPU iOS 17_5_1 like Mac OS X;)\"","osVersion": "17.5.1.21F90"}}, "playbackContext": {"contentPlaybackContext": {"signatureTimestamp": %4}}})";
+static const char *CONTINUATION_BODY = R"({"context": {"client": {"hl": "%0", "gl": "%1", "clientName": "MWEB", "clientVersion": "2.20210711.08.00", "utcOffsetMinutes": 0}, "request": {}, "user": {}}, "continuation": "%2"})";
+
+bool bench_request_template(int iterations) {
+	iterations *= 100;
+	bool ok = true;
+	const std::string video_id = "dQw4w9WgXcQ";
+	const std::string playlist_member = "\"playlistId\": \"PLrAXtmErZgOeiKm4sgNOknGvNjby9efdf\", ";
+	const std::string hl = "en", gl = "US", sts = "19950";
+	// continuation tokens are base64 of ~100 - 300 bytes
+	const std::string token = "4qmFsgKrARIYVUMyT0FQWlpxQktSQ0tfWjFJeVlMU1dGGnRFZ1oyYVdSbGIzTVlBeUFBTUFFNEFlb0RPRU5uUVRaSGVGVklUa1JPZFZwR1JtZFdWVlkwVkVkMGMyUlVXVEJVVkVKRVZHNVNUbGRVUm10a2JFNXpZV3hTVmxZeFNrUlRWVlpPWkRKT2Nrd3dkRWxoYldSRVZVaFNSa3d3YzNsYWJGcDZZVlJLVGxac1ZUSmpNSGd6V2tSc1YxWkhPVVphYTFKVFZXMU5lV0pIY0ZwU1ZXeHNZbXRhYm1OVVdreFdSV3gzVWpOd05GUlVWVEpoVmtwSFZFWlZkMVJHVmxkU1JWSnVTMFpwT0VGSw%3D%3D";
+
+	auto regex_video = [&] () {
+		std::string res = VIDEO_BODY;
+		res = std::regex_replace(res, std::regex("%0"), video_id);
+		res = std::regex_replace(res, std::regex("%1"), playlist_member);
+		res = std::regex_replace(res, std::regex("%2"), hl);
+		res = std::regex_replace(res, std::regex("%3"), gl);
+		res = std::regex_replace(res, std::regex("%4"), sts);
+		return res;
+	};
+	auto regex_continuation = [&] () {
+		std::string res = CONTINUATION_BODY;
+		res = std::regex_replace(res, std::regex("%0"), hl);
+		res = std::regex_replace(res, std::regex("%1"), gl);
+		res = std::regex_replace(res, std::regex("%2"), token);
+		return res;
+	};
+	static const RequestTemplate video_template(VIDEO_BODY);
+	static const RequestTemplate continuation_template(CONTINUATION_BODY);
+	auto template_video = [&] () {
+		return video_template.render({video_id, RequestTemplate::raw(playlist_member), hl, gl, RequestTemplate::raw(sts)});
+	};
+	auto template_continuation = [&] () { return continuation_template.render({hl, gl, token}); };
+
+	if (regex_video() != template_video() || regex_continuation() != template_continuation()) {
+		fprintf(stderr, "request template : the rendered bodies differ from the regex ones\n");
+		ok = false;
+	}
+
+	print_header("request bodies (RequestTemplate vs std::regex_replace)");
+	print_measurement("video body, regex_replace x5", measure(iterations, [&] () { regex_video(); }));
+	print_measurement("video body, RequestTemplate", measure(iterations, [&] () { template_video(); }));
+	print_measurement("continuation body, regex_replace x3", measure(iterations, [&] () { regex_continuation(); }));
+	print_measurement("continuation body, RequestTemplate", measure(iterations, [&] () { template_continuation(); }));
+	return ok;
+}
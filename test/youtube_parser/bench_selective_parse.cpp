@@ -0,0 +1,65 @@
+// RJson::parse_inplace_selective() vs a full in-situ parse, on the player and next responses of the video page
+// both use a plain Document (not the arena of the parser) so that the size of what gets materialized shows up
+#include <cstdio>
+#include "internal_common.hpp"
+#include "bench.hpp"
+
+bool bench_selective_parse(int iterations) {
+	iterations *= 10;
+	bool ok = true;
+	struct Case {
+		const char *fixture;
+		std::vector<const char *> paths; // the same as in video.cpp
+	};
+	Case cases[] = {
+		{"player.json", {"playabilityStatus", "videoDetails", "streamingData"}},
+		{"player_mweb.json", {"captions"}},
+		{"next.json", {"contents.singleColumnWatchNextResults", "engagementPanels"}},
+	};
+
+	print_header("video page responses (selective vs full parse, copy of the body included)");
+	for (auto &cur_case : cases) {
+		const std::string &body = get_fixture(cur_case.fixture);
+		size_t full_pool_size = 0, selective_pool_size = 0;
+		auto parse_full = [&] (std::string &buffer, Document &document) {
+			std::string error;
+			RJson res = RJson::parse_inplace(document, &buffer[0], error);
+			full_pool_size = document.GetAllocator().Size();
+			return res;
+		};
+		auto parse_selective = [&] (std::string &buffer, Document &document) {
+			std::string error;
+			RJson res = RJson::parse_inplace_selective(document, &buffer[0], cur_case.paths, error);
+			selective_pool_size = document.GetAllocator().Size();
+			return res;
+		};
+
+		{ // the values at the paths must come out the same
+			std::string full_buffer = body, selective_buffer = body;
+			Document full_document, selective_document;
+			RJson full = parse_full(full_buffer, full_document);
+			RJson selective = parse_selective(selective_buffer, selective_document);
+			for (auto path : cur_case.paths) {
+				RJsonPath compiled(path);
+				if (!full[compiled].is_valid() || full[compiled].dump() != selective[compiled].dump()) {
+					fprintf(stderr, "selective parse : %s of %s differs from the full parse\n", path, cur_case.fixture);
+					ok = false;
+				}
+			}
+		}
+
+		std::string name = std::string(cur_case.fixture) + " (" + std::to_string(body.size() / 1024) + " KiB)";
+		print_measurement(name + ", full", measure(iterations, [&] () {
+			std::string buffer = body;
+			Document document;
+			parse_full(buffer, document);
+		}));
+		print_measurement(name + ", selective", measure(iterations, [&] () {
+			std::string buffer = body;
+			Document document;
+			parse_selective(buffer, document);
+		}));
+		printf("  allocator pool : full %zu KiB, selective %zu KiB\n", full_pool_size / 1024, selective_pool_size / 1024);
+	}
+	return ok;
+}
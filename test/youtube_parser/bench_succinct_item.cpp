@@ -0,0 +1,86 @@
+// the packed YouTubeSuccinctItem vs the one it replaced (a video, a channel and a playlist at once, one std::string per field),
+// on the items of a search with its continuation
+#include <cstdio>
+#include <cstring>
+#include "parser.hpp"
+#include "bench.hpp"
+
+namespace {
+	struct OldSuccinctItem {
+		enum {
+			VIDEO,
+			CHANNEL,
+			PLAYLIST
+		} type;
+		YouTubeVideoSuccinct video;
+		YouTubeChannelSuccinct channel;
+		YouTubePlaylistSuccinct playlist;
+		
+		OldSuccinctItem () = default;
+		OldSuccinctItem (YouTubeVideoSuccinct video) : type(VIDEO), video(video) {}
+		OldSuccinctItem (YouTubeChannelSuccinct channel) : type(CHANNEL), channel(channel) {}
+		OldSuccinctItem (YouTubePlaylistSuccinct playlist) : type(PLAYLIST), playlist(playlist) {}
+		
+		std::string get_url() const { return type == VIDEO ? video.url : type == CHANNEL ? channel.id : playlist.url; }
+		std::string get_thumbnail_url() const { return type == VIDEO ? video.thumbnail_url : type == CHANNEL ? channel.icon_url : playlist.thumbnail_url; }
+		std::string get_name() const { return type == VIDEO ? video.title : type == CHANNEL ? channel.name : playlist.title; }
+	};
+}
+
+bool bench_succinct_item(int iterations) {
+	iterations *= 20;
+	auto search = youtube_load_search("https://m.youtube.com/results?search_query=3ds%20homebrew");
+	search.load_more_results();
+	
+	// what the parser extracts, before it is turned into items
+	std::vector<YouTubeVideoSuccinct> videos;
+	std::vector<YouTubeChannelSuccinct> channels;
+	std::vector<YouTubePlaylistSuccinct> playlists;
+	for (auto &item : search.results) {
+		if (item.type == YouTubeSuccinctItem::VIDEO) videos.push_back(item.get_video());
+		if (item.type == YouTubeSuccinctItem::CHANNEL) channels.push_back(item.get_channel());
+		if (item.type == YouTubeSuccinctItem::PLAYLIST) playlists.push_back(item.get_playlist());
+	}
+	auto build_old = [&] () {
+		std::vector<OldSuccinctItem> res;
+		for (auto &video : videos) res.push_back(OldSuccinctItem(video));
+		for (auto &channel : channels) res.push_back(OldSuccinctItem(channel));
+		for (auto &playlist : playlists) res.push_back(OldSuccinctItem(playlist));
+		return res;
+	};
+	auto build_packed = [&] () {
+		std::vector<YouTubeSuccinctItem> res;
+		for (auto &video : videos) res.push_back(YouTubeSuccinctItem(video));
+		for (auto &channel : channels) res.push_back(YouTubeSuccinctItem(channel));
+		for (auto &playlist : playlists) res.push_back(YouTubeSuccinctItem(playlist));
+		return res;
+	};
+	const auto old_items = build_old();
+	const auto packed_items = build_packed();
+	
+	// what a list view reads from each item
+	auto read_old = [&] () {
+		size_t res = 0;
+		for (auto &item : old_items) res += item.get_name().size() + item.get_thumbnail_url().size() + item.get_url().size();
+		return res;
+	};
+	auto read_packed = [&] () {
+		size_t res = 0;
+		for (auto &item : packed_items) res += strlen(item.get_name()) + strlen(item.get_thumbnail_url()) + strlen(item.get_url());
+		return res;
+	};
+	
+	bool ok = old_items.size() == packed_items.size() && read_old() == read_packed();
+	for (size_t i = 0; ok && i < old_items.size(); i++) ok = old_items[i].get_name() == packed_items[i].get_name();
+	if (!ok) fprintf(stderr, "succinct item : the packed items differ from the old ones\n");
+	
+	print_header((std::to_string(old_items.size()) + " search result items (packed YouTubeSuccinctItem vs one std::string per field)").c_str());
+	printf("  sizeof : old %zu, packed %zu\n", sizeof(OldSuccinctItem), sizeof(YouTubeSuccinctItem));
+	print_measurement("build the list, old", measure(iterations, [&] () { bench_sink = build_old().size(); }));
+	print_measurement("build the list, packed", measure(iterations, [&] () { bench_sink = build_packed().size(); }));
+	print_measurement("copy the list, old", measure(iterations, [&] () { auto copy = old_items; bench_sink = copy.size(); }));
+	print_measurement("copy the list, packed", measure(iterations, [&] () { auto copy = packed_items; bench_sink = copy.size(); }));
+	print_measurement("read name, thumbnail and url, old", measure(iterations, [&] () { bench_sink = read_old(); }));
+	print_measurement("read name, thumbnail and url, packed", measure(iterations, [&] () { bench_sink = read_packed(); }));
+	return ok;
+}
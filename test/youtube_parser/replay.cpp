@@ -0,0 +1,72 @@
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include "replay.hpp"
+
+namespace {
+	struct ReplayEntry {
+		std::string method;
+		std::string url_pattern;
+		std::string body_pattern; // empty for any
+		std::string response;
+	};
+	std::vector<ReplayEntry> entries;
+	int request_num = 0;
+	std::vector<std::string> unmatched;
+
+	bool read_file(const std::string &path, std::string &out) {
+		std::ifstream file(path, std::ios::binary);
+		if (!file) return false;
+		std::stringstream sstream;
+		sstream << file.rdbuf();
+		out = sstream.str();
+		return true;
+	}
+}
+
+bool replay_load(const std::string &fixture_dir) {
+	entries.clear();
+	std::ifstream manifest(fixture_dir + "/replay.txt");
+	if (!manifest) {
+		std::cerr << "replay : cannot open " << fixture_dir << "/replay.txt" << std::endl;
+		return false;
+	}
+	std::string line;
+	while (std::getline(manifest, line)) {
+		if (line.empty() || line[0] == '#') continue;
+		std::stringstream sstream(line);
+		ReplayEntry entry;
+		std::string file_name;
+		if (!(sstream >> entry.method >> entry.url_pattern >> entry.body_pattern >> file_name)) {
+			std::cerr << "replay : malformed line : " << line << std::endl;
+			return false;
+		}
+		if (entry.body_pattern == "-") entry.body_pattern = "";
+		if (!read_file(fixture_dir + "/" + file_name, entry.response)) {
+			std::cerr << "replay : cannot read " << file_name << std::endl;
+			return false;
+		}
+		entries.push_back(std::move(entry));
+	}
+	return true;
+}
+
+YouTubeTransport replay_transport() {
+	return [] (const std::string &method, const std::string &url, const std::map<std::string, std::string> &, const std::string &body) {
+		request_num++;
+		for (auto &entry : entries) {
+			if (entry.method != method || url.find(entry.url_pattern) == std::string::npos) continue;
+			if (entry.body_pattern.size() && body.find(entry.body_pattern) == std::string::npos) continue;
+			return std::pair<bool, std::string>(true, entry.response);
+		}
+		unmatched.push_back(method + " " + url);
+		return std::pair<bool, std::string>(false, "no recorded response for " + method + " " + url);
+	};
+}
+
+int replay_get_request_num() { return request_num; }
+std::vector<std::string> replay_get_unmatched() { return unmatched; }
+void replay_reset_stats() {
+	request_num = 0;
+	unmatched.clear();
+}
@@ -0,0 +1,13 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "parser.hpp"
+
+// serves the responses listed in `fixture_dir`/replay.txt to the parser through youtube_set_transport()
+// all of the files are read into memory by replay_load(), so that serving a response costs only the copy of its body
+bool replay_load(const std::string &fixture_dir);
+YouTubeTransport replay_transport();
+
+int replay_get_request_num(); // the number of requests served (or failed) since the last replay_reset_stats()
+std::vector<std::string> replay_get_unmatched(); // "METHOD url" of the requests no line matched
+void replay_reset_stats();
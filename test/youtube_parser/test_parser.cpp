@@ -0,0 +1,211 @@
+// replays the recorded responses in fixtures/ through the parser and checks what it extracts
+// usage : test_parser [fixture directory]
+#include <iostream>
+#include <string>
+#include "parser.hpp"
+#include "replay.hpp"
+
+static int check_num = 0;
+static int fail_num = 0;
+#define CHECK(cond) do { \
+	check_num++; \
+	if (!(cond)) { \
+		fail_num++; \
+		std::cerr << __FILE__ << ":" << __LINE__ << " : CHECK(" #cond ") failed" << std::endl; \
+	} \
+} while (0)
+#define CHECK_EQ(a, b) do { \
+	check_num++; \
+	if (!((a) == (b))) { \
+		fail_num++; \
+		std::cerr << __FILE__ << ":" << __LINE__ << " : CHECK_EQ(" #a ", " #b ") failed : " << (a) << " vs " << (b) << std::endl; \
+	} \
+} while (0)
+
+static bool starts_with(const std::string &str, const std::string &prefix) { return str.compare(0, prefix.size(), prefix) == 0; }
+
+static void test_search() {
+	auto result = youtube_load_search("https://m.youtube.com/results?search_query=3ds%20homebrew");
+	CHECK_EQ(result.error, "");
+	CHECK_EQ(result.estimated_result_num, "123456");
+	CHECK_EQ(result.results.size(), 19u); // 17 videos, a channel and a playlist (the shorts shelf is skipped)
+	CHECK_EQ(result.continue_token, "SEARCH_CONT_1");
+	int video_num = 0, channel_num = 0, playlist_num = 0;
+	for (auto &item : result.results) {
+		if (item.type == YouTubeSuccinctItem::VIDEO) {
+			video_num++;
+			auto video = item.get_video();
+			CHECK(youtube_is_valid_video_id(youtube_get_video_id_by_url(video.url)));
+			CHECK(video.title != "");
+			CHECK(video.duration_text != "");
+			CHECK(video.author != "");
+			CHECK(starts_with(video.thumbnail_url, "https://i.ytimg.com/vi/"));
+		} else if (item.type == YouTubeSuccinctItem::CHANNEL) {
+			channel_num++;
+			auto channel = item.get_channel();
+			CHECK_EQ(channel.name, "River Channel");
+			CHECK(starts_with(channel.id, "UC"));
+			CHECK_EQ(channel.subscribers, "1.23M subscribers");
+			CHECK(channel.icon_url != "");
+		} else {
+			playlist_num++;
+			auto playlist = item.get_playlist();
+			CHECK(starts_with(playlist.url, "https://m.youtube.com/watch?v="));
+			CHECK(playlist.url.find("&list=PL") != std::string::npos);
+		}
+	}
+	CHECK_EQ(video_num, 17);
+	CHECK_EQ(channel_num, 1);
+	CHECK_EQ(playlist_num, 1);
+
+	result.load_more_results();
+	CHECK_EQ(result.error, "");
+	CHECK_EQ(result.results.size(), 39u);
+	CHECK_EQ(result.continue_token, "SEARCH_CONT_2");
+}
+
+static void test_video() {
+	auto result = youtube_load_video_page("https://m.youtube.com/watch?v=dQw4w9WgXcQ&list=PLtest");
+	CHECK_EQ(result.error, "");
+	CHECK_EQ(result.id, "dQw4w9WgXcQ");
+	CHECK_EQ(result.title, "Never gonna test you up");
+	CHECK_EQ(result.author.name, "Mountain Channel");
+	CHECK(starts_with(result.author.id, "UC"));
+	CHECK_EQ(result.author.subscribers, "4.1M subscribers");
+	CHECK(starts_with(result.description, "Official video. "));
+	CHECK_EQ(result.publish_date, "Oct 25, 2009");
+	CHECK_EQ(result.views_str, "1,600,000,000 views");
+	CHECK_EQ(result.like_count_str, "18.1M");
+	CHECK_EQ(result.dislike_count_str, "523.5k");
+
+	// player
+	CHECK_EQ(result.playability_status, "OK");
+	CHECK(result.is_playable());
+	CHECK(!result.is_livestream);
+	CHECK_EQ(result.duration_ms, 212091);
+	CHECK(result.audio_stream_url.find("itag=140") != std::string::npos);
+	CHECK_EQ(result.video_stream_urls.size(), 3u);
+	CHECK(result.video_stream_urls[360].find("itag=134") != std::string::npos);
+	CHECK(result.both_stream_url.find("itag=18") != std::string::npos);
+	CHECK(result.audio_stream_url.find("%2C") == std::string::npos); // url-decoded
+
+	// captions (from the second player request)
+	CHECK_EQ(result.caption_base_languages.size(), 3u);
+	CHECK_EQ(result.caption_translation_languages.size(), 12u);
+	if (result.caption_base_languages.size()) {
+		CHECK_EQ(result.caption_base_languages[0].id, "en");
+		CHECK_EQ(result.caption_base_languages[0].name, "English");
+	}
+
+	// suggestions and playlist
+	CHECK_EQ(result.suggestions.size(), 21u); // 20 videos and a mix
+	CHECK_EQ(result.suggestions_continue_token, "SUGGEST_CONT_1");
+	CHECK_EQ(result.playlist.videos.size(), 12u);
+	CHECK_EQ(result.playlist.selected_index, 4);
+	CHECK_EQ(result.playlist.total_videos, 12);
+	CHECK(result.has_next_video_in_playlist());
+	CHECK(result.get_next_video().url.find("&list=" + result.playlist.id) != std::string::npos);
+
+	result.load_more_suggestions();
+	CHECK_EQ(result.error, "");
+	CHECK_EQ(result.suggestions.size(), 41u);
+	CHECK_EQ(result.suggestions_continue_token, "SUGGEST_CONT_2");
+
+	// comments
+	CHECK(!result.comments_disabled);
+	CHECK_EQ(result.comment_continue_type, 1);
+	CHECK_EQ(result.comment_continue_token, "COMMENTS_CONT_1");
+	result.load_more_comments();
+	CHECK_EQ(result.error, "");
+	CHECK_EQ(result.comments.size(), 20u);
+	CHECK_EQ(result.comment_continue_token, "COMMENTS_CONT_2");
+	if (result.comments.size()) {
+		auto &comment = result.comments[0];
+		CHECK(comment.content != "");
+		CHECK(comment.author.name != "");
+		CHECK(comment.author.icon_url != "");
+		CHECK_EQ(comment.replies_continue_token, "REPLIES_CONT_0");
+		comment.load_more_replies();
+		CHECK_EQ(comment.replies.size(), 10u);
+		CHECK(!comment.has_more_replies());
+	}
+
+	result.load_caption("en", "");
+	CHECK_EQ(result.error, "");
+	auto &caption = result.caption_data[{"en", ""}];
+	CHECK_EQ(caption.size(), 100u);
+	if (caption.size() > 1) {
+		CHECK_EQ(caption[1].start_time, 2.0f);
+		CHECK(caption[1].content != "");
+	}
+}
+
+static void check_channel(const YouTubeChannelDetail &result) {
+	CHECK_EQ(result.error, "");
+	CHECK_EQ(result.name, "Night Channel");
+	CHECK(starts_with(result.id, "UC"));
+	CHECK_EQ(result.url, "https://m.youtube.com/channel/" + result.id);
+	CHECK_EQ(result.subscriber_count_str, "1.23M subscribers");
+	CHECK(result.icon_url != "");
+	CHECK(result.banner_url != "");
+	CHECK(starts_with(result.description, "The channel of Night Channel. "));
+	CHECK_EQ(result.videos.size(), 30u);
+	CHECK_EQ(result.continue_token, "CHANNEL_VIDEOS_CONT_1");
+	CHECK(result.has_playlists_to_load());
+}
+
+static void test_channel() {
+	auto result = youtube_load_channel_page("UC2OAPZZqBKRCK_Z1IyYLSWF");
+	check_channel(result);
+	result.load_more_videos();
+	CHECK_EQ(result.error, "");
+	CHECK_EQ(result.videos.size(), 60u);
+	CHECK_EQ(result.continue_token, "CHANNEL_VIDEOS_CONT_2");
+	result.load_playlists();
+	CHECK_EQ(result.error, "");
+	CHECK_EQ(result.playlists.size(), 1u);
+	if (result.playlists.size()) {
+		CHECK_EQ(result.playlists[0].first, "Created playlists");
+		CHECK_EQ(result.playlists[0].second.size(), 8u);
+	}
+
+	// the same data embedded in the html of the channel page
+	check_channel(youtube_load_channel_page("https://www.youtube.com/@nightchannel"));
+
+	int progress_num = 0;
+	auto results = youtube_load_channel_page_multi({"UC2OAPZZqBKRCK_Z1IyYLSWF", "UC2OAPZZqBKRCK_Z1IyYLSWF", "UC2OAPZZqBKRCK_Z1IyYLSWF"},
+		[&] (int, int) { progress_num++; });
+	CHECK_EQ(results.size(), 3u);
+	CHECK_EQ(progress_num, 4); // once before and once per channel
+	for (auto &cur_result : results) check_channel(cur_result);
+}
+
+static void test_home() {
+	auto result = youtube_load_home_page();
+	CHECK_EQ(result.error, "");
+	CHECK_EQ(result.videos.size(), 25u);
+	CHECK_EQ(result.visitor_data, "CgtIT01FVklTSVRPUg%3D%3D");
+	CHECK_EQ(result.continue_token, "HOME_CONT_1");
+	result.load_more_results();
+	CHECK_EQ(result.error, "");
+	CHECK_EQ(result.videos.size(), 50u);
+	CHECK_EQ(result.continue_token, "HOME_CONT_2");
+}
+
+int main(int argc, char **argv) {
+	std::string fixture_dir = argc >= 2 ? argv[1] : "test/youtube_parser/fixtures";
+	if (!replay_load(fixture_dir)) return 1;
+	youtube_set_transport(replay_transport());
+
+	test_search();
+	test_video();
+	test_channel();
+	test_home();
+
+	for (auto &request : replay_get_unmatched()) {
+		fail_num++;
+		std::cerr << "unmatched request : " << request << std::endl;
+	}
+	std::cout << check_num << " checks, " << fail_num << " failures (" << replay_get_request_num() << " requests replayed)" << std::endl;
+	return fail_num ? 1 : 0;
+}